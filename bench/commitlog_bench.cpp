@@ -0,0 +1,270 @@
+// Micro-benchmarks for the hot paths of the object store, tree parsing and
+// the index. Inputs come from synthetic_repo.hpp and are seeded, so numbers
+// are comparable between builds:
+//
+//   cmake --build build --target commitlog_bench
+//   build/commitlog_bench --benchmark_filter=ReadObject
+//
+// Sizes follow blob_sizes() where a benchmark models a whole repository;
+// the per-size benchmarks cover the range it spans (64 B .. 4 MiB).
+
+#include "synthetic_repo.hpp"
+
+#include "entry.hpp"
+#include "i_object_codec.hpp"
+#include "index.hpp"
+#include "object_store.hpp"
+
+#include <benchmark/benchmark.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <random>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace {
+
+constexpr std::uint64_t kSeed = 0x636f6d6d69746c6fULL;
+
+void size_args(benchmark::internal::Benchmark* b) {
+    for (long size : {64L, 1L << 10, 16L << 10, 256L << 10, 4L << 20}) b->Arg(size);
+}
+
+// --------------------------------------------------------------- hashing
+
+void BM_ComputeOid(benchmark::State& state, HashAlgo algo) {
+    std::mt19937_64 rng(kSeed);
+    const std::string object = make_object("blob", text_content(rng, state.range(0)));
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(ObjectStore::compute_oid(object, algo));
+    }
+    state.SetBytesProcessed(state.iterations() * static_cast<std::int64_t>(object.size()));
+}
+BENCHMARK_CAPTURE(BM_ComputeOid, sha1, HashAlgo::Sha1)->Apply(size_args);
+BENCHMARK_CAPTURE(BM_ComputeOid, sha256, HashAlgo::Sha256)->Apply(size_args);
+
+// ----------------------------------------------------------- compression
+// Registered per available codec in main(). Text is the common case;
+// random bytes exercise the incompressible path (level_for() picks 0).
+
+std::string codec_input(bool text, std::size_t size) {
+    std::mt19937_64 rng(kSeed);
+    return text ? text_content(rng, size) : random_content(rng, size);
+}
+
+void BM_Compress(benchmark::State& state, std::string codec_name, bool text) {
+    const auto codec = make_codec(codec_name);
+    const std::string input = codec_input(text, state.range(0));
+    const int level = level_for(input, kDefaultLevel);
+    std::size_t out_size = 0;
+    for (auto _ : state) {
+        const std::string out = codec->compress(input, level);
+        out_size = out.size();
+        benchmark::DoNotOptimize(out.data());
+    }
+    state.SetBytesProcessed(state.iterations() * static_cast<std::int64_t>(input.size()));
+    state.counters["ratio"] = static_cast<double>(input.size()) / static_cast<double>(out_size);
+}
+
+void BM_Decompress(benchmark::State& state, std::string codec_name, bool text) {
+    const auto codec = make_codec(codec_name);
+    const std::string input = codec_input(text, state.range(0));
+    const std::string compressed = codec->compress(input, level_for(input, kDefaultLevel));
+    for (auto _ : state) {
+        const std::string out = codec->decompress(compressed, input.size());
+        benchmark::DoNotOptimize(out.data());
+    }
+    state.SetBytesProcessed(state.iterations() * static_cast<std::int64_t>(input.size()));
+}
+
+// ------------------------------------------------------------ object store
+
+// A pool of blob objects with repository-like sizes. next_fresh() stamps a
+// new counter into the first bytes of the content, so every call stores a
+// new object without copying it.
+class BlobPool {
+public:
+    explicit BlobPool(std::size_t n) {
+        std::mt19937_64 rng(kSeed);
+        for (std::size_t size : blob_sizes(n, kSeed, 1u << 20)) {
+            size = std::max<std::size_t>(size, 16);
+            objects_.push_back(make_object("blob", text_content(rng, size)));
+        }
+    }
+
+    std::string_view next_fresh() {
+        std::string& object = objects_[next_++ % objects_.size()];
+        const std::size_t body = object.find('\0') + 1;
+        const std::string stamp = std::to_string(counter_++);
+        object.replace(body, stamp.size(), stamp);
+        return object;
+    }
+
+    const std::vector<std::string>& objects() const { return objects_; }
+
+private:
+    std::vector<std::string> objects_;
+    std::size_t next_ = 0;
+    std::uint64_t counter_ = 0;
+};
+
+void BM_PutObjectNew(benchmark::State& state) {
+    SyntheticRepo repo;
+    auto store = repo.open_store();
+    BlobPool pool(1024);
+    std::int64_t bytes = 0;
+    for (auto _ : state) {
+        const std::string_view object = pool.next_fresh();
+        benchmark::DoNotOptimize(store->put_object_if_absent(object));
+        bytes += static_cast<std::int64_t>(object.size());
+    }
+    state.SetBytesProcessed(bytes);
+}
+BENCHMARK(BM_PutObjectNew)->Unit(benchmark::kMicrosecond);
+
+// Re-storing objects that exist already: hash plus existence check
+void BM_PutObjectExisting(benchmark::State& state) {
+    SyntheticRepo repo;
+    auto store = repo.open_store();
+    BlobPool pool(1024);
+    for (const auto& object : pool.objects()) store->put_object_if_absent(object);
+    std::size_t i = 0;
+    std::int64_t bytes = 0;
+    for (auto _ : state) {
+        const std::string& object = pool.objects()[i++ % pool.objects().size()];
+        benchmark::DoNotOptimize(store->put_object_if_absent(object));
+        bytes += static_cast<std::int64_t>(object.size());
+    }
+    state.SetBytesProcessed(bytes);
+}
+BENCHMARK(BM_PutObjectExisting)->Unit(benchmark::kMicrosecond);
+
+// One repository per (layout, cache) combination, built on first use and
+// kept for the rest of the run: 2000 files with 4 revisions each.
+struct ReadFixture {
+    std::unique_ptr<SyntheticRepo> repo;
+    std::unique_ptr<ObjectStore> store;
+    std::vector<Oid> oids; // shuffled access order
+};
+
+ReadFixture& read_fixture(bool packed, bool cached) {
+    static std::map<std::pair<bool, bool>, ReadFixture> fixtures;
+    ReadFixture& f = fixtures[{packed, cached}];
+    if (f.repo) return f;
+
+    f.repo = std::make_unique<SyntheticRepo>(HashAlgo::Sha1,
+                                             cached ? "" : "[core]\n\tobjectCacheLimit = 0\n");
+    auto writer = f.repo->open_store();
+    f.oids = f.repo->fill(*writer, 2000, 4, kSeed);
+    if (packed) f.repo->pack(*writer, f.oids);
+    writer.reset();
+
+    f.store = f.repo->open_store();
+    std::shuffle(f.oids.begin(), f.oids.end(), std::mt19937_64(kSeed));
+    return f;
+}
+
+void BM_ReadObject(benchmark::State& state, bool packed, bool cached) {
+    ReadFixture& f = read_fixture(packed, cached);
+    std::size_t i = 0;
+    std::int64_t bytes = 0;
+    for (auto _ : state) {
+        auto obj = f.store->read_object(f.oids[i++ % f.oids.size()]);
+        bytes += static_cast<std::int64_t>(obj->content.size());
+        benchmark::DoNotOptimize(obj);
+    }
+    state.SetBytesProcessed(bytes);
+    if (cached) state.counters["hit_rate"] = f.store->object_cache_stats().hit_rate();
+}
+BENCHMARK_CAPTURE(BM_ReadObject, loose, false, false)->Unit(benchmark::kMicrosecond);
+BENCHMARK_CAPTURE(BM_ReadObject, loose_cached, false, true)->Unit(benchmark::kMicrosecond);
+BENCHMARK_CAPTURE(BM_ReadObject, packed, true, false)->Unit(benchmark::kMicrosecond);
+BENCHMARK_CAPTURE(BM_ReadObject, packed_cached, true, true)->Unit(benchmark::kMicrosecond);
+
+// -------------------------------------------------------------------- trees
+
+void tree_args(benchmark::internal::Benchmark* b) {
+    for (long entries : {10L, 1000L, 100000L}) b->Arg(entries);
+}
+
+void BM_ParseAll(benchmark::State& state) {
+    const std::string payload = tree_payload(state.range(0), HashAlgo::Sha1, kSeed);
+    for (auto _ : state) {
+        EntryParser parser(payload, HashAlgo::Sha1);
+        auto entries = parser.parse_all();
+        benchmark::DoNotOptimize(entries.data());
+    }
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_ParseAll)->Apply(tree_args);
+
+void BM_TreeView(benchmark::State& state) {
+    const std::string payload = tree_payload(state.range(0), HashAlgo::Sha1, kSeed);
+    for (auto _ : state) {
+        std::size_t trees = 0;
+        for (const EntryView& e : TreeView(payload, HashAlgo::Sha1)) trees += e.is_tree();
+        benchmark::DoNotOptimize(trees);
+    }
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_TreeView)->Apply(tree_args);
+
+// -------------------------------------------------------------------- index
+
+void index_args(benchmark::internal::Benchmark* b) {
+    for (long files : {1000L, 10000L, 100000L}) b->Arg(files);
+}
+
+// Repository whose .git/index holds `files` synthetic entries
+std::unique_ptr<SyntheticRepo> index_repo(std::size_t files) {
+    auto repo = std::make_unique<SyntheticRepo>();
+    Index index(repo->git_dir() / "index", HashAlgo::Sha1);
+    for (const auto& e : index_entries(files, HashAlgo::Sha1, kSeed)) index.upsert(e);
+    index.flush();
+    return repo;
+}
+
+void BM_IndexLoad(benchmark::State& state) {
+    const auto repo = index_repo(state.range(0));
+    for (auto _ : state) {
+        Index index(repo->git_dir() / "index", HashAlgo::Sha1);
+        index.load();
+        benchmark::DoNotOptimize(index.entries().size());
+    }
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_IndexLoad)->Apply(index_args)->Unit(benchmark::kMillisecond);
+
+void BM_IndexFlush(benchmark::State& state) {
+    const auto repo = index_repo(state.range(0));
+    Index index(repo->git_dir() / "index", HashAlgo::Sha1);
+    index.load();
+    for (auto _ : state) index.flush();
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_IndexFlush)->Apply(index_args)->Unit(benchmark::kMillisecond);
+
+} // namespace
+
+int main(int argc, char** argv) {
+    for (std::string name : {"zlib", "libdeflate", "zstd"}) {
+        if (!codec_available(name)) continue;
+        for (bool text : {true, false}) {
+            const std::string suffix = name + (text ? "/text" : "/random");
+            benchmark::RegisterBenchmark(("BM_Compress/" + suffix).c_str(), BM_Compress, name, text)
+                ->Apply(size_args);
+            benchmark::RegisterBenchmark(("BM_Decompress/" + suffix).c_str(), BM_Decompress, name, text)
+                ->Apply(size_args);
+        }
+    }
+
+    benchmark::Initialize(&argc, argv);
+    if (benchmark::ReportUnrecognizedArguments(argc, argv)) return 1;
+    benchmark::RunSpecifiedBenchmarks();
+    benchmark::Shutdown();
+    return 0;
+}
@@ -0,0 +1,189 @@
+#include "synthetic_repo.hpp"
+
+#include "pack_writer.hpp"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <stdexcept>
+#include <unistd.h>
+
+std::vector<std::size_t> blob_sizes(std::size_t n, std::uint64_t seed, std::size_t max_size) {
+    std::mt19937_64 rng(seed);
+    // ln(2048) ~ 7.6; sigma 1.5 puts the 10th/90th percentiles near 300 B
+    // and 14 KiB
+    std::lognormal_distribution<double> dist(7.6, 1.5);
+    std::vector<std::size_t> sizes(n);
+    for (auto& s : sizes) {
+        s = std::clamp<std::size_t>(static_cast<std::size_t>(dist(rng)), 1, max_size);
+    }
+    return sizes;
+}
+
+std::string text_content(std::mt19937_64& rng, std::size_t size) {
+    static constexpr std::string_view kWords[] = {
+        "return", "const",  "auto",  "std::string", "size",   "if",    "for",   "object",
+        "oid",    "store",  "pack",  "offset",      "buffer", "while", "void",  "int",
+        "data",   "header", "entry", "index",       "path",   "tree",  "commit", "++i",
+    };
+    static constexpr std::string_view kPunct[] = {" = ", "(", ");", ", ", " {", "}", " + ", "->"};
+
+    std::string out;
+    out.reserve(size + 64);
+    std::uniform_int_distribution<std::size_t> word(0, std::size(kWords) - 1);
+    std::uniform_int_distribution<std::size_t> punct(0, std::size(kPunct) - 1);
+    std::uniform_int_distribution<int> indent(0, 3);
+    std::uniform_int_distribution<int> tokens(2, 9);
+    while (out.size() < size) {
+        out.append(4 * indent(rng), ' ');
+        for (int t = tokens(rng); t > 0; --t) {
+            out += kWords[word(rng)];
+            out += kPunct[punct(rng)];
+        }
+        out += '\n';
+    }
+    out.resize(size);
+    return out;
+}
+
+std::string random_content(std::mt19937_64& rng, std::size_t size) {
+    std::string out(size, '\0');
+    std::size_t i = 0;
+    for (; i + 8 <= size; i += 8) {
+        const std::uint64_t v = rng();
+        std::memcpy(&out[i], &v, 8);
+    }
+    for (; i < size; ++i) out[i] = static_cast<char>(rng());
+    return out;
+}
+
+std::string make_object(std::string_view type, std::string_view content) {
+    std::string out;
+    out.reserve(type.size() + 24 + content.size());
+    out.append(type);
+    out.push_back(' ');
+    out.append(std::to_string(content.size()));
+    out.push_back('\0');
+    out.append(content);
+    return out;
+}
+
+static Oid random_oid(std::mt19937_64& rng, HashAlgo algo) {
+    Oid oid{};
+    oid.algo = algo;
+    for (std::size_t i = 0; i < oid.size(); ++i) oid.bytes[i] = static_cast<unsigned char>(rng());
+    return oid;
+}
+
+std::string tree_payload(std::size_t entries, HashAlgo algo, std::uint64_t seed) {
+    std::mt19937_64 rng(seed);
+    // Fixed-width numbering keeps the names in Git's sort order
+    std::string payload;
+    char name[32];
+    for (std::size_t i = 0; i < entries; ++i) {
+        const Oid oid = random_oid(rng, algo);
+        std::string_view mode = "100644";
+        if (i % 16 == 0) {
+            mode = "40000";
+            std::snprintf(name, sizeof(name), "dir_%07zu", i);
+        } else {
+            if (i % 29 == 0) mode = "100755";
+            std::snprintf(name, sizeof(name), "file_%07zu.cpp", i);
+        }
+        payload.append(mode);
+        payload.push_back(' ');
+        payload.append(name);
+        payload.push_back('\0');
+        payload.append(reinterpret_cast<const char*>(oid.bytes), oid.size());
+    }
+    return payload;
+}
+
+std::vector<IndexEntry> index_entries(std::size_t files, HashAlgo algo, std::uint64_t seed) {
+    std::mt19937_64 rng(seed);
+    std::vector<IndexEntry> out;
+    out.reserve(files);
+    char path[64];
+    for (std::size_t i = 0; i < files; ++i) {
+        // ~32 files per directory, two levels deep
+        const std::size_t dir = i / 32;
+        std::snprintf(path, sizeof(path), "d%03zu/d%03zu/file_%07zu.cpp", dir / 64, dir % 64, i);
+        IndexEntry e;
+        e.path = path;
+        e.mode = i % 29 == 0 ? "100755" : "100644";
+        e.oid = random_oid(rng, algo);
+        e.stat.ctime_sec = e.stat.mtime_sec = 1700000000u + static_cast<std::uint32_t>(rng() % 1000000);
+        e.stat.ctime_nsec = e.stat.mtime_nsec = static_cast<std::uint32_t>(rng() % 1000000000);
+        e.stat.dev = 2049;
+        e.stat.ino = static_cast<std::uint32_t>(1000000 + i);
+        e.stat.uid = e.stat.gid = 1000;
+        e.stat.size = static_cast<std::uint32_t>(rng() % 65536);
+        out.push_back(std::move(e));
+    }
+    return out;
+}
+
+SyntheticRepo::SyntheticRepo(HashAlgo algo, std::string_view extra_config) : algo_(algo) {
+    std::string tmpl = (fs::temp_directory_path() / "commitlog-bench-XXXXXX").string();
+    if (!mkdtemp(tmpl.data())) throw std::runtime_error("mkdtemp failed for " + tmpl);
+    root_ = tmpl;
+
+    fs::create_directories(objects_dir() / "pack");
+    fs::create_directories(git_dir() / "refs" / "heads");
+    std::ofstream(git_dir() / "HEAD") << "ref: refs/heads/main\n";
+
+    std::ofstream config(git_dir() / "config");
+    if (algo == HashAlgo::Sha256) {
+        config << "[core]\n\trepositoryformatversion = 1\n"
+               << "[extensions]\n\tobjectformat = sha256\n";
+    } else {
+        config << "[core]\n\trepositoryformatversion = 0\n";
+    }
+    config << extra_config;
+}
+
+SyntheticRepo::~SyntheticRepo() {
+    std::error_code ec;
+    fs::remove_all(root_, ec);
+}
+
+std::unique_ptr<ObjectStore> SyntheticRepo::open_store(std::string_view codec) const {
+    return std::make_unique<ObjectStore>(make_codec(codec), objects_dir());
+}
+
+std::vector<Oid> SyntheticRepo::fill(ObjectStore& store, std::size_t files, std::size_t revisions,
+                                     std::uint64_t seed) const {
+    std::mt19937_64 rng(seed);
+    const auto sizes = blob_sizes(files, seed);
+    std::vector<Oid> oids;
+    oids.reserve(files * revisions);
+    for (std::size_t f = 0; f < files; ++f) {
+        std::string content = text_content(rng, sizes[f]);
+        oids.push_back(store.put_object_if_absent(make_object("blob", content)).oid);
+        for (std::size_t r = 1; r < revisions; ++r) {
+            // Rewrite a handful of 64-byte stretches, like a small commit
+            for (int edit = 0; edit < 4; ++edit) {
+                const std::size_t len = std::min<std::size_t>(64, content.size());
+                const std::size_t at = rng() % (content.size() - len + 1);
+                content.replace(at, len, text_content(rng, len));
+            }
+            oids.push_back(store.put_object_if_absent(make_object("blob", content)).oid);
+        }
+    }
+    return oids;
+}
+
+void SyntheticRepo::pack(ObjectStore& store, const std::vector<Oid>& oids) const {
+    write_pack(store, oids, objects_dir() / "pack");
+    store.reprepare_packs();
+    for (const auto& oid : oids) {
+        const auto hex = oid.hex();
+        const fs::path dir = objects_dir() / hex.view().substr(0, 2);
+        std::error_code ec;
+        fs::remove(dir / hex.view().substr(2), ec);
+        fs::remove(dir, ec); // only succeeds once the fan-out dir is empty
+    }
+}
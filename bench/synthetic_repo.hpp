@@ -0,0 +1,74 @@
+#pragma once
+
+#include "index.hpp"
+#include "object_store.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <memory>
+#include <random>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace fs = std::filesystem;
+
+// Synthetic inputs for the benchmarks. Everything is derived from a seed, so
+// runs are comparable across builds.
+
+// Blob sizes drawn from a log-normal distribution fitted to source trees:
+// median around 2 KiB, most files between 200 B and 30 KiB, and a thin tail
+// up to `max_size`.
+std::vector<std::size_t> blob_sizes(std::size_t n, std::uint64_t seed,
+                                    std::size_t max_size = 4u << 20);
+
+// Text-like content of `size` bytes: indented lines of identifiers and
+// punctuation, compressing roughly 3:1 under zlib like real source does.
+std::string text_content(std::mt19937_64& rng, std::size_t size);
+
+// Random bytes, the incompressible case (media, archives).
+std::string random_content(std::mt19937_64& rng, std::size_t size);
+
+// "<type> <size>\0" + content
+std::string make_object(std::string_view type, std::string_view content);
+
+// Payload of a tree with `entries` entries in Git's order: mostly blobs,
+// about one subtree per 16 entries, a few executables.
+std::string tree_payload(std::size_t entries, HashAlgo algo, std::uint64_t seed);
+
+// Index entries for `files` paths spread over nested directories
+// ("d03/d11/file_00042.cpp"), with random OIDs and plausible stat data.
+std::vector<IndexEntry> index_entries(std::size_t files, HashAlgo algo, std::uint64_t seed);
+
+// Throwaway repository under the temp directory: .git/{objects,refs},
+// a config with `extra_config` appended, removed again on destruction.
+class SyntheticRepo {
+public:
+    explicit SyntheticRepo(HashAlgo algo = HashAlgo::Sha1, std::string_view extra_config = {});
+    ~SyntheticRepo();
+
+    SyntheticRepo(const SyntheticRepo&) = delete;
+    SyntheticRepo& operator=(const SyntheticRepo&) = delete;
+
+    const fs::path& root() const { return root_; }
+    fs::path git_dir() const { return root_ / ".git"; }
+    fs::path objects_dir() const { return root_ / ".git" / "objects"; }
+    HashAlgo algo() const { return algo_; }
+
+    // A fresh store over the repository, reading its config like main does
+    std::unique_ptr<ObjectStore> open_store(std::string_view codec = "zlib") const;
+
+    // Writes `files` text blobs with blob_sizes() sizes plus `revisions - 1`
+    // edited versions of each (a few lines changed per revision, so that
+    // repack finds deltas). Returns the OIDs in write order.
+    std::vector<Oid> fill(ObjectStore& store, std::size_t files, std::size_t revisions,
+                          std::uint64_t seed) const;
+
+    // Packs `oids` with write_pack and deletes the loose copies.
+    void pack(ObjectStore& store, const std::vector<Oid>& oids) const;
+
+private:
+    fs::path root_;
+    HashAlgo algo_;
+};
@@ -1,6 +1,9 @@
 // commands.cpp
+#include <cctype>
+#include <charconv>
 #include <cstdio>
 #include <cstdlib>
+#include <ctime>
 #include <memory>
 #include <string>
 #include <string_view>
@@ -10,43 +13,32 @@
 #include <iostream>
 #include <iterator>
 #include <optional>
-#include <openssl/sha.h>        // for SHA1 in hash-object (no-write path)
+#include <unordered_set>
+#include <atomic>
+#include <functional>
+#include <future>
+#include <mutex>
+#include <fnmatch.h>
+#include <sys/stat.h>
 
 #include "commands.hpp"
 #include "object_store.hpp"
+#include "commit.hpp"
+#include "commit_graph.hpp"
+#include "config.hpp"
 #include "entry.hpp"
 #include "index.hpp"
+#include "multi_pack_index.hpp"
+#include "pack_bitmap.hpp"
+#include "pack_writer.hpp"
+#include "refs.hpp"
+#include "rev_walk.hpp"
+#include "thread_pool.hpp"
 
 namespace fs = std::filesystem;
 struct ICommand;
 
 // -------------------- Small helpers (local to this TU) --------------------
-static std::vector<unsigned char> read_file_bytes(const fs::path& p) {
-    std::ifstream f(p, std::ios::binary);
-    if (!f) {
-        throw std::runtime_error("could not open file: " + p.string());
-    }
-    return std::vector<unsigned char>((std::istreambuf_iterator<char>(f)),
-                                       std::istreambuf_iterator<char>());
-}
-
-static std::string sha1_hex(std::string_view bytes) {
-    unsigned char digest[SHA_DIGEST_LENGTH];
-    SHA1(reinterpret_cast<const unsigned char*>(bytes.data()),
-         bytes.size(), digest);
-    // hex encode
-    static const char* kHex = "0123456789abcdef";
-    std::string out;
-    out.resize(SHA_DIGEST_LENGTH * 2);
-    for (int i = 0; i < SHA_DIGEST_LENGTH; ++i) {
-        out[2*i]   = kHex[(digest[i] >> 4) & 0xF];
-        out[2*i+1] = kHex[digest[i] & 0xF];
-    }
-    return out;
-}
-
-
-
 std::string detect_mode(const fs::path& p){
     std::error_code ec;
     auto perms = fs::status(p, ec).permissions();
@@ -58,21 +50,25 @@ std::string detect_mode(const fs::path& p){
     return exec ? "100755" : "100644";
 };
 
-std::string slurp(fs::path p) {
-  std::ifstream in(p, std::ios::binary);
-  if (!in) throw std::runtime_error("open failed: " + p.string());
-  return std::string(
-    std::istreambuf_iterator<char>(in), 
-    std::istreambuf_iterator<char>()
-  ); 
-}
-
 
 // ------------------------------ init -------------------------------------
 
 struct InitCommand : ICommand {
   const char* name () const override { return "init"; }
-  int execute(int /*argc*/, char** /*argv*/, ObjectStore& /*store*/) override {
+  int execute(int argc, char** argv, ObjectStore& /*store*/) override {
+    HashAlgo algo = HashAlgo::Sha1;
+    for (int i = 2; i < argc; ++i) {
+      const std::string arg = argv[i];
+      const std::string flag = "--object-format=";
+      auto parsed = arg.rfind(flag, 0) == 0 ? hash_algo_from_name(arg.substr(flag.size()))
+                                            : std::nullopt;
+      if (!parsed) {
+        std::cerr << "Usage: init [--object-format=sha1|sha256]\n";
+        return EXIT_FAILURE;
+      }
+      algo = *parsed;
+    }
+
     try {
       fs::create_directory(".git");
       fs::create_directory(".git/objects");
@@ -84,6 +80,23 @@ struct InitCommand : ICommand {
         return EXIT_FAILURE;
       }
       head << "ref: refs/heads/main\n";
+
+      // Kept on re-init: the object format of existing objects is fixed.
+      // SHA-256 needs format version 1 so that older readers refuse the repo
+      if (!fs::exists(".git/config")) {
+        std::ofstream config(".git/config");
+        if (!config) {
+          std::cerr << "Failed to create .git/config\n";
+          return EXIT_FAILURE;
+        }
+        config << "[core]\n"
+               << "\trepositoryformatversion = " << (algo == HashAlgo::Sha1 ? 0 : 1) << "\n"
+               << "\tfilemode = true\n"
+               << "\tbare = false\n";
+        if (algo != HashAlgo::Sha1) {
+          config << "[extensions]\n\tobjectformat = " << hash_name(algo) << "\n";
+        }
+      }
       std::cout << "Initialized git directory\n";
       return EXIT_SUCCESS;
     } catch (const fs::filesystem_error& e) {
@@ -100,21 +113,33 @@ struct CatFileCommand : ICommand {
   int execute(int argc, char** argv, ObjectStore& store) override {
     // parse flags/args (skip program name and command)
     bool print_payload = false, print_type = false;
+    bool batch = false, batch_check = false;
     std::string oid_hex;
 
     for (int i = 2; i < argc; ++i) {
       std::string arg = argv[i];
       if (arg == "-p") print_payload = true;
       else if (arg == "-t") print_type = true;
+      else if (arg == "--batch") batch = true;
+      else if (arg == "--batch-check") batch_check = true;
       else oid_hex = std::move(arg);
     }
 
+    if (batch || batch_check) {
+      if (batch && batch_check) {
+        std::cerr << "cat-file: --batch and --batch-check are exclusive\n";
+        return EXIT_FAILURE;
+      }
+      return run_batch(store, batch);
+    }
+
     if (print_payload == print_type) {
       std::cerr << "cat-file: need exactly one of -p or -t\n";
       return EXIT_FAILURE;
     }
-    if (oid_hex.size() != 40) {
-      std::cerr << "Invalid oid length (need 40 hex chars)\n";
+    const std::size_t hex_len = 2 * hash_len(store.hash_algo());
+    if (oid_hex.size() != hex_len) {
+      std::cerr << "Invalid oid length (need " << hex_len << " hex chars)\n";
       return EXIT_FAILURE;
     }
     auto maybe_oid = Oid::from_hex(oid_hex);
@@ -123,7 +148,8 @@ struct CatFileCommand : ICommand {
       return EXIT_FAILURE;
     }
 
-    auto obj = store.read_object(*maybe_oid);
+    // Only the header is decoded until the payload is pulled
+    auto obj = store.open_object(*maybe_oid);
     if (!obj) {
       std::cerr << "Object not found\n";
       return EXIT_FAILURE;
@@ -134,9 +160,55 @@ struct CatFileCommand : ICommand {
       return EXIT_SUCCESS;
     }
 
-    // binary-safe print for payload (trees contain NULs)
-    std::cout.write(obj->content.data(),
-                    static_cast<std::streamsize>(obj->content.size()));
+    // binary-safe print for payload (trees contain NULs), in constant memory
+    std::vector<char> buf(64 * 1024);
+    while (std::size_t n = obj->reader->read(buf.data(), buf.size())) {
+      std::cout.write(buf.data(), static_cast<std::streamsize>(n));
+    }
+    std::cout.flush();
+    return EXIT_SUCCESS;
+  }
+
+private:
+  // One object name per stdin line; for each, "<oid> <type> <size>\n" and,
+  // with --batch, the payload plus "\n". Unknown names print
+  // "<name> missing\n". Output is block-buffered and only flushed when the
+  // next read from stdin could block, so a pipeline of requests streams at
+  // full speed while an interactive caller still gets each answer.
+  static int run_batch(ObjectStore& store, bool with_payload) {
+    std::cout << std::nounitbuf;
+    std::vector<char> buf(64 * 1024);
+    std::string line;
+
+    while (true) {
+      if (std::cin.rdbuf()->in_avail() <= 0) std::cout.flush();
+      if (!std::getline(std::cin, line)) break;
+
+      const std::string name = line.substr(0, line.find_first_of(" \t"));
+      auto oid = Oid::from_hex(name);
+
+      if (!with_payload) {
+        auto info = oid ? store.read_object_info(*oid) : std::nullopt;
+        if (!info) {
+          std::cout << name << " missing\n";
+          continue;
+        }
+        std::cout << name << ' ' << info->type << ' ' << info->size << '\n';
+        continue;
+      }
+
+      auto obj = oid ? store.open_object(*oid) : std::nullopt;
+      if (!obj) {
+        std::cout << name << " missing\n";
+        continue;
+      }
+      std::cout << name << ' ' << obj->type << ' ' << obj->size << '\n';
+      while (std::size_t n = obj->reader->read(buf.data(), buf.size())) {
+        std::cout.write(buf.data(), static_cast<std::streamsize>(n));
+      }
+      std::cout << '\n';
+    }
+
     std::cout.flush();
     return EXIT_SUCCESS;
   }
@@ -162,31 +234,20 @@ struct HashObjectCommand : ICommand {
     }
 
     const fs::path full = fs::absolute(file_name);
-    std::vector<unsigned char> bytes;
-    
+
+    // Streams the file through the object hash (and deflate with -w) chunk by chunk
     try {
-      bytes = read_file_bytes(full);
+      if (write) {
+        auto res = store.put_blob_from_file(full);
+        std::cout << res.oid.to_hex() << "\n";
+      } else {
+        std::cout << ObjectStore::hash_blob_file(full, store.hash_algo()).to_hex() << "\n";
+      }
     } catch (const std::exception& e) {
       std::cerr << e.what() << "\n";
       return EXIT_FAILURE;
     }
-
-    // Build UNCOMPRESSED object: "blob <size>\0" + content
-    const std::string header = "blob " + std::to_string(bytes.size()) + '\0';
-    std::string object_bytes;
-    object_bytes.reserve(header.size() + bytes.size());
-    object_bytes.append(header);
-    object_bytes.append(reinterpret_cast<const char*>(bytes.data()), bytes.size());
-
-    if (write) {
-      auto res = store.put_object_if_absent(object_bytes);
-      std::cout << res.oid.to_hex() << "\n";
-      return EXIT_SUCCESS;
-    } else {
-      // compute sha1 (hex) without writing
-      std::cout << sha1_hex(object_bytes) << "\n";
-      return EXIT_SUCCESS;
-    }
+    return EXIT_SUCCESS;
   }
 };
 
@@ -194,19 +255,32 @@ struct HashObjectCommand : ICommand {
 
 struct LsTreeCommand : ICommand {
   const char* name() const override { return "ls-tree"; }
+
+  // A tree whose payload is fetched by a pool task. `subtrees` holds one
+  // node per tree entry, in entry order, and is complete once `ready` is.
+  struct Node {
+    std::string content;
+    std::vector<std::unique_ptr<Node>> subtrees;
+    std::promise<void> loaded;
+    std::future<void> ready = loaded.get_future();
+  };
+
   int execute(int argc, char** argv, ObjectStore& store) override {
     bool name_only = false;
+    bool recursive = false;
+    bool show_trees = false;
     std::string oid_hex;
 
     for (int i = 2; i < argc; ++i) {
       std::string arg = argv[i];
       if (arg == "--name-only") name_only = true;
-      else if (arg == "-r") { /* reserved; optional */ }
+      else if (arg == "-r") recursive = true;
+      else if (arg == "-t") show_trees = true;
       else oid_hex = std::move(arg);
     }
 
-    if (oid_hex.size() != 40) {
-      std::cerr << "usage: ls-tree [--name-only] <40-hex-oid>\n";
+    if (oid_hex.size() != 2 * hash_len(store.hash_algo())) {
+      std::cerr << "usage: ls-tree [-r] [-t] [--name-only] <tree-oid>\n";
       return EXIT_FAILURE;
     }
 
@@ -226,18 +300,80 @@ struct LsTreeCommand : ICommand {
       return EXIT_FAILURE;
     }
 
-    std::string_view payload{ obj->content.data(), obj->content.size() };
-    EntryParser parser{ payload };
-    std::vector<Entry> entries = parser.parse_all();
+    // With -r, every subtree is fetched and inflated by a pool task as soon
+    // as its parent is parsed, while this thread prints in entry order,
+    // waiting only for the subtree it is about to descend into. Trees are
+    // freed once printed.
+    const HashAlgo algo = store.hash_algo();
+    Node root;
+    std::function<void(Node&, Oid)> load;
+    std::function<void(Node&)> expand;
+    std::optional<ThreadPool> pool; // declared last: joined before the rest goes
 
-    for (const auto& e : entries) {
-      if (name_only) {
-        std::cout << e.name << "\n";
-      } else {
-        std::cout << e.mode << " " << e.get_type()
-                  << " " << e.oid.to_hex() << " " << e.name << "\n";
+    // Queues a load for every subtree of `node`
+    expand = [&](Node& node) {
+      for (const EntryView& e : TreeView(node.content, algo)) {
+        if (!e.is_tree()) continue;
+        Node& child = *node.subtrees.emplace_back(std::make_unique<Node>());
+        pool->submit([&load, &child, sub = e.oid()] { load(child, sub); });
+      }
+    };
+    load = [&](Node& node, Oid oid) {
+      try {
+        auto tree = store.read_object(oid);
+        if (!tree || tree->type != "tree") {
+          throw std::runtime_error("missing tree " + oid.to_hex());
+        }
+        node.content = std::move(tree->content);
+        expand(node);
+        node.loaded.set_value();
+      } catch (...) {
+        node.loaded.set_exception(std::current_exception());
+      }
+    };
+
+    // Entries are views into the payload; nothing is copied per entry.
+    // Same layout as Git: "<mode> <type> <oid>\t<path>", block-buffered
+    std::string path;
+    std::function<void(Node&)> print = [&](Node& node) {
+      node.ready.get(); // rethrows a failed load
+      std::size_t next_subtree = 0;
+      for (const EntryView& e : TreeView(node.content, algo)) {
+        const bool descend = recursive && e.is_tree();
+        if (!descend || show_trees) {
+          if (!name_only) {
+            std::cout << mode_string(e.mode).view() << ' ' << e.type() << ' '
+                      << e.oid().hex().view() << '\t';
+          }
+          std::cout << path << e.name << '\n';
+        }
+        if (descend) {
+          const std::size_t len = path.size();
+          path.append(e.name);
+          path.push_back('/');
+          auto& child = node.subtrees[next_subtree++];
+          print(*child);
+          child.reset();
+          path.resize(len);
+        }
       }
+    };
+
+    std::cout << std::nounitbuf;
+    try {
+      root.content = std::move(obj->content);
+      if (recursive) {
+        pool.emplace();
+        expand(root);
+      }
+      root.loaded.set_value();
+      print(root);
+    } catch (const std::exception& e) {
+      std::cout.flush();
+      std::cerr << e.what() << "\n";
+      return EXIT_FAILURE;
     }
+    std::cout.flush();
     return EXIT_SUCCESS;
   }
 };
@@ -246,62 +382,868 @@ struct LsTreeCommand : ICommand {
 
 struct WriteTreeCommand : ICommand {
   const char* name() const override { return "write-tree"; }
+  int execute(int /*argc*/, char** /*argv*/, ObjectStore& store) override {
+    fs::path repo_root = store.objects_root().parent_path().parent_path();
+    Index index(repo_root / ".git" / "index", store.hash_algo());
+
+    try {
+      index.lock();
+      index.load();
+      const Oid root = index.write_tree(store);
+      index.flush(); // persist the refreshed cache-tree
+      std::cout << root.to_hex() << "\n";
+    } catch (const std::exception& e) {
+      std::cerr << "write-tree: " << e.what() << "\n";
+      return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+  }
+};
+
+
+// ----------------------------- commit-tree -------------------------------
+
+// Writes a commit for `tree` with `parents` and prints nothing; callers
+// decide what to report. Tree and parents must exist with the right types.
+static Oid write_commit(ObjectStore& store, const Config& config, const Oid& tree,
+                        std::vector<Oid> parents, std::string message) {
+  auto info = store.read_object_info(tree);
+  if (!info || info->type != "tree") throw std::runtime_error(tree.to_hex() + " is not a valid tree");
+  for (const Oid& p : parents) {
+    info = store.read_object_info(p);
+    if (!info || info->type != "commit") throw std::runtime_error(p.to_hex() + " is not a valid commit");
+  }
+
+  Commit c;
+  c.tree = tree;
+  c.parents = std::move(parents);
+  c.author = make_ident("author", config);
+  c.committer = make_ident("committer", config);
+  if (!message.empty() && message.back() != '\n') message.push_back('\n');
+  c.message = std::move(message);
+
+  const std::string payload = c.serialize();
+  const std::string object = "commit " + std::to_string(payload.size()) + '\0' + payload;
+  return store.put_object_if_absent(object).oid;
+}
+
+// Joins repeated -m values with blank lines, like git
+static void append_message(std::string& message, const std::string& paragraph) {
+  if (!message.empty()) message += "\n\n";
+  message += paragraph;
+}
+
+struct CommitTreeCommand : ICommand {
+  const char* name() const override { return "commit-tree"; }
+  int execute(int argc, char** argv, ObjectStore& store) override {
+    const fs::path git_dir = store.objects_root().parent_path();
+    const Refs refs(git_dir, store.hash_algo());
+
+    std::optional<Oid> tree;
+    std::vector<Oid> parents;
+    std::string message;
+    bool have_message = false;
+    for (int i = 2; i < argc; ++i) {
+      const std::string arg = argv[i];
+      if ((arg == "-p" || arg == "-m") && i + 1 < argc) {
+        const std::string value = argv[++i];
+        if (arg == "-m") {
+          append_message(message, value);
+          have_message = true;
+          continue;
+        }
+        auto parent = resolve_revision(store, refs, value);
+        if (!parent) {
+          std::cerr << "commit-tree: not a valid object name " << value << "\n";
+          return EXIT_FAILURE;
+        }
+        parents.push_back(*parent);
+      } else if (!tree && arg[0] != '-') {
+        tree = refs.resolve(arg);
+        if (!tree) {
+          std::cerr << "commit-tree: not a valid object name " << arg << "\n";
+          return EXIT_FAILURE;
+        }
+      } else {
+        std::cerr << "usage: commit-tree <tree> [-p <parent>]... [-m <message>]...\n";
+        return EXIT_FAILURE;
+      }
+    }
+    if (!tree) {
+      std::cerr << "usage: commit-tree <tree> [-p <parent>]... [-m <message>]...\n";
+      return EXIT_FAILURE;
+    }
+    // Without -m the message comes from stdin
+    if (!have_message) {
+      message.assign(std::istreambuf_iterator<char>(std::cin), std::istreambuf_iterator<char>());
+    }
+
+    try {
+      const Config config = Config::load(git_dir / "config");
+      std::cout << write_commit(store, config, *tree, std::move(parents), std::move(message)).to_hex()
+                << "\n";
+    } catch (const std::exception& e) {
+      std::cerr << "commit-tree: " << e.what() << "\n";
+      return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+  }
+};
+
+// ------------------------------- commit ----------------------------------
+
+struct CommitCommand : ICommand {
+  const char* name() const override { return "commit"; }
+  int execute(int argc, char** argv, ObjectStore& store) override {
+    std::string message;
+    bool allow_empty = false;
+    for (int i = 2; i < argc; ++i) {
+      const std::string arg = argv[i];
+      if (arg == "-m" && i + 1 < argc) append_message(message, argv[++i]);
+      else if (arg == "--allow-empty") allow_empty = true;
+      else {
+        std::cerr << "usage: commit -m <message>... [--allow-empty]\n";
+        return EXIT_FAILURE;
+      }
+    }
+    if (message.empty()) {
+      std::cerr << "commit: empty commit message (use -m)\n";
+      return EXIT_FAILURE;
+    }
+
+    const fs::path git_dir = store.objects_root().parent_path();
+    const Refs refs(git_dir, store.hash_algo());
+    Index index(git_dir / "index", store.hash_algo());
+    try {
+      index.lock();
+      index.load();
+      const Oid tree = index.write_tree(store);
+      index.flush(); // persist the refreshed cache-tree
+
+      const auto parent = refs.read("HEAD");
+      if (parent && !allow_empty) {
+        const auto head = store.read_object(*parent);
+        if (head && Commit::parse(head->content, store.hash_algo()).tree == tree) {
+          std::cerr << "nothing to commit\n";
+          return EXIT_FAILURE;
+        }
+      }
+
+      const Config config = Config::load(git_dir / "config");
+      std::vector<Oid> parents;
+      if (parent) parents.push_back(*parent);
+      const std::string subject = message.substr(0, message.find('\n'));
+      const Oid oid = write_commit(store, config, tree, std::move(parents), std::move(message));
+
+      // Compare-and-swap: fails if HEAD moved since it was read above
+      Oid expected{};
+      expected.algo = store.hash_algo();
+      refs.update("HEAD", oid, parent.value_or(expected));
+
+      const auto branch = refs.symbolic_target("HEAD");
+      std::string label = "detached HEAD";
+      if (branch) label = branch->rfind("refs/heads/", 0) == 0 ? branch->substr(11) : *branch;
+      std::cout << '[' << label << (parent ? "" : " (root-commit)") << ' '
+                << oid.hex().view().substr(0, 7) << "] " << subject << "\n";
+    } catch (const std::exception& e) {
+      std::cerr << "commit: " << e.what() << "\n";
+      return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+  }
+};
+
+// ---------------------------- commit-graph -------------------------------
+
+struct CommitGraphCommand : ICommand {
+  const char* name() const override { return "commit-graph"; }
   int execute(int argc, char** argv, ObjectStore& store) override {
-    return EXIT_SUCCESS;  
+    const std::string sub = argc > 2 ? argv[2] : "";
+    const bool reachable_only = argc == 3 || (argc == 4 && std::string(argv[3]) == "--reachable");
+    if ((sub != "write" && sub != "verify") || !reachable_only || (sub == "verify" && argc != 3)) {
+      std::cerr << "usage: commit-graph (write [--reachable] | verify)\n";
+      return EXIT_FAILURE;
+    }
+
+    const fs::path file = store.objects_root() / "info" / "commit-graph";
+    try {
+      if (sub == "verify") {
+        const auto graph = CommitGraph::open(file, store.hash_algo());
+        if (!graph) {
+          std::cerr << "commit-graph: no valid commit-graph at " << file.string() << "\n";
+          return EXIT_FAILURE;
+        }
+        if (auto problem = graph->verify(store)) {
+          std::cerr << "commit-graph: " << *problem << "\n";
+          return EXIT_FAILURE;
+        }
+        return EXIT_SUCCESS;
+      }
+
+      // Every ref plus HEAD, which may be detached
+      const Refs refs(store.objects_root().parent_path(), store.hash_algo());
+      std::vector<Oid> tips;
+      for (const auto& [ref, oid] : refs.list()) tips.push_back(oid);
+      if (auto head = refs.read("HEAD")) tips.push_back(*head);
+      write_commit_graph(store, tips, file);
+    } catch (const std::exception& e) {
+      std::cerr << "commit-graph: " << e.what() << "\n";
+      return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
   }
 };
 
+// ------------------------------ rev-list ---------------------------------
+
+// The commit-graph unless core.commitGraph is false; null when there is none
+static std::unique_ptr<CommitGraph> open_commit_graph(const ObjectStore& store) {
+  const Config config = Config::load(store.objects_root().parent_path() / "config");
+  const std::string use = config.get("core.commitGraph").value_or("true");
+  if (use == "false" || use == "no" || use == "off" || use == "0") return nullptr;
+  return CommitGraph::open(store.objects_root() / "info" / "commit-graph", store.hash_algo());
+}
+
+// Start points from a rev-list / log command line
+struct RevisionArgs {
+  std::vector<Oid> include;
+  std::vector<Oid> exclude;
+  // Annotated tags among the included start points (tags of tags too), with
+  // the name in their "tag" header; "rev-list --objects" lists them
+  std::vector<std::pair<Oid, std::string>> tags;
+
+  void push_to(RevWalk& walk) const {
+    for (const Oid& oid : include) walk.push(oid);
+    for (const Oid& oid : exclude) walk.push(oid, true);
+  }
+};
+
+// Records `oid` and the tags it points through when it is an annotated tag
+static void note_tags(const ObjectStore& store, Oid oid, RevisionArgs& out) {
+  for (int depth = 0; depth < 16; ++depth) {
+    const auto obj = store.read_object(oid);
+    if (!obj || obj->type != "tag") return;
+    std::string_view name;
+    for (std::string_view rest = obj->content; !rest.empty() && rest[0] != '\n';) {
+      const std::size_t eol = rest.find('\n');
+      const std::string_view line = rest.substr(0, eol);
+      if (line.rfind("tag ", 0) == 0) name = line.substr(4);
+      rest.remove_prefix(eol == std::string_view::npos ? rest.size() : eol + 1);
+    }
+    out.tags.emplace_back(oid, std::string(name));
+    auto target = tag_target(obj->content);
+    if (!target) return;
+    oid = *target;
+  }
+}
+
+// Parses the revisions in `args`: "<rev>", "^<rev>" (hidden), "A..B" (A
+// hidden, B shown; an empty side means HEAD) and "--all".
+// Returns false and prints to stderr when one does not name a commit.
+static bool parse_revisions(const ObjectStore& store, const std::vector<std::string>& args, const char* cmd,
+                            RevisionArgs& out) {
+  const Refs refs(store.objects_root().parent_path(), store.hash_algo());
+  auto add = [&](std::string_view spec, bool hidden) {
+    if (spec.empty()) spec = "HEAD";
+    auto oid = resolve_revision(store, refs, spec);
+    if (!oid) {
+      std::cerr << cmd << ": bad revision '" << spec << "'\n";
+      return false;
+    }
+    (hidden ? out.exclude : out.include).push_back(*oid);
+    if (!hidden && spec.find_first_of("^~") == std::string_view::npos) {
+      if (auto named = refs.resolve(spec)) note_tags(store, *named, out);
+    }
+    return true;
+  };
+
+  for (const std::string& arg : args) {
+    if (arg == "--all") {
+      for (const auto& [ref, oid] : refs.list()) {
+        if (auto commit = resolve_revision(store, refs, oid.to_hex())) {
+          out.include.push_back(*commit);
+          note_tags(store, oid, out);
+        }
+      }
+      if (auto head = refs.read("HEAD")) out.include.push_back(*head);
+    } else if (const std::size_t dots = arg.find(".."); dots != std::string::npos) {
+      if (!add(std::string_view(arg).substr(0, dots), true) ||
+          !add(std::string_view(arg).substr(dots + 2), false)) {
+        return false;
+      }
+    } else if (arg[0] == '^') {
+      if (!add(std::string_view(arg).substr(1), true)) return false;
+    } else if (!add(arg, false)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+// Whole of `text` as a number >= 0
+template <class T>
+static bool parse_non_negative(std::string_view text, T& out) {
+  T value = 0;
+  const auto [end, ec] = std::from_chars(text.data(), text.data() + text.size(), value);
+  if (ec != std::errc{} || end != text.data() + text.size() || value < 0) return false;
+  out = value;
+  return true;
+}
+
+enum class MaxCountArg { None, Parsed, Bad };
+
+// "-n <n>", "-<n>" or "--max-count=<n>" at argv[i]; advances i past a
+// separate value. Bad when the value is missing, negative or not a number.
+static MaxCountArg parse_max_count(int argc, char** argv, int& i, long& max_count) {
+  const std::string_view arg = argv[i];
+  std::string_view value;
+  if (arg == "-n") {
+    if (i + 1 >= argc) return MaxCountArg::Bad;
+    value = argv[++i];
+  } else if (arg.rfind("--max-count=", 0) == 0) {
+    value = arg.substr(12);
+  } else if (arg.size() > 1 && arg[0] == '-' && std::isdigit(static_cast<unsigned char>(arg[1]))) {
+    value = arg.substr(1);
+  } else {
+    return MaxCountArg::None;
+  }
+  return parse_non_negative(value, max_count) ? MaxCountArg::Parsed : MaxCountArg::Bad;
+}
+
+// Objects reachable from `args` but not from its hidden revisions, from
+// the pack bitmap; false when there is no usable bitmap
+static bool bitmap_objects(const ObjectStore& store, const RevisionArgs& args, bool objects, bool count) {
+  auto bitmap = PackBitmap::open(store.objects_root() / "pack", store.hash_algo());
+  if (!bitmap) return false;
+  std::vector<Oid> tips = args.include;
+  for (const auto& [oid, name] : args.tags) tips.push_back(oid);
+  Bitmap result = bitmap->reachable(store, tips);
+  if (!args.exclude.empty()) result.and_not(bitmap->reachable(store, args.exclude));
+
+  if (count) {
+    std::size_t n = bitmap->count(result, PackObjectType::Commit);
+    if (objects) {
+      for (PackObjectType type : {PackObjectType::Tree, PackObjectType::Blob, PackObjectType::Tag}) {
+        n += bitmap->count(result, type);
+      }
+    }
+    std::cout << n << '\n';
+    return true;
+  }
+  bitmap->for_each(result, [&](const Oid& oid, PackObjectType type) {
+    if (objects || type == PackObjectType::Commit) std::cout << oid.hex().view() << '\n';
+  });
+  return true;
+}
+
+struct RevListCommand : ICommand {
+  const char* name() const override { return "rev-list"; }
+  int execute(int argc, char** argv, ObjectStore& store) override {
+    bool count = false;
+    bool objects = false;
+    bool use_bitmap = false;
+    long max_count = -1;
+    std::vector<std::string> revs;
+    try {
+      for (int i = 2; i < argc; ++i) {
+        const std::string arg = argv[i];
+        if (arg == "--count") count = true;
+        else if (arg == "--objects") objects = true;
+        else if (arg == "--use-bitmap-index") use_bitmap = true;
+        else if (const auto m = parse_max_count(argc, argv, i, max_count); m == MaxCountArg::Parsed) continue;
+        else if (m == MaxCountArg::None && (arg == "--all" || arg[0] != '-')) revs.push_back(arg);
+        else {
+          std::cerr << "usage: rev-list [--count] [--objects] [--use-bitmap-index] [-n <n>] [--all]"
+                       " <rev>... [^<rev>] [<a>..<b>]\n";
+          return EXIT_FAILURE;
+        }
+      }
+      if (revs.empty()) {
+        std::cerr << "rev-list: no revisions given\n";
+        return EXIT_FAILURE;
+      }
+
+      RevisionArgs args;
+      if (!parse_revisions(store, revs, "rev-list", args)) return EXIT_FAILURE;
+      std::cout << std::nounitbuf;
+      // Bitmaps answer for whole histories; -n needs the walk's order
+      if (use_bitmap && max_count < 0 && bitmap_objects(store, args, objects, count)) {
+        std::cout.flush();
+        return EXIT_SUCCESS;
+      }
+
+      const auto graph = open_commit_graph(store);
+      RevWalk walk(store, graph.get());
+      args.push_to(walk);
+
+      std::size_t n = 0;
+      std::vector<std::uint32_t> shown;
+      while (max_count < 0 || n < static_cast<std::size_t>(max_count)) {
+        const auto oid = walk.next();
+        if (!oid) break;
+        ++n;
+        if (objects) shown.push_back(walk.commits().lookup(*oid));
+        if (!count) std::cout << oid->hex().view() << '\n';
+      }
+
+      if (objects) {
+        // Like Git, leave out what the trees of the hidden parents of the
+        // listed commits (the boundary) already have
+        CommitIndex& commits = walk.commits();
+        std::vector<Oid> trees, excluded;
+        std::vector<std::uint32_t> parents;
+        std::unordered_set<std::uint32_t> boundary;
+        for (std::uint32_t c : shown) {
+          trees.push_back(commits.tree(c));
+          commits.parents(c, parents);
+          for (std::uint32_t p : parents) {
+            if (walk.hidden(p) && boundary.insert(p).second) excluded.push_back(commits.tree(p));
+          }
+        }
+        for (const auto& [oid, name] : args.tags) {
+          ++n;
+          if (!count) std::cout << oid.hex().view() << ' ' << name << '\n';
+        }
+        walk_objects(store, trees, excluded, [&](const Oid& oid, std::string_view path) {
+          ++n;
+          if (!count) std::cout << oid.hex().view() << ' ' << path << '\n';
+        });
+      }
+      if (count) std::cout << n << '\n';
+      std::cout.flush();
+    } catch (const std::exception& e) {
+      std::cerr << "rev-list: " << e.what() << "\n";
+      return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+  }
+};
+
+// --------------------------------- log -----------------------------------
+
+// "Tue Nov 14 23:13:20 2023 +0100" from an ident's "<seconds> <+hhmm>",
+// in the ident's own time zone (Git's default date format)
+static std::string format_ident_date(std::string_view ident) {
+  static constexpr const char* kDays[] = {"Sun", "Mon", "Tue", "Wed", "Thu", "Fri", "Sat"};
+  static constexpr const char* kMonths[] = {"Jan", "Feb", "Mar", "Apr", "May", "Jun",
+                                            "Jul", "Aug", "Sep", "Oct", "Nov", "Dec"};
+  const std::size_t close = ident.rfind('>');
+  if (close == std::string_view::npos || close + 2 >= ident.size()) return "";
+  const std::string_view date = ident.substr(close + 2);
+  const std::size_t sp = date.find(' ');
+  if (sp == std::string_view::npos || date.size() != sp + 6) return std::string(date);
+
+  long long seconds = 0;
+  std::from_chars(date.data(), date.data() + sp, seconds);
+  const std::string_view tz = date.substr(sp + 1);
+  const int minutes = ((tz[1] - '0') * 10 + (tz[2] - '0')) * 60 + (tz[3] - '0') * 10 + (tz[4] - '0');
+  const std::time_t local = static_cast<std::time_t>(seconds + (tz[0] == '-' ? -minutes : minutes) * 60);
+  std::tm tm{};
+  gmtime_r(&local, &tm);
+  char buf[64];
+  std::snprintf(buf, sizeof(buf), "%s %s %d %02d:%02d:%02d %d %.*s", kDays[tm.tm_wday], kMonths[tm.tm_mon],
+                tm.tm_mday, tm.tm_hour, tm.tm_min, tm.tm_sec, tm.tm_year + 1900, 5, tz.data());
+  return buf;
+}
+
+struct LogCommand : ICommand {
+  const char* name() const override { return "log"; }
+  int execute(int argc, char** argv, ObjectStore& store) override {
+    bool oneline = false;
+    long max_count = -1;
+    std::vector<std::string> revs;
+    try {
+      for (int i = 2; i < argc; ++i) {
+        const std::string arg = argv[i];
+        if (arg == "--oneline") oneline = true;
+        else if (const auto m = parse_max_count(argc, argv, i, max_count); m == MaxCountArg::Parsed) continue;
+        else if (m == MaxCountArg::None && (arg == "--all" || arg[0] != '-')) revs.push_back(arg);
+        else {
+          std::cerr << "usage: log [--oneline] [-n <n>] [--all] [<rev>... | <a>..<b>]\n";
+          return EXIT_FAILURE;
+        }
+      }
+      if (revs.empty()) revs.push_back("HEAD");
+
+      RevisionArgs args;
+      if (!parse_revisions(store, revs, "log", args)) return EXIT_FAILURE;
+      const auto graph = open_commit_graph(store);
+      RevWalk walk(store, graph.get());
+      args.push_to(walk);
+
+      std::cout << std::nounitbuf;
+      for (long n = 0; max_count < 0 || n < max_count; ++n) {
+        const auto oid = walk.next();
+        if (!oid) break;
+        const auto obj = store.read_object(*oid);
+        if (!obj) throw std::runtime_error("missing commit " + oid->to_hex());
+        const Commit c = Commit::parse(obj->content, store.hash_algo());
+
+        std::string_view message = c.message;
+        while (!message.empty() && message.back() == '\n') message.remove_suffix(1);
+        if (oneline) {
+          std::cout << oid->hex().view().substr(0, 7) << ' ' << message.substr(0, message.find('\n')) << '\n';
+          continue;
+        }
+
+        if (n > 0) std::cout << '\n';
+        std::cout << "commit " << oid->hex().view() << '\n';
+        if (c.parents.size() > 1) {
+          std::cout << "Merge:";
+          for (const Oid& p : c.parents) std::cout << ' ' << p.hex().view().substr(0, 7);
+          std::cout << '\n';
+        }
+        const std::string_view author = c.author;
+        const std::size_t close = author.rfind('>');
+        std::cout << "Author: " << author.substr(0, close == std::string_view::npos ? author.size() : close + 1)
+                  << '\n';
+        std::cout << "Date:   " << format_ident_date(author) << "\n\n";
+        while (!message.empty()) {
+          const std::size_t eol = message.find('\n');
+          const std::string_view line = message.substr(0, eol);
+          if (!line.empty()) std::cout << "    " << line;
+          std::cout << '\n';
+          message.remove_prefix(eol == std::string_view::npos ? message.size() : eol + 1);
+        }
+      }
+      std::cout.flush();
+    } catch (const std::exception& e) {
+      std::cerr << "log: " << e.what() << "\n";
+      return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+  }
+};
 
 // ------------------------------ add --------------------------------------
 struct AddCommand : ICommand {
+  // Files up to this size are read whole and hashed in batches
+  static constexpr std::size_t kSmallBlob = 64 * 1024;
+  static constexpr std::size_t kBatchFiles = 64;
+
   const char* name() const override { return "add"; }
   int execute(int argc, char** argv, ObjectStore& store) override {
     if (argc < 3) {
-      std::cerr << "Usage: add <path>\n";
+      std::cerr << "Usage: add <path|dir|glob>...\n";
       return EXIT_FAILURE;
     }
 
-    std::string file_name = argv[2];
     const fs::path& objects = store.objects_root();
     fs::path repo_root = objects.parent_path().parent_path();
 
     fs::path index_path = repo_root / ".git" / "index";
 
-    Index index(index_path);
-    index.load();
-
-    // Get the absolute path
-    fs::path abs = fs::absolute(file_name);
-    if (!fs::exists(abs) || !fs::is_regular_file(abs)) {
-      std::cerr << "add: not a regular file: " << abs << "\n";
+    Index index(index_path, store.hash_algo());
+    try {
+      index.lock();
+      index.load();
+    } catch (const std::exception& e) {
+      std::cerr << "add: " << e.what() << "\n";
       return EXIT_FAILURE;
     }
-    
-    fs::path rel = fs::relative(abs, repo_root).generic_string();
-    if (rel.string().rfind(".git/", 0) == 0) {
-      std::cerr << "add: refusing to stage inside .git/: " << rel << "\n";
+
+    // Resolve and check every argument before any work is queued, so that
+    // a bad one cannot return while tasks are still running
+    struct Root {
+      fs::path path;
+      std::string pattern; // for walk(); empty: every file under `path`
+      std::size_t slot;
+      bool file;
+    };
+    std::vector<Root> roots;
+    try {
+      for (int i = 2; i < argc; ++i) {
+        const std::string arg = argv[i];
+        const std::size_t slot = static_cast<std::size_t>(i - 2);
+        fs::path abs = fs::absolute(arg).lexically_normal();
+        if (abs.has_parent_path() && abs.filename().empty()) abs = abs.parent_path();
+
+        std::string rel = fs::relative(abs, repo_root).generic_string();
+        if (rel.rfind("..", 0) == 0) {
+          std::cerr << "add: " << arg << " is outside repository\n";
+          return EXIT_FAILURE;
+        }
+        if (rel == ".git" || rel.rfind(".git/", 0) == 0) {
+          std::cerr << "add: refusing to stage inside .git/: " << rel << "\n";
+          return EXIT_FAILURE;
+        }
+
+        if (fs::is_directory(abs)) {
+          roots.push_back(Root{abs, "", slot, false});
+        } else if (fs::is_regular_file(abs)) {
+          roots.push_back(Root{abs, "", slot, true});
+        } else if (arg.find_first_of("*?[") != std::string::npos) {
+          // Walk from the deepest directory that has no glob characters
+          fs::path base = abs;
+          while (base.string().find_first_of("*?[") != std::string::npos) base = base.parent_path();
+          if (fs::is_directory(base)) roots.push_back(Root{base, abs.string(), slot, false});
+        } else {
+          std::cerr << "add: not a regular file: " << abs << "\n";
+          return EXIT_FAILURE;
+        }
+      }
+    } catch (const std::exception& e) {
+      std::cerr << "add: " << e.what() << "\n";
       return EXIT_FAILURE;
     }
-    
-    // Mode detection: exec bit => 100755, else 100644
-    std::string mode = detect_mode(abs);
-    std::string data = slurp(abs);
 
-    std::string object_bytes;
-    {
-        std::string header = "blob " + std::to_string(data.size()) + '\0';
-        object_bytes.reserve(header.size() + data.size());
-        object_bytes.append(header);
-        object_bytes.append(data);
+    // Directories are walked in parallel and every file is hashed and
+    // compressed on the pool; the index is only touched once at the end.
+    // The pool is declared after everything its tasks use, so it is torn
+    // down (and drained) first.
+    std::mutex mu;
+    std::vector<IndexEntry> staged;
+    std::vector<std::atomic<std::size_t>> matched(argc - 2);
+
+    // `index` is only read here; all upserts happen after the pool is idle.
+    // Files are staged in batches so that small blobs can be hashed together
+    // by put_objects_if_absent; larger ones are streamed one by one.
+    auto stage_files = [&](const std::vector<fs::path>& files) {
+      std::vector<IndexEntry> done;
+      std::vector<IndexEntry> pending; // waiting for their OID from the batch
+      std::vector<std::string> blobs;
+      for (const fs::path& abs : files) {
+        std::string rel = fs::relative(abs, repo_root).generic_string();
+        struct stat st {};
+        if (::lstat(abs.c_str(), &st) != 0) {
+          throw std::runtime_error("stat failed: " + abs.string());
+        }
+        const IndexStat stat_data = IndexStat::from(st);
+        // Mode detection: exec bit => 100755, else 100644
+        std::string mode = detect_mode(abs);
+
+        // Unchanged since it was last staged: skip reading and hashing it
+        const IndexEntry* cached = index.find(rel);
+        if (cached && cached->mode == mode && cached->stat == stat_data && !index.is_racy(*cached)) {
+          continue;
+        }
+
+        if (static_cast<std::size_t>(st.st_size) > kSmallBlob) {
+          // Store blob in object store (streamed, constant memory); get OID
+          auto put = store.put_blob_from_file(abs);
+          done.push_back(IndexEntry{std::move(rel), std::move(mode), put.oid, stat_data});
+          continue;
+        }
+        std::ifstream in(abs, std::ios::binary);
+        if (!in) throw std::runtime_error("could not open file: " + abs.string());
+        std::string content((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+        blobs.push_back("blob " + std::to_string(content.size()) + '\0' + content);
+        pending.push_back(IndexEntry{std::move(rel), std::move(mode), Oid{}, stat_data});
+      }
+
+      const std::vector<std::string_view> views(blobs.begin(), blobs.end());
+      const auto puts = store.put_objects_if_absent(views);
+      for (std::size_t i = 0; i < pending.size(); ++i) {
+        pending[i].oid = puts[i].oid;
+        done.push_back(std::move(pending[i]));
+      }
+
+      std::lock_guard<std::mutex> lock(mu);
+      for (auto& e : done) staged.push_back(std::move(e));
+    };
+
+    // `pattern` empty: take every regular file; otherwise fnmatch() it
+    // against the absolute path ('*' also matches '/', like a git pathspec)
+    std::function<void(fs::path, std::string, std::size_t)> walk;
+    ThreadPool pool;
+    walk = [&](fs::path dir, std::string pattern, std::size_t arg) {
+      std::vector<fs::path> batch;
+      auto submit_batch = [&] {
+        pool.submit([&stage_files, files = std::move(batch)] { stage_files(files); });
+        batch.clear();
+      };
+      for (const auto& entry : fs::directory_iterator(dir)) {
+        const fs::path& p = entry.path();
+        if (p.filename() == ".git") continue;
+        if (entry.is_directory() && !entry.is_symlink()) {
+          pool.submit([&walk, p, pattern, arg] { walk(p, pattern, arg); });
+        } else if (entry.is_regular_file() && !entry.is_symlink()) {
+          if (!pattern.empty() && fnmatch(pattern.c_str(), p.c_str(), 0) != 0) continue;
+          ++matched[arg];
+          batch.push_back(p);
+          if (batch.size() == kBatchFiles) submit_batch();
+        }
+      }
+      if (!batch.empty()) submit_batch();
+    };
+
+    for (const Root& root : roots) {
+      if (root.file) {
+        ++matched[root.slot];
+        pool.submit([&stage_files, abs = root.path] { stage_files({abs}); });
+      } else {
+        pool.submit([&walk, root] { walk(root.path, root.pattern, root.slot); });
+      }
+    }
+
+    try {
+      pool.wait_idle();
+    } catch (const std::exception& e) {
+      std::cerr << "add: " << e.what() << "\n";
+      return EXIT_FAILURE;
     }
 
-    // Store blob in object store; get OID
-    auto put = store.put_object_if_absent(object_bytes);
-    const Oid& oid = put.oid;
+    for (int i = 2; i < argc; ++i) {
+      std::error_code ec;
+      if (matched[static_cast<std::size_t>(i - 2)] == 0 && !fs::is_directory(fs::absolute(argv[i], ec), ec)) {
+        std::cerr << "add: pathspec '" << argv[i] << "' did not match any files\n";
+        return EXIT_FAILURE;
+      }
+    }
 
     // Update index and persist
-    index.upsert(IndexEntry{rel, mode, oid});
-    index.flush();
+    for (auto& e : staged) index.upsert(e);
+    try {
+      index.flush();
+    } catch (const std::exception& e) {
+      std::cerr << "add: " << e.what() << "\n";
+      return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+  }
+};
+
+// ------------------------------ repack -----------------------------------
+
+struct RepackCommand : ICommand {
+  const char* name() const override { return "repack"; }
+  int execute(int argc, char** argv, ObjectStore& store) override {
+    bool prune = false;
+    bool all = false;
+    bool bitmap = false;
+    bool midx = false;
+    PackWriteOptions opts;
+
+    for (int i = 2; i < argc; ++i) {
+      std::string_view arg = argv[i];
+      bool ok = true;
+      if (arg.rfind("--window=", 0) == 0) ok = parse_non_negative(arg.substr(9), opts.window);
+      else if (arg.rfind("--depth=", 0) == 0) ok = parse_non_negative(arg.substr(8), opts.depth);
+      else if (arg == "--write-bitmap-index") bitmap = true;
+      else if (arg == "--write-midx") midx = true;
+      else if (arg.size() > 1 && arg[0] == '-' && arg.find_first_not_of("adb", 1) == std::string::npos) {
+        // Short flags, also bundled as in "-adb"
+        all |= arg.find('a') != std::string::npos;
+        prune |= arg.find('d') != std::string::npos;
+        bitmap |= arg.find('b') != std::string::npos;
+      } else {
+        ok = false;
+      }
+      if (!ok) {
+        std::cerr << "usage: repack [-a] [-d] [-b | --write-bitmap-index] [--write-midx] [--window=<n>]"
+                     " [--depth=<n>]\n";
+        return EXIT_FAILURE;
+      }
+    }
+    // Bitmaps describe reachability inside one pack, so that pack has to
+    // hold every object the selected commits reach
+    if (bitmap && !all) {
+      std::cerr << "repack: -b needs -a\n";
+      return EXIT_FAILURE;
+    }
+
+    const std::vector<Oid> loose = store.get_all_objects();
+    std::vector<Oid> oids = loose;
+    std::vector<fs::path> old_packs;
+    if (all) {
+      std::error_code ec;
+      for (const auto& entry : fs::directory_iterator(store.objects_root() / "pack", ec)) {
+        if (entry.path().extension() == ".pack") old_packs.push_back(entry.path());
+      }
+      std::unordered_set<Oid, OidHash> unique(oids.begin(), oids.end());
+      for (const Oid& oid : store.get_packed_objects()) {
+        if (unique.insert(oid).second) oids.push_back(oid);
+      }
+    }
+    if (oids.empty()) {
+      std::cout << "Nothing new to pack.\n";
+      return EXIT_SUCCESS;
+    }
+
+    PackWriteResult res;
+    try {
+      res = write_pack(store, oids, store.objects_root() / "pack", opts);
+      store.reprepare_packs();
+      if (bitmap) {
+        const Refs refs(store.objects_root().parent_path(), store.hash_algo());
+        std::vector<Oid> tips;
+        for (const auto& [ref, oid] : refs.list()) tips.push_back(oid);
+        if (auto head = refs.read("HEAD")) tips.push_back(*head);
+        const auto graph = open_commit_graph(store);
+        write_pack_bitmap(store, res.idx_path, tips, graph.get());
+      }
+    } catch (const std::exception& e) {
+      std::cerr << "repack: " << e.what() << "\n";
+      return EXIT_FAILURE;
+    }
+
+    // The pack is fsync'ed and published, so the loose copies and, with -a,
+    // the old packs are redundant. Packs with a .keep file are left alone.
+    if (prune) {
+      for (const auto& oid : loose) {
+        const auto hex = oid.hex();
+        const fs::path dir = store.objects_root() / hex.view().substr(0, 2);
+        std::error_code ec;
+        fs::remove(dir / hex.view().substr(2), ec);
+        fs::remove(dir, ec); // only succeeds once the fan-out dir is empty
+      }
+      for (fs::path pack : old_packs) {
+        if (pack == res.pack_path) continue; // same objects, same name
+        std::error_code ec;
+        if (fs::exists(fs::path(pack).replace_extension(".keep"), ec)) continue;
+        for (const char* ext : {".bitmap", ".idx", ".pack"}) fs::remove(pack.replace_extension(ext), ec);
+      }
+      store.reprepare_packs();
+    }
+
+    // A multi-pack-index that no longer lists every pack would send
+    // lookups for the new one down the slow path, so keep it current
+    const fs::path pack_dir = store.objects_root() / "pack";
+    if (midx || fs::exists(pack_dir / "multi-pack-index")) {
+      try {
+        write_multi_pack_index(pack_dir, store.hash_algo());
+      } catch (const std::exception& e) {
+        std::cerr << "repack: " << e.what() << "\n";
+        return EXIT_FAILURE;
+      }
+      store.reprepare_packs();
+    }
+
+    std::cout << res.name << "\n";
+    return EXIT_SUCCESS;
+  }
+};
+
+// --------------------------- multi-pack-index ----------------------------
+
+struct MultiPackIndexCommand : ICommand {
+  const char* name() const override { return "multi-pack-index"; }
+  int execute(int argc, char** argv, ObjectStore& store) override {
+    const std::string sub = argc == 3 ? argv[2] : "";
+    if (sub != "write" && sub != "verify") {
+      std::cerr << "usage: multi-pack-index (write | verify)\n";
+      return EXIT_FAILURE;
+    }
+
+    const fs::path pack_dir = store.objects_root() / "pack";
+    try {
+      if (sub == "verify") {
+        const auto midx = MultiPackIndex::open(pack_dir / "multi-pack-index", store.hash_algo());
+        if (!midx) {
+          std::cerr << "multi-pack-index: no valid multi-pack-index in " << pack_dir.string() << "\n";
+          return EXIT_FAILURE;
+        }
+        if (auto problem = midx->verify(pack_dir)) {
+          std::cerr << "multi-pack-index: " << *problem << "\n";
+          return EXIT_FAILURE;
+        }
+        return EXIT_SUCCESS;
+      }
+      write_multi_pack_index(pack_dir, store.hash_algo());
+    } catch (const std::exception& e) {
+      std::cerr << "multi-pack-index: " << e.what() << "\n";
+      return EXIT_FAILURE;
+    }
     return EXIT_SUCCESS;
   }
 };
@@ -315,6 +1257,13 @@ static std::unique_ptr<ICommand> make_cmd(const std::string& name) {
   if (name == "ls-tree")     return std::make_unique<LsTreeCommand>();
   if (name == "write-tree")  return std::make_unique<WriteTreeCommand>();
   if (name == "add") return std::make_unique<AddCommand>();
+  if (name == "repack")      return std::make_unique<RepackCommand>();
+  if (name == "multi-pack-index") return std::make_unique<MultiPackIndexCommand>();
+  if (name == "commit-tree") return std::make_unique<CommitTreeCommand>();
+  if (name == "commit")      return std::make_unique<CommitCommand>();
+  if (name == "commit-graph") return std::make_unique<CommitGraphCommand>();
+  if (name == "rev-list")    return std::make_unique<RevListCommand>();
+  if (name == "log")         return std::make_unique<LogCommand>();
   return nullptr;
 }
 
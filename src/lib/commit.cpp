@@ -0,0 +1,141 @@
+#include "commit.hpp"
+
+#include <algorithm>
+#include <cctype>
+#include <charconv>
+#include <cstdlib>
+#include <ctime>
+#include <stdexcept>
+
+[[noreturn]] static void corrupt(const std::string& what) {
+    throw std::runtime_error("corrupt commit: " + what);
+}
+
+static Oid header_oid(std::string_view value, HashAlgo algo, std::string_view field) {
+    auto oid = Oid::from_hex(value);
+    if (!oid || oid->algo != algo) corrupt("bad " + std::string(field) + " id");
+    return *oid;
+}
+
+// "<unix seconds> <+hhmm>" at the end of an ident line
+static bool parse_ident_date(std::string_view date, std::int64_t& seconds) {
+    const std::size_t sp = date.find(' ');
+    if (sp == std::string_view::npos || sp == 0) return false;
+    const std::string_view tz = date.substr(sp + 1);
+    if (tz.size() != 5 || (tz[0] != '+' && tz[0] != '-')) return false;
+    for (char c : tz.substr(1)) {
+        if (!std::isdigit(static_cast<unsigned char>(c))) return false;
+    }
+    auto [end, ec] = std::from_chars(date.data(), date.data() + sp, seconds);
+    return ec == std::errc() && end == date.data() + sp;
+}
+
+std::int64_t Commit::commit_time() const {
+    const std::size_t close = committer.rfind('>');
+    if (close == std::string::npos || close + 2 > committer.size()) return 0;
+    std::int64_t seconds = 0;
+    return parse_ident_date(std::string_view(committer).substr(close + 2), seconds) ? seconds : 0;
+}
+
+std::string Commit::serialize() const {
+    std::string out;
+    out.reserve(256 + message.size());
+    out += "tree ";
+    out += tree.hex().view();
+    out += '\n';
+    for (const Oid& p : parents) {
+        out += "parent ";
+        out += p.hex().view();
+        out += '\n';
+    }
+    out += "author " + author + '\n';
+    out += "committer " + committer + '\n';
+    out += extra_headers;
+    out += '\n';
+    out += message;
+    return out;
+}
+
+Commit Commit::parse(std::string_view payload, HashAlgo algo) {
+    Commit c;
+    bool have_tree = false;
+    std::size_t pos = 0;
+    while (true) {
+        const std::size_t eol = payload.find('\n', pos);
+        if (eol == std::string_view::npos) corrupt("unterminated header");
+        const std::string_view line = payload.substr(pos, eol - pos);
+        const std::size_t start = pos;
+        pos = eol + 1;
+        if (line.empty()) break; // end of headers
+
+        const std::size_t sp = line.find(' ');
+        const std::string_view key = line.substr(0, sp);
+        const std::string_view value = sp == std::string_view::npos ? "" : line.substr(sp + 1);
+        if (key == "tree" && !have_tree && c.parents.empty()) {
+            c.tree = header_oid(value, algo, key);
+            have_tree = true;
+        } else if (key == "parent" && have_tree && c.author.empty()) {
+            c.parents.push_back(header_oid(value, algo, key));
+        } else if (key == "author" && have_tree && c.author.empty()) {
+            c.author = value;
+        } else if (key == "committer" && !c.author.empty() && c.committer.empty()) {
+            c.committer = value;
+        } else if (!c.committer.empty()) {
+            // Extra headers, including multi-line ones (continuations start
+            // with a space), are kept byte for byte
+            c.extra_headers.append(payload.substr(start, pos - start));
+        } else {
+            corrupt("unexpected '" + std::string(key) + "' header");
+        }
+    }
+    if (!have_tree || c.committer.empty()) corrupt("missing tree, author or committer");
+    c.message = payload.substr(pos);
+    return c;
+}
+
+std::optional<Oid> tag_target(std::string_view payload) {
+    if (payload.rfind("object ", 0) != 0) return std::nullopt;
+    const std::size_t eol = payload.find('\n');
+    return Oid::from_hex(payload.substr(7, eol == std::string_view::npos ? eol : eol - 7));
+}
+
+std::string make_ident(std::string_view role, const Config& config) {
+    const std::string prefix = role == "author" ? "GIT_AUTHOR_" : "GIT_COMMITTER_";
+    auto setting = [&](const char* env, const char* key) -> std::string {
+        if (const char* v = std::getenv((prefix + env).c_str()); v && *v) return v;
+        return config.get(key).value_or("");
+    };
+    const std::string name = setting("NAME", "user.name");
+    const std::string email = setting("EMAIL", "user.email");
+    if (name.empty() || email.empty()) {
+        throw std::runtime_error("unknown " + std::string(role) +
+                                 " identity: set user.name and user.email in .git/config or " +
+                                 prefix + "NAME / " + prefix + "EMAIL");
+    }
+
+    std::string date;
+    if (const char* v = std::getenv((prefix + "DATE").c_str()); v && *v) {
+        std::string_view d = v;
+        if (d.front() == '@') d.remove_prefix(1);
+        std::int64_t seconds = 0;
+        if (!parse_ident_date(d, seconds)) {
+            throw std::runtime_error("bad " + prefix + "DATE '" + v + "' (want '<unix seconds> <+hhmm>')");
+        }
+        date = d;
+    } else {
+        const std::time_t now = std::time(nullptr);
+        std::tm local{};
+        localtime_r(&now, &local);
+        const long offset = local.tm_gmtoff / 60;
+        // Real offsets stay within +-14:00; the clamp keeps the field at
+        // four digits whatever tm_gmtoff holds
+        const long abs = std::min(offset < 0 ? -offset : offset, 99L * 60 + 59);
+        const auto hours = static_cast<int>(abs / 60);
+        const auto minutes = static_cast<int>(abs % 60);
+        const char tz[] = {offset < 0 ? '-' : '+', static_cast<char>('0' + hours / 10),
+                           static_cast<char>('0' + hours % 10), static_cast<char>('0' + minutes / 10),
+                           static_cast<char>('0' + minutes % 10), '\0'};
+        date = std::to_string(static_cast<long long>(now)) + ' ' + tz;
+    }
+    return name + " <" + email + "> " + date;
+}
@@ -0,0 +1,49 @@
+#pragma once
+
+#include "config.hpp"
+#include "oid.hpp"
+
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// A commit object's payload (the bytes after "commit <size>\0"):
+//   tree <hex>
+//   parent <hex>        zero or more
+//   author <ident>
+//   committer <ident>
+//   <other headers>     kept verbatim (gpgsig, encoding, ...)
+//
+//   <message>
+// where <ident> is "Name <email> <unix seconds> <+hhmm>".
+struct Commit {
+    Oid tree;
+    std::vector<Oid> parents;
+    std::string author;
+    std::string committer;
+    std::string extra_headers; // full lines, each ending in '\n'
+    std::string message;
+
+    // Seconds since the epoch from the committer line (0 when malformed)
+    std::int64_t commit_time() const;
+
+    // Payload bytes, the inverse of parse()
+    std::string serialize() const;
+
+    // Throws std::runtime_error ("corrupt commit: ...") on malformed input.
+    static Commit parse(std::string_view payload, HashAlgo algo);
+};
+
+// Target of an annotated tag: the "object <hex>" header of its payload;
+// nullopt when that header is missing or malformed.
+std::optional<Oid> tag_target(std::string_view payload);
+
+// Identity line for `role` ("author" or "committer"), Git's way: name and
+// email from GIT_AUTHOR_NAME / GIT_AUTHOR_EMAIL (GIT_COMMITTER_* for the
+// committer) or user.name / user.email, the date from GIT_AUTHOR_DATE /
+// GIT_COMMITTER_DATE ("<unix seconds> <+hhmm>", optionally prefixed with
+// '@') or the current time and local offset. Throws when no name or email
+// is configured.
+std::string make_ident(std::string_view role, const Config& config);
@@ -0,0 +1,344 @@
+#include "commit_graph.hpp"
+
+#include "byte_order.hpp"
+#include "commit.hpp"
+#include "file_util.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <stdexcept>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <unordered_map>
+
+static constexpr char kSignature[4] = {'C', 'G', 'P', 'H'};
+static constexpr std::uint8_t kVersion = 1;
+static constexpr std::size_t kHeaderLen = 8;
+static constexpr std::size_t kChunkEntryLen = 12;
+static constexpr std::size_t kFanoutLen = 256 * 4;
+
+static constexpr std::uint32_t kChunkFanout = 0x4f494446; // "OIDF"
+static constexpr std::uint32_t kChunkOids = 0x4f49444c;   // "OIDL"
+static constexpr std::uint32_t kChunkData = 0x43444154;   // "CDAT"
+static constexpr std::uint32_t kChunkEdges = 0x45444745;  // "EDGE"
+
+static constexpr std::uint32_t kParentNone = 0x70000000;
+static constexpr std::uint32_t kEdgeFlag = 0x80000000; // parent 2: EDGE index; EDGE: last parent
+static constexpr std::int64_t kTimeMax = (std::int64_t{1} << 34) - 1;
+
+// ------------------------------------------------------------------ reading
+
+std::unique_ptr<CommitGraph> CommitGraph::open(const fs::path& file, HashAlgo algo) {
+    const int fd = ::open(file.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return nullptr;
+    struct stat st {};
+    if (::fstat(fd, &st) != 0 || st.st_size == 0) {
+        ::close(fd);
+        return nullptr;
+    }
+    const auto size = static_cast<std::size_t>(st.st_size);
+    void* map = ::mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if (map == MAP_FAILED) return nullptr;
+
+    std::unique_ptr<CommitGraph> g(new CommitGraph());
+    g->algo_ = algo;
+    g->hash_len_ = hash_len(algo);
+    g->data_ = static_cast<const unsigned char*>(map);
+    g->size_ = size;
+
+    const unsigned char* p = g->data_;
+    const std::size_t h = g->hash_len_;
+    if (size < kHeaderLen + kChunkEntryLen + h || std::memcmp(p, kSignature, 4) != 0 ||
+        p[4] != kVersion || p[5] != hash_version(algo) || p[7] != 0) {
+        return nullptr;
+    }
+
+    // Chunk table: each chunk runs up to the offset of the next entry
+    const std::size_t chunks = p[6];
+    const std::size_t end = size - h;
+    if (kHeaderLen + (chunks + 1) * kChunkEntryLen > end) return nullptr;
+    std::size_t fanout_len = 0, oids_len = 0, cdat_len = 0, edges_len = 0;
+    for (std::size_t i = 0; i < chunks; ++i) {
+        const unsigned char* entry = p + kHeaderLen + i * kChunkEntryLen;
+        const std::uint32_t id = read_be32(entry);
+        const std::uint64_t off = read_be64(entry + 4);
+        const std::uint64_t next = read_be64(entry + kChunkEntryLen + 4);
+        if (off > next || next > end) return nullptr;
+        const unsigned char* chunk = p + off;
+        const std::size_t len = static_cast<std::size_t>(next - off);
+        switch (id) {
+        case kChunkFanout: g->fanout_ = chunk; fanout_len = len; break;
+        case kChunkOids: g->oids_ = chunk; oids_len = len; break;
+        case kChunkData: g->cdat_ = chunk; cdat_len = len; break;
+        case kChunkEdges: g->edges_ = chunk; edges_len = len; break;
+        default: break; // optional chunks (GDA2, BIDX, ...) are not used
+        }
+    }
+
+    if (!g->fanout_ || !g->oids_ || !g->cdat_ || fanout_len != kFanoutLen) return nullptr;
+    g->count_ = read_be32(g->fanout_ + 255 * 4);
+    if (oids_len != std::size_t(g->count_) * h || cdat_len != std::size_t(g->count_) * (h + 16) ||
+        edges_len % 4 != 0) {
+        return nullptr;
+    }
+    g->edge_count_ = edges_len / 4;
+    return g;
+}
+
+CommitGraph::~CommitGraph() {
+    if (data_) ::munmap(const_cast<unsigned char*>(data_), size_);
+}
+
+std::optional<std::uint32_t> CommitGraph::find(const Oid& oid) const {
+    if (oid.algo != algo_) return std::nullopt;
+    const int first = oid.bytes[0];
+    std::uint32_t lo = first == 0 ? 0 : read_be32(fanout_ + 4 * (first - 1));
+    std::uint32_t hi = std::min(read_be32(fanout_ + 4 * first), count_);
+    while (lo < hi) {
+        const std::uint32_t mid = lo + (hi - lo) / 2;
+        const int cmp = std::memcmp(oids_ + std::size_t(mid) * hash_len_, oid.bytes, hash_len_);
+        if (cmp == 0) return mid;
+        if (cmp < 0) lo = mid + 1;
+        else hi = mid;
+    }
+    return std::nullopt;
+}
+
+const unsigned char* CommitGraph::cdat(std::uint32_t pos) const {
+    return cdat_ + std::size_t(pos) * (hash_len_ + 16);
+}
+
+Oid CommitGraph::oid_at(std::uint32_t pos) const {
+    return Oid::from_raw(oids_ + std::size_t(pos) * hash_len_, algo_);
+}
+
+Oid CommitGraph::tree_at(std::uint32_t pos) const {
+    return Oid::from_raw(cdat(pos), algo_);
+}
+
+std::uint32_t CommitGraph::generation(std::uint32_t pos) const {
+    return read_be32(cdat(pos) + hash_len_ + 8) >> 2;
+}
+
+std::int64_t CommitGraph::commit_time(std::uint32_t pos) const {
+    const unsigned char* d = cdat(pos) + hash_len_ + 8;
+    return (std::int64_t(read_be32(d) & 3) << 32) | read_be32(d + 4);
+}
+
+void CommitGraph::parents(std::uint32_t pos, std::vector<std::uint32_t>& out) const {
+    auto push = [&](std::uint32_t parent) {
+        if (parent >= count_) throw std::runtime_error("corrupt commit-graph: parent out of range");
+        out.push_back(parent);
+    };
+    const unsigned char* d = cdat(pos) + hash_len_;
+    const std::uint32_t p1 = read_be32(d);
+    const std::uint32_t p2 = read_be32(d + 4);
+    if (p1 == kParentNone) return;
+    push(p1);
+    if (p2 == kParentNone) return;
+    if ((p2 & kEdgeFlag) == 0) {
+        push(p2);
+        return;
+    }
+    for (std::size_t i = p2 & ~kEdgeFlag;; ++i) {
+        if (i >= edge_count_) throw std::runtime_error("corrupt commit-graph: edge out of range");
+        const std::uint32_t e = read_be32(edges_ + 4 * i);
+        push(e & ~kEdgeFlag);
+        if (e & kEdgeFlag) return;
+    }
+}
+
+std::optional<std::string> CommitGraph::verify(const ObjectStore& store) const {
+    unsigned char digest[kMaxHashLen];
+    Hasher::digest(algo_, data_, size_ - hash_len_, digest);
+    if (std::memcmp(digest, data_ + size_ - hash_len_, hash_len_) != 0) {
+        return std::string("checksum mismatch");
+    }
+
+    std::vector<std::uint32_t> parents_of;
+    for (std::uint32_t pos = 0; pos < count_; ++pos) {
+        const Oid oid = oid_at(pos);
+        const std::string hex = oid.to_hex();
+        if (pos > 0 && std::memcmp(oids_ + std::size_t(pos - 1) * hash_len_, oid.bytes, hash_len_) >= 0) {
+            return "commit OIDs out of order at " + hex;
+        }
+        if (find(oid) != pos) return "fanout does not cover " + hex;
+
+        const auto obj = store.read_object(oid);
+        if (!obj || obj->type != "commit") return "missing commit " + hex;
+        const Commit c = Commit::parse(obj->content, algo_);
+        if (c.tree != tree_at(pos)) return "root tree mismatch for " + hex;
+
+        parents_of.clear();
+        parents(pos, parents_of);
+        if (parents_of.size() != c.parents.size()) return "parent count mismatch for " + hex;
+        std::uint32_t expected_gen = 0;
+        for (std::size_t i = 0; i < parents_of.size(); ++i) {
+            if (oid_at(parents_of[i]) != c.parents[i]) return "parent mismatch for " + hex;
+            expected_gen = std::max(expected_gen, generation(parents_of[i]));
+        }
+        expected_gen = std::min(expected_gen + 1, kGenerationMax);
+        if (generation(pos) != expected_gen) return "generation mismatch for " + hex;
+        if (commit_time(pos) != std::clamp<std::int64_t>(c.commit_time(), 0, kTimeMax)) {
+            return "commit date mismatch for " + hex;
+        }
+    }
+    return std::nullopt;
+}
+
+// ------------------------------------------------------------------ writing
+
+namespace {
+
+struct GraphCommit {
+    Oid oid;
+    Oid tree;
+    std::vector<Oid> parents;
+    std::int64_t time = 0;
+    std::uint32_t generation = 0; // 0 until computed
+};
+
+} // namespace
+
+std::size_t write_commit_graph(const ObjectStore& store, const std::vector<Oid>& tips,
+                               const fs::path& file) {
+    const HashAlgo algo = store.hash_algo();
+    const std::size_t h = hash_len(algo);
+    const auto previous = CommitGraph::open(file, algo);
+
+    // Collect every reachable commit, from the old graph where possible
+    std::vector<GraphCommit> commits;
+    std::unordered_map<Oid, std::uint32_t, OidHash> index;
+    // (oid, is a tip): refs may point at trees or blobs, parents may not
+    std::vector<std::pair<Oid, bool>> todo;
+    for (const Oid& tip : tips) todo.emplace_back(tip, true);
+    std::vector<std::uint32_t> parent_pos;
+    while (!todo.empty()) {
+        const auto [oid, is_tip] = todo.back();
+        todo.pop_back();
+        if (index.count(oid)) continue;
+
+        GraphCommit c;
+        c.oid = oid;
+        if (auto pos = previous ? previous->find(oid) : std::nullopt) {
+            c.tree = previous->tree_at(*pos);
+            c.time = previous->commit_time(*pos);
+            parent_pos.clear();
+            previous->parents(*pos, parent_pos);
+            for (std::uint32_t p : parent_pos) c.parents.push_back(previous->oid_at(p));
+        } else {
+            const auto obj = store.read_object(oid);
+            if (!obj) throw std::runtime_error("missing object " + oid.to_hex());
+            if (obj->type == "tag") {
+                if (auto target = tag_target(obj->content)) todo.emplace_back(*target, is_tip);
+                continue;
+            }
+            if (obj->type != "commit") {
+                if (is_tip) continue;
+                throw std::runtime_error("parent " + oid.to_hex() + " is a " + obj->type);
+            }
+            Commit parsed = Commit::parse(obj->content, algo);
+            c.tree = parsed.tree;
+            c.parents = std::move(parsed.parents);
+            c.time = std::clamp<std::int64_t>(parsed.commit_time(), 0, kTimeMax);
+        }
+        for (const Oid& p : c.parents) todo.emplace_back(p, false);
+        index.emplace(oid, static_cast<std::uint32_t>(commits.size()));
+        commits.push_back(std::move(c));
+    }
+
+    // Generations: post-order over the parents, without recursion
+    std::vector<std::uint32_t> stack;
+    for (std::uint32_t start = 0; start < commits.size(); ++start) {
+        if (commits[start].generation) continue;
+        stack.push_back(start);
+        while (!stack.empty()) {
+            GraphCommit& c = commits[stack.back()];
+            if (c.generation) {
+                stack.pop_back();
+                continue;
+            }
+            std::uint32_t gen = 0;
+            bool ready = true;
+            for (const Oid& p : c.parents) {
+                const std::uint32_t pi = index.at(p);
+                if (!commits[pi].generation) {
+                    stack.push_back(pi);
+                    ready = false;
+                } else {
+                    gen = std::max(gen, commits[pi].generation);
+                }
+            }
+            if (ready) {
+                c.generation = std::min(gen + 1, CommitGraph::kGenerationMax);
+                stack.pop_back();
+            }
+        }
+    }
+
+    // Positions follow OID order
+    std::vector<std::uint32_t> order(commits.size());
+    for (std::uint32_t i = 0; i < order.size(); ++i) order[i] = i;
+    std::sort(order.begin(), order.end(), [&](std::uint32_t a, std::uint32_t b) {
+        return std::memcmp(commits[a].oid.bytes, commits[b].oid.bytes, h) < 0;
+    });
+    std::vector<std::uint32_t> pos_of(commits.size());
+    for (std::uint32_t pos = 0; pos < order.size(); ++pos) pos_of[order[pos]] = pos;
+    auto position = [&](const Oid& oid) { return pos_of[index.at(oid)]; };
+
+    std::string fanout, oids, cdat, edges;
+    std::uint32_t counts[256] = {};
+    for (const auto& c : commits) ++counts[c.oid.bytes[0]];
+    for (std::uint32_t b = 0, total = 0; b < 256; ++b) put_be32(fanout, total += counts[b]);
+    for (std::uint32_t i : order) {
+        const GraphCommit& c = commits[i];
+        oids.append(reinterpret_cast<const char*>(c.oid.bytes), h);
+        cdat.append(reinterpret_cast<const char*>(c.tree.bytes), h);
+        put_be32(cdat, c.parents.empty() ? kParentNone : position(c.parents[0]));
+        if (c.parents.size() <= 2) {
+            put_be32(cdat, c.parents.size() == 2 ? position(c.parents[1]) : kParentNone);
+        } else {
+            put_be32(cdat, kEdgeFlag | static_cast<std::uint32_t>(edges.size() / 4));
+            for (std::size_t k = 1; k < c.parents.size(); ++k) {
+                const bool last = k + 1 == c.parents.size();
+                put_be32(edges, position(c.parents[k]) | (last ? kEdgeFlag : 0));
+            }
+        }
+        const auto time = static_cast<std::uint64_t>(c.time);
+        put_be32(cdat, (c.generation << 2) | static_cast<std::uint32_t>(time >> 32));
+        put_be32(cdat, static_cast<std::uint32_t>(time));
+    }
+
+    struct Chunk {
+        std::uint32_t id;
+        const std::string* data;
+    };
+    std::vector<Chunk> chunks = {{kChunkFanout, &fanout}, {kChunkOids, &oids}, {kChunkData, &cdat}};
+    if (!edges.empty()) chunks.push_back({kChunkEdges, &edges});
+
+    std::string out(kSignature, sizeof(kSignature));
+    out.push_back(static_cast<char>(kVersion));
+    out.push_back(static_cast<char>(hash_version(algo)));
+    out.push_back(static_cast<char>(chunks.size()));
+    out.push_back(0); // no base graphs
+    std::uint64_t offset = kHeaderLen + (chunks.size() + 1) * kChunkEntryLen;
+    for (const auto& chunk : chunks) {
+        put_be32(out, chunk.id);
+        put_be64(out, offset);
+        offset += chunk.data->size();
+    }
+    put_be32(out, 0);
+    put_be64(out, offset);
+    for (const auto& chunk : chunks) out += *chunk.data;
+    unsigned char digest[kMaxHashLen];
+    Hasher::digest(algo, out.data(), out.size(), digest);
+    out.append(reinterpret_cast<const char*>(digest), h);
+
+    fs::create_directories(file.parent_path());
+    replace_file(file, out);
+    return commits.size();
+}
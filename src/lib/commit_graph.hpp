@@ -0,0 +1,80 @@
+#pragma once
+
+#include "object_store.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <memory>
+#include <optional>
+#include <string>
+#include <vector>
+
+namespace fs = std::filesystem;
+
+// Read-only view over a commit-graph file ("objects/info/commit-graph"),
+// in Git's format so either tool can read what the other wrote:
+//   "CGPH" | version 1 | hash version | chunk count | base graph count 0
+//   | chunk table: (id, 64-bit offset) per chunk plus a terminating entry
+//   OIDF  fanout[256] over the first OID byte
+//   OIDL  sorted commit OIDs
+//   CDAT  per commit: root tree OID | parent 1 | parent 2 | generation
+//         (30 bits) and commit time (34 bits)
+//   EDGE  parents 3.. of octopus merges (optional)
+//   | hash of everything before it
+// Parents are stored as positions in OIDL, so walks that stay inside the
+// graph never inflate a commit object. The file is mmap'ed for the lifetime
+// of the object.
+class CommitGraph {
+public:
+    static constexpr std::uint32_t kGenerationMax = 0x3FFFFFFF;
+
+    // nullptr when the file is missing, malformed or for another hash
+    static std::unique_ptr<CommitGraph> open(const fs::path& file, HashAlgo algo);
+    ~CommitGraph();
+
+    CommitGraph(const CommitGraph&) = delete;
+    CommitGraph& operator=(const CommitGraph&) = delete;
+
+    std::uint32_t count() const { return count_; }
+
+    // Position of `oid`, by a binary search inside its fanout bucket
+    std::optional<std::uint32_t> find(const Oid& oid) const;
+
+    Oid oid_at(std::uint32_t pos) const;
+    Oid tree_at(std::uint32_t pos) const;
+    // 1 for root commits, else 1 + the largest parent generation (capped at
+    // kGenerationMax): a commit can only reach commits of lower generation
+    std::uint32_t generation(std::uint32_t pos) const;
+    std::int64_t commit_time(std::uint32_t pos) const;
+    // Appends the positions of the parents of `pos`, in commit order.
+    // Throws on out-of-range parent positions.
+    void parents(std::uint32_t pos, std::vector<std::uint32_t>& out) const;
+
+    // Checks the trailing hash and every entry against the commit objects
+    // in `store`; returns a description of the first problem, or nullopt.
+    std::optional<std::string> verify(const ObjectStore& store) const;
+
+private:
+    CommitGraph() = default;
+    const unsigned char* cdat(std::uint32_t pos) const;
+
+    HashAlgo algo_ = HashAlgo::Sha1;
+    std::size_t hash_len_ = kSha1Len;
+    const unsigned char* data_ = nullptr;
+    std::size_t size_ = 0;
+    std::uint32_t count_ = 0;
+    const unsigned char* fanout_ = nullptr;
+    const unsigned char* oids_ = nullptr;
+    const unsigned char* cdat_ = nullptr;
+    const unsigned char* edges_ = nullptr;
+    std::size_t edge_count_ = 0;
+};
+
+// Writes a commit-graph to `file` covering every commit reachable from
+// `tips` (annotated tags are peeled; tips that are not commits are
+// skipped). Commits already in `file` are taken from it instead of being
+// read, so refreshing the graph after new commits only inflates those.
+// Written to a temp file and renamed into place. Returns the commit count.
+std::size_t write_commit_graph(const ObjectStore& store, const std::vector<Oid>& tips,
+                               const fs::path& file);
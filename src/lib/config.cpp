@@ -0,0 +1,145 @@
+#include "config.hpp"
+
+#include <cctype>
+#include <fstream>
+#include <iterator>
+#include <stdexcept>
+
+static std::string lower(std::string_view s) {
+    std::string out(s);
+    for (char& c : out) c = static_cast<char>(std::tolower(static_cast<unsigned char>(c)));
+    return out;
+}
+
+static std::string_view trim(std::string_view s) {
+    while (!s.empty() && std::isspace(static_cast<unsigned char>(s.front()))) s.remove_prefix(1);
+    while (!s.empty() && std::isspace(static_cast<unsigned char>(s.back()))) s.remove_suffix(1);
+    return s;
+}
+
+// "section.sub.key": section and key lowercased, the subsection kept as is
+static std::string normalize_key(std::string_view key) {
+    const std::size_t first = key.find('.');
+    const std::size_t last = key.rfind('.');
+    if (first == std::string_view::npos) return lower(key);
+    std::string out = lower(key.substr(0, first));
+    if (last != first) {
+        out.append(key.substr(first, last - first));
+    }
+    out.push_back('.');
+    out.append(lower(key.substr(last + 1)));
+    return out;
+}
+
+Config Config::load(const fs::path& file) {
+    Config cfg;
+    std::ifstream in(file, std::ios::binary);
+    if (!in) return cfg;
+    const std::string text((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+    cfg.parse(text, file);
+    return cfg;
+}
+
+void Config::parse(std::string_view text, const fs::path& file) {
+    auto fail = [&](std::size_t line_no) {
+        throw std::runtime_error("bad config line " + std::to_string(line_no) + " in " +
+                                 file.string());
+    };
+
+    std::string section;
+    std::size_t line_no = 0;
+    while (!text.empty()) {
+        ++line_no;
+        const std::size_t eol = text.find('\n');
+        std::string_view line = trim(text.substr(0, eol));
+        text.remove_prefix(eol == std::string_view::npos ? text.size() : eol + 1);
+
+        if (line.empty() || line[0] == '#' || line[0] == ';') continue;
+
+        if (line[0] == '[') {
+            const std::size_t close = line.find(']');
+            if (close == std::string_view::npos) fail(line_no);
+            const std::string_view head = trim(line.substr(1, close - 1));
+            const std::size_t quote = head.find('"');
+            if (quote == std::string_view::npos) {
+                section = lower(head);
+            } else {
+                if (head.size() < quote + 2 || head.back() != '"') fail(line_no);
+                section = lower(trim(head.substr(0, quote)));
+                section.push_back('.');
+                section.append(head.substr(quote + 1, head.size() - quote - 2));
+            }
+            continue;
+        }
+        if (section.empty()) fail(line_no);
+
+        // "key" alone means boolean true
+        const std::size_t eq = line.find('=');
+        const std::string key = lower(trim(line.substr(0, eq)));
+        if (key.empty()) fail(line_no);
+        if (eq == std::string_view::npos) {
+            values_[section + '.' + key] = "true";
+            continue;
+        }
+
+        std::string value;
+        bool quoted = false;
+        std::size_t pending_space = 0; // unquoted inner whitespace is kept
+        for (const char* p = line.data() + eq + 1, *end = line.data() + line.size(); p < end; ++p) {
+            const char c = *p;
+            if (!quoted && (c == '#' || c == ';')) break;
+            if (c == '"') {
+                quoted = !quoted;
+                continue;
+            }
+            if (c == '\\' && p + 1 < end) {
+                const char n = *++p;
+                value.append(pending_space, ' ');
+                pending_space = 0;
+                value.push_back(n == 'n' ? '\n' : n == 't' ? '\t' : n);
+                continue;
+            }
+            if (!quoted && std::isspace(static_cast<unsigned char>(c))) {
+                if (!value.empty()) ++pending_space;
+                continue;
+            }
+            value.append(pending_space, ' ');
+            pending_space = 0;
+            value.push_back(c);
+        }
+        if (quoted) fail(line_no);
+        values_[section + '.' + key] = std::move(value);
+    }
+}
+
+std::optional<std::string> Config::get(std::string_view key) const {
+    auto it = values_.find(normalize_key(key));
+    if (it == values_.end()) return std::nullopt;
+    return it->second;
+}
+
+std::optional<long long> Config::get_int(std::string_view key) const {
+    auto value = get(key);
+    if (!value) return std::nullopt;
+    std::size_t used = 0;
+    long long n = 0;
+    try {
+        n = std::stoll(*value, &used, 0);
+    } catch (const std::exception&) {
+        used = 0;
+    }
+    const std::string_view rest = std::string_view(*value).substr(used);
+    if (used == 0 || rest.size() > 1) {
+        throw std::runtime_error("bad numeric config value '" + *value + "' for " + std::string(key));
+    }
+    if (!rest.empty()) {
+        switch (std::tolower(static_cast<unsigned char>(rest[0]))) {
+        case 'k': return n << 10;
+        case 'm': return n << 20;
+        case 'g': return n << 30;
+        default:
+            throw std::runtime_error("bad numeric config value '" + *value + "' for " + std::string(key));
+        }
+    }
+    return n;
+}
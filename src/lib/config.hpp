@@ -0,0 +1,31 @@
+#pragma once
+
+#include <filesystem>
+#include <map>
+#include <optional>
+#include <string>
+#include <string_view>
+
+namespace fs = std::filesystem;
+
+// Reader for the subset of git-config syntax that appears in .git/config:
+//   [section]  [section "subsection"]  key = value  # or ; comments
+// Values may be double-quoted and use \" \\ \n \t escapes. Section and key
+// names are case-insensitive (subsections are not). Lookups take
+// "section.key" or "section.subsection.key"; the last assignment wins.
+class Config {
+public:
+    // A missing file yields an empty config.
+    static Config load(const fs::path& file);
+
+    std::optional<std::string> get(std::string_view key) const;
+
+    // Integer value with an optional k/m/g suffix; throws when the value is
+    // not a number.
+    std::optional<long long> get_int(std::string_view key) const;
+
+private:
+    void parse(std::string_view text, const fs::path& file);
+
+    std::map<std::string, std::string> values_;
+};
@@ -0,0 +1,197 @@
+#include "delta.hpp"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <unordered_map>
+
+static std::size_t read_size_varint(std::string_view delta, std::size_t& pos) {
+    std::size_t value = 0;
+    int shift = 0;
+    while (true) {
+        if (pos >= delta.size()) {
+            throw std::runtime_error("corrupt delta: truncated size");
+        }
+        const auto byte = static_cast<unsigned char>(delta[pos++]);
+        value |= static_cast<std::size_t>(byte & 0x7f) << shift;
+        if ((byte & 0x80) == 0) break;
+        shift += 7;
+    }
+    return value;
+}
+
+DeltaSizes read_delta_sizes(std::string_view delta) {
+    std::size_t pos = 0;
+    DeltaSizes s;
+    s.base_size = read_size_varint(delta, pos);
+    s.result_size = read_size_varint(delta, pos);
+    return s;
+}
+
+std::string apply_delta(std::string_view base, std::string_view delta) {
+    std::size_t pos = 0;
+    const std::size_t base_size = read_size_varint(delta, pos);
+    const std::size_t result_size = read_size_varint(delta, pos);
+
+    if (base_size != base.size()) {
+        throw std::runtime_error("corrupt delta: base size mismatch");
+    }
+
+    std::string out;
+    out.reserve(result_size);
+
+    while (pos < delta.size()) {
+        const auto op = static_cast<unsigned char>(delta[pos++]);
+
+        if (op & 0x80) {
+            // Copy: bits 0-3 select offset bytes, bits 4-6 select size bytes
+            std::size_t offset = 0;
+            std::size_t size = 0;
+            for (int i = 0; i < 4; ++i) {
+                if (op & (1u << i)) {
+                    if (pos >= delta.size()) throw std::runtime_error("corrupt delta: truncated copy");
+                    offset |= static_cast<std::size_t>(static_cast<unsigned char>(delta[pos++])) << (8 * i);
+                }
+            }
+            for (int i = 0; i < 3; ++i) {
+                if (op & (1u << (4 + i))) {
+                    if (pos >= delta.size()) throw std::runtime_error("corrupt delta: truncated copy");
+                    size |= static_cast<std::size_t>(static_cast<unsigned char>(delta[pos++])) << (8 * i);
+                }
+            }
+            if (size == 0) size = 0x10000;
+
+            if (offset > base.size() || size > base.size() - offset) {
+                throw std::runtime_error("corrupt delta: copy out of range");
+            }
+            out.append(base.data() + offset, size);
+        } else if (op != 0) {
+            // Insert: `op` literal bytes follow
+            if (op > delta.size() - pos) {
+                throw std::runtime_error("corrupt delta: truncated insert");
+            }
+            out.append(delta.data() + pos, op);
+            pos += op;
+        } else {
+            throw std::runtime_error("corrupt delta: reserved opcode 0");
+        }
+    }
+
+    if (out.size() != result_size) {
+        throw std::runtime_error("corrupt delta: result size mismatch");
+    }
+    return out;
+}
+
+// ------------------------------ create_delta -----------------------------
+
+static constexpr std::size_t kBlock = 16;
+static constexpr std::uint32_t kPrime = 0x01000193u;
+
+static std::uint32_t block_hash(const unsigned char* p) {
+    std::uint32_t h = 0;
+    for (std::size_t i = 0; i < kBlock; ++i) h = h * kPrime + p[i];
+    return h;
+}
+
+static void write_size_varint(std::string& out, std::size_t v) {
+    while (v >= 0x80) {
+        out.push_back(static_cast<char>((v & 0x7f) | 0x80));
+        v >>= 7;
+    }
+    out.push_back(static_cast<char>(v));
+}
+
+static void flush_insert(std::string& out, std::string_view lit) {
+    while (!lit.empty()) {
+        const std::size_t n = std::min<std::size_t>(lit.size(), 127);
+        out.push_back(static_cast<char>(n));
+        out.append(lit.data(), n);
+        lit.remove_prefix(n);
+    }
+}
+
+static void emit_copy(std::string& out, std::size_t offset, std::size_t size) {
+    while (size > 0) {
+        const std::size_t n = std::min<std::size_t>(size, 0xffffff);
+        unsigned char op = 0x80;
+        unsigned char args[7];
+        int nargs = 0;
+        for (int i = 0; i < 4; ++i) {
+            const auto b = static_cast<unsigned char>(offset >> (8 * i));
+            if (b) { op |= 1u << i; args[nargs++] = b; }
+        }
+        for (int i = 0; i < 3; ++i) {
+            const auto b = static_cast<unsigned char>(n >> (8 * i));
+            if (b) { op |= 1u << (4 + i); args[nargs++] = b; }
+        }
+        out.push_back(static_cast<char>(op));
+        out.append(reinterpret_cast<const char*>(args), nargs);
+        offset += n;
+        size -= n;
+    }
+}
+
+std::optional<std::string> create_delta(std::string_view base, std::string_view target,
+                                        std::size_t max_size) {
+    if (base.size() > 0xffffffffu) return std::nullopt; // copy offsets are 32-bit
+
+    std::string out;
+    write_size_varint(out, base.size());
+    write_size_varint(out, target.size());
+
+    const auto* b = reinterpret_cast<const unsigned char*>(base.data());
+    const auto* t = reinterpret_cast<const unsigned char*>(target.data());
+
+    // Index non-overlapping base blocks; the first occurrence wins
+    std::unordered_map<std::uint32_t, std::uint32_t> blocks;
+    blocks.reserve(base.size() / kBlock + 1);
+    for (std::size_t i = 0; i + kBlock <= base.size(); i += kBlock) {
+        blocks.emplace(block_hash(b + i), static_cast<std::uint32_t>(i));
+    }
+
+    std::uint32_t top = 1; // kPrime^(kBlock-1), used to roll the oldest byte out
+    for (std::size_t i = 1; i < kBlock; ++i) top *= kPrime;
+
+    std::size_t lit_begin = 0;
+    std::size_t i = 0;
+    std::uint32_t h = target.size() >= kBlock ? block_hash(t) : 0;
+
+    while (i + kBlock <= target.size()) {
+        auto it = blocks.find(h);
+        if (it != blocks.end() && std::memcmp(b + it->second, t + i, kBlock) == 0) {
+            std::size_t bpos = it->second;
+            std::size_t tpos = i;
+            // Grow backwards into the pending literal run
+            while (tpos > lit_begin && bpos > 0 && b[bpos - 1] == t[tpos - 1]) {
+                --tpos;
+                --bpos;
+            }
+            std::size_t len = (i - tpos) + kBlock;
+            while (tpos + len < target.size() && bpos + len < base.size() &&
+                   b[bpos + len] == t[tpos + len]) {
+                ++len;
+            }
+
+            flush_insert(out, target.substr(lit_begin, tpos - lit_begin));
+            emit_copy(out, bpos, len);
+            if (out.size() > max_size) return std::nullopt;
+
+            i = tpos + len;
+            lit_begin = i;
+            if (i + kBlock <= target.size()) h = block_hash(t + i);
+            continue;
+        }
+
+        if (i + kBlock < target.size()) {
+            h = (h - t[i] * top) * kPrime + t[i + kBlock];
+        }
+        ++i;
+        if (i - lit_begin > max_size) return std::nullopt;
+    }
+
+    flush_insert(out, target.substr(lit_begin));
+    if (out.size() > max_size) return std::nullopt;
+    return out;
+}
@@ -0,0 +1,26 @@
+#pragma once
+
+#include <cstddef>
+#include <optional>
+#include <string>
+#include <string_view>
+
+// Git delta encoding (as used by OFS_DELTA / REF_DELTA pack entries):
+//   <varint base size> <varint result size> <instruction>*
+// where an instruction is either a copy from the base (high bit set) or an
+// insert of 1..127 literal bytes that follow the opcode.
+
+// Reads the two size varints at the start of a delta.
+struct DeltaSizes {
+    std::size_t base_size;
+    std::size_t result_size;
+};
+DeltaSizes read_delta_sizes(std::string_view delta);
+
+// Rebuilds the target object from `base` and `delta`. Throws on corruption.
+std::string apply_delta(std::string_view base, std::string_view delta);
+
+// Encodes `target` as a delta against `base`. Returns std::nullopt when the
+// delta would exceed `max_size` bytes (i.e. is not worth storing).
+std::optional<std::string> create_delta(std::string_view base, std::string_view target,
+                                        std::size_t max_size);
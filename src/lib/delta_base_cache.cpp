@@ -0,0 +1,17 @@
+#include "delta_base_cache.hpp"
+
+#include <utility>
+
+std::shared_ptr<const DeltaBaseCache::Base> DeltaBaseCache::get(const PackFile* pack, std::uint64_t offset) {
+    return lru_.get(Key{pack, offset});
+}
+
+void DeltaBaseCache::put(const PackFile* pack, std::uint64_t offset, std::string type,
+                         std::string content) {
+    const std::size_t cost = content.size();
+    lru_.put(Key{pack, offset}, std::make_shared<const Base>(Base{std::move(type), std::move(content)}), cost);
+}
+
+void DeltaBaseCache::clear() { lru_.clear(); }
+
+DeltaBaseCache::Stats DeltaBaseCache::stats() const { return lru_.stats(); }
@@ -0,0 +1,52 @@
+#pragma once
+
+#include "lru_cache.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+
+class PackFile;
+
+// Size-bounded LRU cache of fully resolved pack entries that served as delta
+// bases, keyed by (pack, offset). Walking many commits keeps hitting the same
+// tree and blob bases; with this cache each base is inflated and rebuilt from
+// its own chain only once. Safe to share between threads.
+class DeltaBaseCache {
+public:
+    static constexpr std::size_t kDefaultLimit = 96u << 20; // 96 MiB
+
+    using Stats = LruCacheStats;
+
+    struct Base {
+        std::string type;
+        std::string content;
+    };
+
+    explicit DeltaBaseCache(std::size_t limit = kDefaultLimit) : lru_(limit) {}
+
+    // Returns the cached base or nullptr. The base stays valid for as long
+    // as the caller holds on to it.
+    std::shared_ptr<const Base> get(const PackFile* pack, std::uint64_t offset);
+
+    void put(const PackFile* pack, std::uint64_t offset, std::string type, std::string content);
+    void clear();
+
+    Stats stats() const;
+
+private:
+    struct Key {
+        const PackFile* pack;
+        std::uint64_t offset;
+        bool operator==(const Key&) const = default;
+    };
+    struct KeyHash {
+        std::size_t operator()(const Key& k) const noexcept {
+            return std::hash<const void*>{}(k.pack) ^ (std::hash<std::uint64_t>{}(k.offset) * 0x9e3779b97f4a7c15ull);
+        }
+    };
+
+    LruCache<Key, Base, KeyHash> lru_;
+};
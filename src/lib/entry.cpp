@@ -1,52 +1,108 @@
 #include <algorithm>
 #include <cstddef>
 #include <cstring>
-#include <openssl/sha.h>
+#include <stdexcept>
 #include <string_view>
 #include <vector>
 #include "entry.hpp"
 
-bool EntryParser::next(Entry& out) {
-    if(!ok_) return false; // sticky
-    if(pos_ >= payload_.size()) return false; // passed the limit
-    
-    // Parse the mode
-    const std::size_t mode_begin = pos_;
-    const std::size_t sp = payload_.find(" ", mode_begin);
+std::string_view entry_type_name(EntryMode mode) {
+    switch (static_cast<std::uint32_t>(mode) & 0170000) {
+    case 0040000: return "tree";
+    case 0100000: return "blob";   // file
+    case 0120000: return "blob";   // symlink (still stored as blob)
+    case 0160000: return "commit"; // submodule
+    default: return "unknown";     // fallback for unexpected modes
+    }
+}
 
-    if (sp == std::string_view::npos || sp == mode_begin) {
-        ok_ = false;
-        err_ = "Missing or corrupted mode";
-        return false;
+ModeString mode_string(EntryMode mode) {
+    ModeString s;
+    auto m = static_cast<std::uint32_t>(mode);
+    for (int i = 5; i >= 0; --i, m >>= 3) s.chars[i] = static_cast<char>('0' + (m & 7));
+    return s;
+}
+
+// "<octal mode> <name>\0<raw oid>" at `pos`. Fills `out`, sets `next` to the
+// following entry and returns nullptr, or returns what is wrong.
+static const char* parse_entry(std::string_view payload, std::size_t pos, HashAlgo algo,
+                               EntryView& out, std::size_t& next) {
+    // Parse the mode
+    const std::size_t sp = payload.find(' ', pos);
+    if (sp == std::string_view::npos || sp == pos || sp - pos > 7) {
+        return "Missing or corrupted mode";
+    }
+    std::uint32_t mode = 0;
+    for (std::size_t i = pos; i < sp; ++i) {
+        const unsigned d = static_cast<unsigned char>(payload[i]) - '0';
+        if (d > 7) return "Missing or corrupted mode";
+        mode = (mode << 3) | d;
     }
 
-    out.mode.assign(payload_, mode_begin, sp - mode_begin);
-    
     // Parse the name
-    const std::size_t name_begin =sp + 1;
-    const std::size_t nul = payload_.find('\0', mode_begin);
+    const std::size_t nul = payload.find('\0', sp + 1);
+    if (nul == std::string_view::npos || nul == sp + 1) {
+        return "Missing or corrupted name";
+    }
 
-    if (nul == std::string_view::npos) {
-        ok_ = false;
-        err_ = "Missing or corrupted name";
-        return false;
+    // The raw Oid (20 or 32 bytes) may end exactly at the end of the payload
+    const std::size_t oid_begin = nul + 1;
+    if (oid_begin + hash_len(algo) > payload.size()) {
+        return "Corrupted Oid";
     }
 
-    out.name.assign(payload_, name_begin, nul - name_begin);
+    out.mode = static_cast<EntryMode>(mode);
+    out.raw_mode = payload.substr(pos, sp - pos);
+    out.name = payload.substr(sp + 1, nul - sp - 1);
+    out.oid_bytes = reinterpret_cast<const unsigned char*>(payload.data() + oid_begin);
+    out.algo = algo;
+    next = oid_begin + hash_len(algo);
+    return nullptr;
+}
+
+void TreeView::iterator::parse() {
+    pos_ = next_;
+    if (pos_ >= payload_.size()) {
+        pos_ = payload_.size();
+        return;
+    }
+    if (const char* err = parse_entry(payload_, pos_, algo_, entry_, next_)) {
+        throw std::runtime_error(std::string("corrupt tree: ") + err);
+    }
+}
+
+TreeView::iterator TreeView::begin() const {
+    iterator it(payload_, algo_, 0);
+    it.parse();
+    return it;
+}
 
-    // Parse the 20 bits Oid
-    const size_t oid_begin = nul + 1;
-    const size_t oid_length = SHA_DIGEST_LENGTH;
+EntryMode Entry::parse_mode() const {
+    std::uint32_t m = 0;
+    for (char c : mode) m = (m << 3) | static_cast<std::uint32_t>(c - '0');
+    return static_cast<EntryMode>(m);
+}
 
-    if (oid_begin + oid_length >= payload_.size()) {
+bool EntryParser::next(EntryView& out) {
+    if(!ok_) return false; // sticky
+    if(pos_ >= payload_.size()) return false; // passed the limit
+
+    std::size_t next = 0;
+    if (const char* err = parse_entry(payload_, pos_, algo_, out, next)) {
         ok_ = false;
-        err_ = "Corrupted Oid";
+        err_ = err;
         return false;
     }
-    
-    const unsigned char* ptr_ = reinterpret_cast<const unsigned char*>(payload_.data() + oid_begin);
-    std::copy(ptr_, ptr_ + oid_length, out.oid.bytes);
-    pos_ = oid_begin + oid_length;
+    pos_ = next;
+    return true;
+}
+
+bool EntryParser::next(Entry& out) {
+    EntryView v;
+    if (!next(v)) return false;
+    out.mode.assign(v.raw_mode);
+    out.name.assign(v.name);
+    out.oid = v.oid();
     return true;
 }
 
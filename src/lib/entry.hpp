@@ -1,31 +1,127 @@
+#pragma once
+
 #include "object_store.hpp"
-#include <openssl/sha.h>
+#include <cstdint>
+#include <iterator>
 #include <string>
 #include <string_view>
 #include <vector>
 
+// Tree entry modes, numerically as Git stores them (octal)
+enum class EntryMode : std::uint32_t {
+    Tree = 0040000,
+    Blob = 0100644,
+    Executable = 0100755,
+    Symlink = 0120000,
+    Gitlink = 0160000, // submodule commit
+};
+
+// Object type an entry with `mode` points to: "tree", "blob", "commit" or
+// "unknown". Decided by the file-type bits, so legacy modes such as 100664
+// still count as blobs.
+std::string_view entry_type_name(EntryMode mode);
+
+// Six-digit octal spelling, as ls-tree prints it ("040000", "100644"). Trees
+// store directories as "40000"; EntryView::raw_mode keeps that spelling.
+struct ModeString {
+    char chars[6];
+    std::string_view view() const { return {chars, sizeof(chars)}; }
+};
+ModeString mode_string(EntryMode mode);
+
+// One tree entry, pointing into the tree's payload: nothing is copied, so
+// the payload has to outlive the view.
+struct EntryView {
+    EntryMode mode{};
+    std::string_view raw_mode;
+    std::string_view name;
+    const unsigned char* oid_bytes = nullptr; // hash_len(algo) raw bytes
+    HashAlgo algo = HashAlgo::Sha1;
+
+    bool is_tree() const { return mode == EntryMode::Tree; }
+    Oid oid() const { return Oid::from_raw(oid_bytes, algo); }
+    std::string_view type() const { return entry_type_name(mode); }
+};
+
+// Forward range over the entries of a tree payload (the bytes after
+// "tree <size>\0"), parsed on the fly without allocating:
+//
+//   for (const EntryView& e : TreeView(payload, algo)) ...
+//
+// Corrupt entries throw std::runtime_error when the iterator reaches them.
+class TreeView {
+public:
+    class iterator {
+    public:
+        using iterator_category = std::forward_iterator_tag;
+        using value_type = EntryView;
+        using difference_type = std::ptrdiff_t;
+        using pointer = const EntryView*;
+        using reference = const EntryView&;
+
+        iterator() = default;
+
+        reference operator*() const { return entry_; }
+        pointer operator->() const { return &entry_; }
+
+        iterator& operator++() {
+            parse();
+            return *this;
+        }
+        iterator operator++(int) {
+            iterator old = *this;
+            parse();
+            return old;
+        }
+
+        // Iterators are equal when they are at the same payload position
+        bool operator==(const iterator& o) const { return pos_ == o.pos_; }
+
+    private:
+        friend class TreeView;
+        iterator(std::string_view payload, HashAlgo algo, std::size_t pos)
+            : payload_(payload), algo_(algo), pos_(pos) {}
+
+        // Parses the entry at next_ into entry_, or moves to the end
+        void parse();
+
+        std::string_view payload_;
+        HashAlgo algo_ = HashAlgo::Sha1;
+        std::size_t pos_ = 0;  // start of entry_; payload_.size() at the end
+        std::size_t next_ = 0; // start of the entry after it
+        EntryView entry_;
+    };
+
+    TreeView(std::string_view payload, HashAlgo algo) : payload_(payload), algo_(algo) {}
+
+    iterator begin() const;
+    iterator end() const { return iterator(payload_, algo_, payload_.size()); }
+
+private:
+    std::string_view payload_;
+    HashAlgo algo_;
+};
+
+// Owning copy of an entry, for callers that keep entries past the payload.
 struct Entry {
     std::string mode;
     std::string name;
     Oid oid;
 
-   std::string get_type() const {
-        if (mode == "040000") return "tree";       // directory
-        if (mode == "100644" || mode == "100755") return "blob"; // file
-        if (mode == "120000") return "blob";       // symlink (still stored as blob)
-        if (mode == "160000") return "commit";     // submodule
-
-        return "unknown"; // fallback for unexpected modes
-    }
+    std::string get_type() const { return std::string(entry_type_name(parse_mode())); }
+    EntryMode parse_mode() const;
 };
 
 class EntryParser {
 public:
-    // payload = bytes after "tree <size>\0"
-    explicit EntryParser(std::string_view payload) : payload_(payload) {}
+    // payload = bytes after "tree <size>\0"; entry OIDs are hash_len(algo)
+    // bytes wide
+    explicit EntryParser(std::string_view payload, HashAlgo algo)
+        : payload_(payload), algo_(algo) {}
 
     // Returns true and fills `out` if an entry was parsed; false = no more.
-    // On corruption, return false and set an error flag (or throw—your call).
+    // On corruption, returns false and sets the error flag.
+    bool next(EntryView& out);
     bool next(Entry& out);
 
     // Convenience: parse all remaining entries.
@@ -37,8 +133,8 @@ public:
 
 private:
     std::string_view payload_;
+    HashAlgo algo_;
     std::size_t pos_ = 0;
     bool ok_ = true;
     std::string_view err_{};
 };
-
@@ -0,0 +1,116 @@
+#include "ewah.hpp"
+
+#include "byte_order.hpp"
+
+#include <algorithm>
+#include <stdexcept>
+
+static constexpr std::uint64_t kMaxRun = 0xFFFFFFFF;   // 32-bit run length
+static constexpr std::uint64_t kMaxLiterals = 0x7FFFFFFF; // 31-bit literal count
+
+// ------------------------------------------------------------------- Bitmap
+
+void Bitmap::set(std::size_t pos) {
+    if (pos / 64 >= words_.size()) words_.resize(pos / 64 + 1);
+    words_[pos / 64] |= std::uint64_t{1} << (pos % 64);
+}
+
+Bitmap& Bitmap::operator|=(const Bitmap& o) {
+    if (o.words_.size() > words_.size()) words_.resize(o.words_.size());
+    for (std::size_t i = 0; i < o.words_.size(); ++i) words_[i] |= o.words_[i];
+    return *this;
+}
+
+Bitmap& Bitmap::operator&=(const Bitmap& o) {
+    if (words_.size() > o.words_.size()) words_.resize(o.words_.size());
+    for (std::size_t i = 0; i < words_.size(); ++i) words_[i] &= o.words_[i];
+    return *this;
+}
+
+Bitmap& Bitmap::operator^=(const Bitmap& o) {
+    if (o.words_.size() > words_.size()) words_.resize(o.words_.size());
+    for (std::size_t i = 0; i < o.words_.size(); ++i) words_[i] ^= o.words_[i];
+    return *this;
+}
+
+Bitmap& Bitmap::and_not(const Bitmap& o) {
+    const std::size_t n = std::min(words_.size(), o.words_.size());
+    for (std::size_t i = 0; i < n; ++i) words_[i] &= ~o.words_[i];
+    return *this;
+}
+
+std::size_t Bitmap::count() const {
+    std::size_t n = 0;
+    for (std::uint64_t w : words_) n += static_cast<std::size_t>(std::popcount(w));
+    return n;
+}
+
+std::size_t Bitmap::count_and(const Bitmap& mask) const {
+    const std::size_t n = std::min(words_.size(), mask.words_.size());
+    std::size_t total = 0;
+    for (std::size_t i = 0; i < n; ++i) total += static_cast<std::size_t>(std::popcount(words_[i] & mask.words_[i]));
+    return total;
+}
+
+// --------------------------------------------------------------------- EWAH
+
+std::string ewah_encode(const Bitmap& bitmap) {
+    const std::vector<std::uint64_t>& words = bitmap.words();
+    std::size_t n = words.size();
+    while (n > 0 && words[n - 1] == 0) --n;
+
+    std::vector<std::uint64_t> buffer;
+    std::size_t marker = 0;
+    std::size_t i = 0;
+    do {
+        std::uint64_t run = 0;
+        const bool run_bit = i < n && words[i] == ~std::uint64_t{0};
+        const std::uint64_t clean = run_bit ? ~std::uint64_t{0} : 0;
+        while (i < n && words[i] == clean && run < kMaxRun) {
+            ++run;
+            ++i;
+        }
+        const std::size_t first_literal = i;
+        while (i < n && words[i] != 0 && words[i] != ~std::uint64_t{0} &&
+               i - first_literal < kMaxLiterals) {
+            ++i;
+        }
+        marker = buffer.size();
+        buffer.push_back((run_bit ? 1 : 0) | (run << 1) | (std::uint64_t(i - first_literal) << 33));
+        buffer.insert(buffer.end(), words.begin() + first_literal, words.begin() + i);
+    } while (i < n);
+
+    std::string out;
+    out.reserve(12 + buffer.size() * 8);
+    put_be32(out, static_cast<std::uint32_t>(n * 64));
+    put_be32(out, static_cast<std::uint32_t>(buffer.size()));
+    for (std::uint64_t w : buffer) put_be64(out, w);
+    put_be32(out, static_cast<std::uint32_t>(marker));
+    return out;
+}
+
+Bitmap ewah_decode(const unsigned char* data, std::size_t size, std::size_t& consumed) {
+    if (size < 12) throw std::runtime_error("truncated EWAH bitmap");
+    const std::size_t count = read_be32(data + 4);
+    if ((size - 12) / 8 < count) throw std::runtime_error("truncated EWAH bitmap");
+    consumed = 12 + count * 8;
+
+    // The bit count bounds the decoded size, so a corrupt run length cannot
+    // make this allocate gigabytes
+    const std::size_t max_words = (std::size_t(read_be32(data)) + 63) / 64;
+    std::vector<std::uint64_t> words;
+    words.reserve(max_words);
+    const unsigned char* p = data + 8;
+    for (std::size_t i = 0; i < count;) {
+        const std::uint64_t marker = read_be64(p + i * 8);
+        ++i;
+        const std::uint64_t run = (marker >> 1) & kMaxRun;
+        const std::uint64_t literals = marker >> 33;
+        if (literals > count - i || words.size() + run + literals > max_words) {
+            throw std::runtime_error("corrupt EWAH bitmap");
+        }
+        words.insert(words.end(), run, (marker & 1) ? ~std::uint64_t{0} : 0);
+        for (std::uint64_t k = 0; k < literals; ++k, ++i) words.push_back(read_be64(p + i * 8));
+    }
+    return Bitmap(std::move(words));
+}
@@ -0,0 +1,60 @@
+#pragma once
+
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Uncompressed bitset over object positions; grows on set(). Set operations
+// treat missing words as zero, so bitmaps of different lengths combine.
+class Bitmap {
+public:
+    Bitmap() = default;
+    explicit Bitmap(std::vector<std::uint64_t> words) : words_(std::move(words)) {}
+
+    void set(std::size_t pos);
+    bool test(std::size_t pos) const {
+        return pos / 64 < words_.size() && (words_[pos / 64] >> (pos % 64)) & 1;
+    }
+
+    Bitmap& operator|=(const Bitmap& o);
+    Bitmap& operator&=(const Bitmap& o);
+    Bitmap& operator^=(const Bitmap& o);
+    // Clears every bit that is set in `o`
+    Bitmap& and_not(const Bitmap& o);
+
+    std::size_t count() const;
+    // Set bits that are also set in `mask`
+    std::size_t count_and(const Bitmap& mask) const;
+
+    // Calls f(pos) for every set bit, in ascending order
+    template <class F>
+    void for_each(F&& f) const {
+        for (std::size_t w = 0; w < words_.size(); ++w) {
+            for (std::uint64_t word = words_[w]; word; word &= word - 1) {
+                f(w * 64 + static_cast<std::size_t>(std::countr_zero(word)));
+            }
+        }
+    }
+
+    const std::vector<std::uint64_t>& words() const { return words_; }
+
+private:
+    std::vector<std::uint64_t> words_;
+};
+
+// EWAH ("Enhanced Word-Aligned Hybrid") encoding as Git stores it in
+// .bitmap files:
+//   bit count (32) | word count (32) | words (64 each) | position of the
+//   last marker word (32), all big-endian
+// The words are a sequence of marker words, each followed by its literal
+// words. A marker holds a run of identical all-0 or all-1 words (bit 0:
+// the run bit, bits 1-32: run length) and the number of literal words that
+// follow it (bits 33-63). Long runs of clean words, typical of reachability
+// bitmaps, shrink to a single word.
+std::string ewah_encode(const Bitmap& bitmap);
+
+// Decodes the EWAH bitmap at `data`; `consumed` is set to its encoded size.
+// Throws std::runtime_error when it is truncated or inconsistent.
+Bitmap ewah_decode(const unsigned char* data, std::size_t size, std::size_t& consumed);
@@ -0,0 +1,21 @@
+#pragma once
+
+#include <cstddef>
+#include <filesystem>
+#include <string_view>
+
+namespace fs = std::filesystem;
+
+// Writes all `len` bytes to `fd`, retrying short writes and EINTR.
+// Throws std::runtime_error on failure.
+void write_all(int fd, const void* data, std::size_t len);
+
+// fsync() of a directory, so a rename into it survives a crash. Best
+// effort: errors are ignored.
+void fsync_dir(const fs::path& dir);
+
+// Replaces `file` with `data`: written to a unique temp file beside it,
+// made read-only, fsync'ed and renamed over the old one. Readers that have
+// the old file mapped keep their copy, and no reader sees a partial or
+// unsynced file. The parent directory must exist.
+void replace_file(const fs::path& file, std::string_view data);
@@ -0,0 +1,432 @@
+#include "hash.hpp"
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <openssl/evp.h>
+#include <stdexcept>
+#include <string>
+#include <utility>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define COMMITLOG_X86 1
+#include <cpuid.h>
+#include <immintrin.h>
+#endif
+
+static constexpr std::uint32_t kIv[5] = {0x67452301u, 0xefcdab89u, 0x98badcfeu, 0x10325476u,
+                                         0xc3d2e1f0u};
+
+static inline std::uint32_t rol(std::uint32_t x, int n) { return (x << n) | (x >> (32 - n)); }
+
+static inline std::uint32_t load_be32(const unsigned char* p) {
+    return (std::uint32_t(p[0]) << 24) | (std::uint32_t(p[1]) << 16) |
+           (std::uint32_t(p[2]) << 8) | std::uint32_t(p[3]);
+}
+
+static inline void store_be32(unsigned char* p, std::uint32_t v) {
+    p[0] = static_cast<unsigned char>(v >> 24);
+    p[1] = static_cast<unsigned char>(v >> 16);
+    p[2] = static_cast<unsigned char>(v >> 8);
+    p[3] = static_cast<unsigned char>(v);
+}
+
+// ------------------------------- generic ---------------------------------
+
+static void blocks_generic(std::uint32_t* st, const unsigned char* p, std::size_t n) {
+    for (; n; --n, p += 64) {
+        std::uint32_t w[80];
+        for (int i = 0; i < 16; ++i) w[i] = load_be32(p + 4 * i);
+        for (int i = 16; i < 80; ++i) w[i] = rol(w[i - 3] ^ w[i - 8] ^ w[i - 14] ^ w[i - 16], 1);
+
+        std::uint32_t a = st[0], b = st[1], c = st[2], d = st[3], e = st[4];
+        auto round = [&](std::uint32_t f, std::uint32_t k, std::uint32_t wi) {
+            const std::uint32_t t = rol(a, 5) + f + e + k + wi;
+            e = d;
+            d = c;
+            c = rol(b, 30);
+            b = a;
+            a = t;
+        };
+        for (int i = 0; i < 20; ++i) round((b & c) | (~b & d), 0x5a827999u, w[i]);
+        for (int i = 20; i < 40; ++i) round(b ^ c ^ d, 0x6ed9eba1u, w[i]);
+        for (int i = 40; i < 60; ++i) round((b & c) | (b & d) | (c & d), 0x8f1bbcdcu, w[i]);
+        for (int i = 60; i < 80; ++i) round(b ^ c ^ d, 0xca62c1d6u, w[i]);
+        st[0] += a; st[1] += b; st[2] += c; st[3] += d; st[4] += e;
+    }
+}
+
+#ifdef COMMITLOG_X86
+
+// -------------------------------- SHA-NI ---------------------------------
+
+#define SHANI_TARGET __attribute__((target("sha,sse4.1,ssse3")))
+
+// Four rounds per step; G selects the message word group (0..19). The
+// message schedule runs three groups ahead through msg1/xor/msg2.
+template <int G>
+SHANI_TARGET static inline void shani_step(__m128i& abcd, __m128i (&e)[2], __m128i (&msg)[4],
+                                           const unsigned char* p, __m128i mask) {
+    __m128i& m = msg[G % 4];
+    __m128i& ea = e[G % 2];
+    __m128i& eb = e[(G + 1) % 2];
+
+    if constexpr (G < 4) {
+        m = _mm_shuffle_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(p + 16 * G)), mask);
+    }
+    if constexpr (G == 0) ea = _mm_add_epi32(ea, m);
+    else                  ea = _mm_sha1nexte_epu32(ea, m);
+    eb = abcd;
+    if constexpr (G >= 3 && G <= 18) msg[(G + 1) % 4] = _mm_sha1msg2_epu32(msg[(G + 1) % 4], m);
+    abcd = _mm_sha1rnds4_epu32(abcd, ea, G / 5);
+    if constexpr (G >= 1 && G <= 16) msg[(G + 3) % 4] = _mm_sha1msg1_epu32(msg[(G + 3) % 4], m);
+    if constexpr (G >= 2 && G <= 17) msg[(G + 2) % 4] = _mm_xor_si128(msg[(G + 2) % 4], m);
+}
+
+template <int... G>
+SHANI_TARGET static inline void shani_rounds(__m128i& abcd, __m128i (&e)[2], __m128i (&msg)[4],
+                                             const unsigned char* p, __m128i mask,
+                                             std::integer_sequence<int, G...>) {
+    (shani_step<G>(abcd, e, msg, p, mask), ...);
+}
+
+SHANI_TARGET static void blocks_shani(std::uint32_t* st, const unsigned char* p, std::size_t n) {
+    const __m128i mask = _mm_set_epi64x(0x0001020304050607ULL, 0x08090a0b0c0d0e0fULL);
+    __m128i abcd = _mm_shuffle_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(st)), 0x1b);
+    __m128i e0 = _mm_set_epi32(static_cast<int>(st[4]), 0, 0, 0);
+
+    for (; n; --n, p += 64) {
+        const __m128i abcd_save = abcd;
+        const __m128i e0_save = e0;
+        __m128i e[2] = {e0, _mm_setzero_si128()};
+        __m128i msg[4];
+        shani_rounds(abcd, e, msg, p, mask, std::make_integer_sequence<int, 20>{});
+        e0 = _mm_sha1nexte_epu32(e[0], e0_save);
+        abcd = _mm_add_epi32(abcd, abcd_save);
+    }
+
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(st), _mm_shuffle_epi32(abcd, 0x1b));
+    st[4] = static_cast<std::uint32_t>(_mm_extract_epi32(e0, 3));
+}
+
+// --------------------------- AVX2, eight lanes ---------------------------
+
+#define AVX2_TARGET __attribute__((target("avx2")))
+
+AVX2_TARGET static inline __m256i rol8(__m256i x, int n) {
+    return _mm256_or_si256(_mm256_slli_epi32(x, n), _mm256_srli_epi32(x, 32 - n));
+}
+
+// 8x8 transpose of 32-bit words: row j (lane j's words) -> row i (word i of
+// every lane).
+AVX2_TARGET static inline void transpose8(__m256i (&r)[8]) {
+    const __m256i t0 = _mm256_unpacklo_epi32(r[0], r[1]), t1 = _mm256_unpackhi_epi32(r[0], r[1]);
+    const __m256i t2 = _mm256_unpacklo_epi32(r[2], r[3]), t3 = _mm256_unpackhi_epi32(r[2], r[3]);
+    const __m256i t4 = _mm256_unpacklo_epi32(r[4], r[5]), t5 = _mm256_unpackhi_epi32(r[4], r[5]);
+    const __m256i t6 = _mm256_unpacklo_epi32(r[6], r[7]), t7 = _mm256_unpackhi_epi32(r[6], r[7]);
+    const __m256i u0 = _mm256_unpacklo_epi64(t0, t2), u1 = _mm256_unpackhi_epi64(t0, t2);
+    const __m256i u2 = _mm256_unpacklo_epi64(t1, t3), u3 = _mm256_unpackhi_epi64(t1, t3);
+    const __m256i u4 = _mm256_unpacklo_epi64(t4, t6), u5 = _mm256_unpackhi_epi64(t4, t6);
+    const __m256i u6 = _mm256_unpacklo_epi64(t5, t7), u7 = _mm256_unpackhi_epi64(t5, t7);
+    r[0] = _mm256_permute2x128_si256(u0, u4, 0x20);
+    r[1] = _mm256_permute2x128_si256(u1, u5, 0x20);
+    r[2] = _mm256_permute2x128_si256(u2, u6, 0x20);
+    r[3] = _mm256_permute2x128_si256(u3, u7, 0x20);
+    r[4] = _mm256_permute2x128_si256(u0, u4, 0x31);
+    r[5] = _mm256_permute2x128_si256(u1, u5, 0x31);
+    r[6] = _mm256_permute2x128_si256(u2, u6, 0x31);
+    r[7] = _mm256_permute2x128_si256(u3, u7, 0x31);
+}
+
+// One 64-byte block from each of eight independent messages.
+// st[k][lane] holds state word k of that lane.
+AVX2_TARGET static void compress_x8(std::uint32_t (&st)[5][8], const unsigned char* const (&blk)[8]) {
+    const __m256i bswap = _mm256_set_epi8(12, 13, 14, 15, 8, 9, 10, 11, 4, 5, 6, 7, 0, 1, 2, 3,
+                                          12, 13, 14, 15, 8, 9, 10, 11, 4, 5, 6, 7, 0, 1, 2, 3);
+    __m256i w[16];
+    for (int half = 0; half < 2; ++half) {
+        __m256i rows[8];
+        for (int l = 0; l < 8; ++l) {
+            rows[l] = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(blk[l] + 32 * half));
+        }
+        transpose8(rows);
+        for (int i = 0; i < 8; ++i) w[8 * half + i] = _mm256_shuffle_epi8(rows[i], bswap);
+    }
+
+    __m256i a = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(st[0]));
+    __m256i b = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(st[1]));
+    __m256i c = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(st[2]));
+    __m256i d = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(st[3]));
+    __m256i e = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(st[4]));
+    const __m256i a0 = a, b0 = b, c0 = c, d0 = d, e0 = e;
+
+    auto round = [&](int i, __m256i f, __m256i k) AVX2_TARGET {
+        if (i >= 16) {
+            w[i & 15] = rol8(_mm256_xor_si256(_mm256_xor_si256(w[(i - 3) & 15], w[(i - 8) & 15]),
+                                              _mm256_xor_si256(w[(i - 14) & 15], w[i & 15])), 1);
+        }
+        const __m256i t = _mm256_add_epi32(_mm256_add_epi32(rol8(a, 5), f),
+                                           _mm256_add_epi32(_mm256_add_epi32(e, k), w[i & 15]));
+        e = d;
+        d = c;
+        c = rol8(b, 30);
+        b = a;
+        a = t;
+    };
+
+    const __m256i k0 = _mm256_set1_epi32(0x5a827999), k1 = _mm256_set1_epi32(0x6ed9eba1);
+    const __m256i k2 = _mm256_set1_epi32(static_cast<int>(0x8f1bbcdcu));
+    const __m256i k3 = _mm256_set1_epi32(static_cast<int>(0xca62c1d6u));
+    for (int i = 0; i < 20; ++i) round(i, _mm256_or_si256(_mm256_and_si256(b, c), _mm256_andnot_si256(b, d)), k0);
+    for (int i = 20; i < 40; ++i) round(i, _mm256_xor_si256(_mm256_xor_si256(b, c), d), k1);
+    for (int i = 40; i < 60; ++i) {
+        round(i, _mm256_or_si256(_mm256_and_si256(b, c), _mm256_and_si256(d, _mm256_or_si256(b, c))), k2);
+    }
+    for (int i = 60; i < 80; ++i) round(i, _mm256_xor_si256(_mm256_xor_si256(b, c), d), k3);
+
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(st[0]), _mm256_add_epi32(a, a0));
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(st[1]), _mm256_add_epi32(b, b0));
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(st[2]), _mm256_add_epi32(c, c0));
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(st[3]), _mm256_add_epi32(d, d0));
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(st[4]), _mm256_add_epi32(e, e0));
+}
+
+namespace {
+
+// One message being fed through a lane: its full blocks straight from the
+// input, then one or two padded tail blocks.
+struct Lane {
+    const unsigned char* data = nullptr;
+    std::size_t full_blocks = 0;
+    std::size_t next = 0;
+    std::size_t tail_blocks = 0;
+    std::size_t msg = 0;
+    bool active = false;
+    unsigned char tail[128];
+
+    void start(std::string_view m, std::size_t index) {
+        data = reinterpret_cast<const unsigned char*>(m.data());
+        full_blocks = m.size() / 64;
+        next = 0;
+        msg = index;
+        active = true;
+
+        const std::size_t rem = m.size() % 64;
+        std::memset(tail, 0, sizeof(tail));
+        std::memcpy(tail, data + full_blocks * 64, rem);
+        tail[rem] = 0x80;
+        tail_blocks = rem < 56 ? 1 : 2;
+        const std::uint64_t bits = std::uint64_t(m.size()) * 8;
+        store_be32(tail + 64 * tail_blocks - 8, static_cast<std::uint32_t>(bits >> 32));
+        store_be32(tail + 64 * tail_blocks - 4, static_cast<std::uint32_t>(bits));
+    }
+
+    const unsigned char* block() const {
+        return next < full_blocks ? data + 64 * next : tail + 64 * (next - full_blocks);
+    }
+    bool done() const { return next == full_blocks + tail_blocks; }
+};
+
+} // namespace
+
+static void many_avx2(const std::string_view* inputs, std::size_t n, unsigned char (*out)[kSha1Len]) {
+    static const unsigned char idle[64] = {};
+    std::uint32_t st[5][8];
+    Lane lanes[8];
+    std::size_t next_msg = 0;
+    std::size_t active = 0;
+
+    auto assign = [&](int l) {
+        if (next_msg >= n) {
+            lanes[l].active = false;
+            return;
+        }
+        lanes[l].start(inputs[next_msg], next_msg);
+        ++next_msg;
+        ++active;
+        for (int k = 0; k < 5; ++k) st[k][l] = kIv[k];
+    };
+    for (int l = 0; l < 8; ++l) assign(l);
+
+    while (active > 0) {
+        const unsigned char* blk[8];
+        for (int l = 0; l < 8; ++l) blk[l] = lanes[l].active ? lanes[l].block() : idle;
+        compress_x8(st, blk);
+
+        for (int l = 0; l < 8; ++l) {
+            Lane& lane = lanes[l];
+            if (!lane.active) continue;
+            ++lane.next;
+            if (!lane.done()) continue;
+            for (int k = 0; k < 5; ++k) store_be32(out[lane.msg] + 4 * k, st[k][l]);
+            --active;
+            assign(l);
+        }
+    }
+}
+
+#endif // COMMITLOG_X86
+
+// ------------------------------- dispatch --------------------------------
+
+namespace {
+
+using BlockFn = void (*)(std::uint32_t*, const unsigned char*, std::size_t);
+using ManyFn = void (*)(const std::string_view*, std::size_t, unsigned char (*)[kSha1Len]);
+
+struct Backend {
+    BlockFn blocks = blocks_generic;
+    const char* name = "generic";
+    ManyFn many = nullptr; // nullptr: loop over `blocks`
+    const char* many_name = "generic";
+};
+
+Backend detect_backend() {
+    Backend b;
+#ifdef COMMITLOG_X86
+    __builtin_cpu_init();
+    unsigned eax = 0, ebx = 0, ecx = 0, edx = 0;
+    const bool sha = __get_cpuid_count(7, 0, &eax, &ebx, &ecx, &edx) && (ebx & (1u << 29));
+    const bool shani = sha && __builtin_cpu_supports("sse4.1") && __builtin_cpu_supports("ssse3");
+    const bool avx2 = __builtin_cpu_supports("avx2");
+
+    const char* env = std::getenv("COMMITLOG_SHA1_BACKEND");
+    const std::string want = env ? env : "";
+
+    if (want == "generic") return b;
+    if (shani && want != "avx2") {
+        b.blocks = blocks_shani;
+        b.name = b.many_name = "shani";
+    }
+    if (avx2 && want != "shani") {
+        b.many = many_avx2;
+        b.many_name = "avx2";
+    }
+#endif
+    return b;
+}
+
+const Backend& backend() {
+    static const Backend b = detect_backend();
+    return b;
+}
+
+} // namespace
+
+const char* sha1_backend_name() { return backend().name; }
+const char* sha1_many_backend_name() { return backend().many_name; }
+
+// --------------------------------- Sha1 ----------------------------------
+
+Sha1::Sha1() {
+    std::memcpy(state_, kIv, sizeof(state_));
+}
+
+void Sha1::update(const void* data, std::size_t len) {
+    const auto* p = static_cast<const unsigned char*>(data);
+    const BlockFn blocks = backend().blocks;
+    total_ += len;
+
+    if (buf_len_ > 0) {
+        const std::size_t take = std::min(len, sizeof(buf_) - buf_len_);
+        std::memcpy(buf_ + buf_len_, p, take);
+        buf_len_ += take;
+        p += take;
+        len -= take;
+        if (buf_len_ < sizeof(buf_)) return;
+        blocks(state_, buf_, 1);
+        buf_len_ = 0;
+    }
+
+    if (len >= 64) {
+        blocks(state_, p, len / 64);
+        p += len / 64 * 64;
+        len %= 64;
+    }
+    std::memcpy(buf_, p, len);
+    buf_len_ = len;
+}
+
+void Sha1::finish(unsigned char* out) {
+    const std::uint64_t bits = total_ * 8;
+    unsigned char pad[72] = {0x80};
+    const std::size_t pad_len = (buf_len_ < 56 ? 56 : 120) - buf_len_;
+    update(pad, pad_len);
+
+    unsigned char len_be[8];
+    store_be32(len_be, static_cast<std::uint32_t>(bits >> 32));
+    store_be32(len_be + 4, static_cast<std::uint32_t>(bits));
+    update(len_be, sizeof(len_be));
+
+    for (int i = 0; i < 5; ++i) store_be32(out + 4 * i, state_[i]);
+}
+
+void Sha1::digest(const void* data, std::size_t len, unsigned char* out) {
+    Sha1 h;
+    h.update(data, len);
+    h.finish(out);
+}
+
+void sha1_many(const std::string_view* inputs, std::size_t n, unsigned char (*out)[kSha1Len]) {
+    // Lanes only pay off when there are enough messages to fill them
+    if (const ManyFn many = backend().many; many && n >= 4) {
+        many(inputs, n, out);
+        return;
+    }
+    for (std::size_t i = 0; i < n; ++i) {
+        Sha1::digest(inputs[i].data(), inputs[i].size(), out[i]);
+    }
+}
+
+// -------------------------------- SHA-256 --------------------------------
+
+Sha256::Sha256() : ctx_(EVP_MD_CTX_new()) {
+    if (!ctx_ || EVP_DigestInit_ex(ctx_, EVP_sha256(), nullptr) != 1) {
+        EVP_MD_CTX_free(ctx_);
+        throw std::runtime_error("SHA-256 init failed");
+    }
+}
+
+Sha256::~Sha256() { EVP_MD_CTX_free(ctx_); }
+
+void Sha256::update(const void* data, std::size_t len) { EVP_DigestUpdate(ctx_, data, len); }
+
+void Sha256::finish(unsigned char* out) {
+    unsigned int len = 0;
+    EVP_DigestFinal_ex(ctx_, out, &len);
+}
+
+void Sha256::digest(const void* data, std::size_t len, unsigned char* out) {
+    unsigned int n = 0;
+    EVP_Digest(data, len, out, &n, EVP_sha256(), nullptr);
+}
+
+// -------------------------------- Hasher ---------------------------------
+
+const char* hash_name(HashAlgo algo) { return algo == HashAlgo::Sha256 ? "sha256" : "sha1"; }
+
+std::optional<HashAlgo> hash_algo_from_name(std::string_view name) {
+    if (name == "sha1") return HashAlgo::Sha1;
+    if (name == "sha256") return HashAlgo::Sha256;
+    return std::nullopt;
+}
+
+static std::variant<Sha1, Sha256> make_impl(HashAlgo algo) {
+    if (algo == HashAlgo::Sha256) return std::variant<Sha1, Sha256>(std::in_place_type<Sha256>);
+    return std::variant<Sha1, Sha256>(std::in_place_type<Sha1>);
+}
+
+Hasher::Hasher(HashAlgo algo) : algo_(algo), impl_(make_impl(algo)) {}
+
+void Hasher::update(const void* data, std::size_t len) {
+    std::visit([&](auto& h) { h.update(data, len); }, impl_);
+}
+
+void Hasher::finish(unsigned char* out) {
+    std::visit([&](auto& h) { h.finish(out); }, impl_);
+}
+
+void Hasher::digest(HashAlgo algo, const void* data, std::size_t len, unsigned char* out) {
+    if (algo == HashAlgo::Sha256) Sha256::digest(data, len, out);
+    else Sha1::digest(data, len, out);
+}
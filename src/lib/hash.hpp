@@ -0,0 +1,110 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <string_view>
+#include <variant>
+
+// SHA-1 engine with backends picked once at startup from CPU features:
+//   "shani"   x86 SHA extensions, one message at a time
+//   "avx2"    eight messages side by side in 32-bit SIMD lanes (sha1_many)
+//   "generic" portable C++
+// COMMITLOG_SHA1_BACKEND=generic|shani|avx2 overrides the choice (unsupported
+// values fall back to the detected default).
+
+static constexpr std::size_t kSha1Len = 20;
+static constexpr std::size_t kSha256Len = 32;
+static constexpr std::size_t kMaxHashLen = kSha256Len;
+
+// Object ID hash of a repository (extensions.objectFormat).
+enum class HashAlgo : std::uint8_t { Sha1, Sha256 };
+
+// Compile-time digest width, for code that is instantiated per format so
+// that comparisons run on a constant length.
+template <HashAlgo A> struct HashTraits;
+template <> struct HashTraits<HashAlgo::Sha1> { static constexpr std::size_t kLen = kSha1Len; };
+template <> struct HashTraits<HashAlgo::Sha256> { static constexpr std::size_t kLen = kSha256Len; };
+
+constexpr std::size_t hash_len(HashAlgo algo) {
+    return algo == HashAlgo::Sha256 ? kSha256Len : kSha1Len;
+}
+
+// Git's "hash version" byte in chunk-file headers (commit-graph,
+// multi-pack-index): 1 for SHA-1, 2 for SHA-256
+constexpr std::uint8_t hash_version(HashAlgo algo) {
+    return algo == HashAlgo::Sha256 ? 2 : 1;
+}
+
+// "sha1" | "sha256"
+const char* hash_name(HashAlgo algo);
+std::optional<HashAlgo> hash_algo_from_name(std::string_view name);
+
+// Incremental SHA-1.
+class Sha1 {
+public:
+    Sha1();
+
+    void update(const void* data, std::size_t len);
+    void update(std::string_view s) { update(s.data(), s.size()); }
+
+    // Writes the 20-byte digest. The object must not be updated afterwards.
+    void finish(unsigned char* out);
+
+    static void digest(const void* data, std::size_t len, unsigned char* out);
+
+private:
+    std::uint32_t state_[5];
+    unsigned char buf_[64];
+    std::size_t buf_len_ = 0;
+    std::uint64_t total_ = 0;
+};
+
+// Incremental SHA-256 (OpenSSL; it uses the SHA extensions where present).
+class Sha256 {
+public:
+    Sha256();
+    ~Sha256();
+
+    Sha256(const Sha256&) = delete;
+    Sha256& operator=(const Sha256&) = delete;
+
+    void update(const void* data, std::size_t len);
+    void update(std::string_view s) { update(s.data(), s.size()); }
+
+    // Writes the 32-byte digest.
+    void finish(unsigned char* out);
+
+    static void digest(const void* data, std::size_t len, unsigned char* out);
+
+private:
+    struct evp_md_ctx_st* ctx_;
+};
+
+// Either of the above, chosen at construction; finish() writes
+// hash_len(algo()) bytes.
+class Hasher {
+public:
+    explicit Hasher(HashAlgo algo);
+
+    void update(const void* data, std::size_t len);
+    void update(std::string_view s) { update(s.data(), s.size()); }
+    void finish(unsigned char* out);
+
+    HashAlgo algo() const { return algo_; }
+
+    static void digest(HashAlgo algo, const void* data, std::size_t len, unsigned char* out);
+
+private:
+    HashAlgo algo_;
+    std::variant<Sha1, Sha256> impl_;
+};
+
+// Hashes `n` independent messages; out[i] receives the digest of inputs[i].
+// Small messages are where this pays off: the AVX2 backend runs eight of
+// them through the compression function at once.
+void sha1_many(const std::string_view* inputs, std::size_t n, unsigned char (*out)[kSha1Len]);
+
+// Names of the backends in use, e.g. "shani" / "avx2".
+const char* sha1_backend_name();
+const char* sha1_many_backend_name();
@@ -0,0 +1,52 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+// Table-driven hex conversion for object IDs. Both directions work on
+// caller-provided buffers and never allocate.
+
+// kHexPairs[2 * b], kHexPairs[2 * b + 1]: lowercase spelling of byte b
+inline constexpr std::array<char, 512> kHexPairs = [] {
+    constexpr char digits[] = "0123456789abcdef";
+    std::array<char, 512> t{};
+    for (int b = 0; b < 256; ++b) {
+        t[2 * b] = digits[b >> 4];
+        t[2 * b + 1] = digits[b & 0xf];
+    }
+    return t;
+}();
+
+// Nibble value of a hex digit (either case), or -1
+inline constexpr std::array<std::int8_t, 256> kHexValues = [] {
+    std::array<std::int8_t, 256> t{};
+    for (int c = 0; c < 256; ++c) {
+        t[c] = c >= '0' && c <= '9'   ? static_cast<std::int8_t>(c - '0')
+               : c >= 'a' && c <= 'f' ? static_cast<std::int8_t>(c - 'a' + 10)
+               : c >= 'A' && c <= 'F' ? static_cast<std::int8_t>(c - 'A' + 10)
+                                      : std::int8_t{-1};
+    }
+    return t;
+}();
+
+// Writes 2 * n characters to `out` (not NUL-terminated).
+inline void hex_encode(const unsigned char* in, std::size_t n, char* out) {
+    for (std::size_t i = 0; i < n; ++i) {
+        std::memcpy(out + 2 * i, &kHexPairs[2 * std::size_t(in[i])], 2);
+    }
+}
+
+// Reads 2 * n hex digits into n bytes; false if any digit is invalid (the
+// contents of `out` are then unspecified).
+inline bool hex_decode(const char* in, std::size_t n, unsigned char* out) {
+    int bad = 0;
+    for (std::size_t i = 0; i < n; ++i) {
+        const int hi = kHexValues[static_cast<unsigned char>(in[2 * i])];
+        const int lo = kHexValues[static_cast<unsigned char>(in[2 * i + 1])];
+        bad |= hi | lo; // negative iff either digit was invalid
+        out[i] = static_cast<unsigned char>((hi << 4) | lo);
+    }
+    return bad >= 0;
+}
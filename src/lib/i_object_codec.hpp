@@ -1,14 +1,76 @@
 #pragma once
 
+#include <cstddef>
+#include <functional>
 #include <memory>
 #include <string>
 #include <string_view>
 
+// Incremental compressor for objects that are streamed from disk.
+class StreamEncoder {
+public:
+    virtual ~StreamEncoder() = default;
+
+    // Compresses `in` and passes finished output to `sink`, possibly in
+    // several pieces. `finish` ends the stream.
+    virtual void write(std::string_view in, bool finish,
+                       const std::function<void(std::string_view)>& sink) = 0;
+};
+
+// Incremental decompressor. Consumes input from the front of `in` and
+// returns the number of bytes written to `out`; `done` is set once the end
+// of the compressed stream has been reached.
+class StreamDecoder {
+public:
+    virtual ~StreamDecoder() = default;
+    virtual std::size_t decode(std::string_view& in, char* out, std::size_t out_len, bool& done) = 0;
+};
+
+// Compression levels use Git's scale: 0 stores without compressing, 1 is
+// fastest, 9 smallest; kDefaultLevel lets the codec pick. Codecs map this
+// onto their own range.
+inline constexpr int kDefaultLevel = -1;
+
+// On-disk compression of loose objects. Implementations are shared between
+// threads and must not keep per-call state in the codec object itself.
 class IObjectCodec {
 public:
     virtual ~IObjectCodec() = default;
-    virtual std::string compress(std::string_view uncompressed) = 0;
-    virtual std::string decompress(std::string_view compressed) = 0;
+
+    // "zlib" | "libdeflate" | "zstd"
+    virtual const char* name() const = 0;
+
+    // Output is a zlib stream, readable by upstream Git and valid in packs
+    virtual bool zlib_compatible() const = 0;
+
+    // True if `prefix`, the first bytes of a stored object, is in this
+    // codec's format. Used to read objects written under another codec.
+    virtual bool recognizes(std::string_view prefix) const = 0;
+
+    virtual std::string compress(std::string_view uncompressed, int level = kDefaultLevel) const = 0;
+
+    // `size_hint` is the exact decompressed size when the caller knows it,
+    // 0 otherwise.
+    virtual std::string decompress(std::string_view compressed, std::size_t size_hint = 0) const = 0;
+
+    virtual std::unique_ptr<StreamEncoder> encoder(int level = kDefaultLevel) const = 0;
+    virtual std::unique_ptr<StreamDecoder> decoder() const = 0;
 };
 
 std::unique_ptr<IObjectCodec> make_zlib_codec();
+
+// Codec by name, as set in core.objectCodec. Throws for unknown names and
+// for codecs that were not compiled into this build.
+std::unique_ptr<IObjectCodec> make_codec(std::string_view name);
+bool codec_available(std::string_view name);
+
+// Byte-entropy probe over the first few KiB of `data`: true when it looks
+// already compressed or encrypted (jpg, zip, tarballs, ...), so that
+// spending CPU on compressing it would not shrink it.
+bool looks_incompressible(std::string_view data);
+
+// Level to compress `data` with: 0 when it looks incompressible, else
+// `configured`.
+inline int level_for(std::string_view data, int configured) {
+    return configured != 0 && looks_incompressible(data) ? 0 : configured;
+}
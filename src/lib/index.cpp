@@ -1,26 +1,205 @@
 #include "index.hpp"
+#include "byte_order.hpp"
+#include "file_util.hpp"
+#include "hash.hpp"
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
 #include <filesystem>
 #include <fstream>
+#include <iterator>
+#include <memory>
+#include <sstream>
 #include <stdexcept>
 #include <string>
+#include <utility>
+#include <fcntl.h>
+#include <unistd.h>
 
-Index::Index(fs::path index_path) {
+static constexpr std::size_t kHeaderLen = 12;
+static constexpr std::size_t kEntryStatLen = 40; // 10 * u32, then oid + flags
+static constexpr std::uint16_t kNameMask = 0x0fff;
+static constexpr std::uint16_t kExtendedFlag = 0x4000;
+
+IndexStat IndexStat::from(const struct stat &st) {
+  IndexStat s;
+  s.ctime_sec = static_cast<std::uint32_t>(st.st_ctim.tv_sec);
+  s.ctime_nsec = static_cast<std::uint32_t>(st.st_ctim.tv_nsec);
+  s.mtime_sec = static_cast<std::uint32_t>(st.st_mtim.tv_sec);
+  s.mtime_nsec = static_cast<std::uint32_t>(st.st_mtim.tv_nsec);
+  s.dev = static_cast<std::uint32_t>(st.st_dev);
+  s.ino = static_cast<std::uint32_t>(st.st_ino);
+  s.uid = static_cast<std::uint32_t>(st.st_uid);
+  s.gid = static_cast<std::uint32_t>(st.st_gid);
+  s.size = static_cast<std::uint32_t>(st.st_size);
+  return s;
+}
+
+Index::Index(fs::path index_path, HashAlgo algo) : algo_(algo) {
   path_ = index_path;
 }
 
+Index::~Index() {
+  if (lock_fd_ < 0) return;
+  ::close(lock_fd_);
+  ::unlink((path_.string() + ".lock").c_str());
+}
+
 void Index::upsert(const IndexEntry& e) {
   by_path_[e.path] = e;
+  invalidate_path(e.path);
+}
+
+void Index::invalidate_path(const std::string &path) {
+  // Every directory from the root down to the entry's parent is now stale
+  CacheTree *node = &cache_tree_;
+  node->entry_count = -1;
+  std::size_t begin = 0;
+  for (std::size_t slash; (slash = path.find('/', begin)) != std::string::npos; begin = slash + 1) {
+    auto it = node->subtrees.find(path.substr(begin, slash - begin));
+    if (it == node->subtrees.end()) return;
+    node = it->second.get();
+    node->entry_count = -1;
+  }
+}
+
+// ------------------------------ cache-tree --------------------------------
+
+// "<name>\0<entry_count> <subtree_count>\n[<oid>]" then the subtrees
+static void read_cache_tree(CacheTree &node, const unsigned char *&p, const unsigned char *end,
+                            std::string &name, HashAlgo algo) {
+  auto field = [&](char stop) {
+    const auto *hit = static_cast<const unsigned char *>(std::memchr(p, stop, end - p));
+    if (!hit) throw std::runtime_error("corrupt cache-tree extension");
+    std::string out(reinterpret_cast<const char *>(p), hit - p);
+    p = hit + 1;
+    return out;
+  };
+
+  name = field('\0');
+  const int entry_count = std::stoi(field(' '));
+  const int subtree_count = std::stoi(field('\n'));
+  node.entry_count = entry_count;
+  if (entry_count >= 0) {
+    if (static_cast<std::size_t>(end - p) < hash_len(algo)) {
+      throw std::runtime_error("corrupt cache-tree extension");
+    }
+    node.oid = Oid::from_raw(p, algo);
+    p += hash_len(algo);
+  }
+  for (int i = 0; i < subtree_count; ++i) {
+    auto child = std::make_unique<CacheTree>();
+    std::string child_name;
+    read_cache_tree(*child, p, end, child_name, algo);
+    node.subtrees[child_name] = std::move(child);
+  }
+}
+
+static void write_cache_tree(const CacheTree &node, const std::string &name, std::string &out) {
+  out.append(name);
+  out.push_back('\0');
+  out.append(std::to_string(node.entry_count));
+  out.push_back(' ');
+  out.append(std::to_string(node.subtrees.size()));
+  out.push_back('\n');
+  if (node.entry_count >= 0) {
+    out.append(reinterpret_cast<const char *>(node.oid.bytes), node.oid.size());
+  }
+  for (const auto &[child_name, child] : node.subtrees) {
+    write_cache_tree(*child, child_name, out);
+  }
+}
+
+Oid Index::write_tree(ObjectStore &store) {
+  return build_tree(cache_tree_, "", by_path_.begin(), by_path_.end(), store);
+}
+
+Oid Index::build_tree(CacheTree &node, const std::string &prefix, EntryIter begin,
+                      EntryIter end, ObjectStore &store) {
+  if (node.entry_count >= 0) return node.oid;
+
+  // Index order is tree order: a directory "d" sorts like "d/", and all
+  // paths under "<prefix>d/" are contiguous in the map
+  std::string payload;
+  std::map<std::string, std::unique_ptr<CacheTree>> seen;
+  for (EntryIter it = begin; it != end;) {
+    const std::string_view rel = std::string_view(it->first).substr(prefix.size());
+    const std::size_t slash = rel.find('/');
+
+    if (slash == std::string_view::npos) {
+      payload.append(it->second.mode);
+      payload.push_back(' ');
+      payload.append(rel);
+      payload.push_back('\0');
+      payload.append(reinterpret_cast<const char *>(it->second.oid.bytes), it->second.oid.size());
+      ++it;
+      continue;
+    }
+
+    const std::string dir(rel.substr(0, slash));
+    const std::string child_prefix = prefix + dir + '/';
+    // '0' is the byte right after '/', so this is the first path past the dir
+    const EntryIter child_end = by_path_.lower_bound(prefix + dir + '0');
+
+    auto child = node.subtrees.count(dir) ? std::move(node.subtrees[dir])
+                                          : std::make_unique<CacheTree>();
+    const Oid child_oid = build_tree(*child, child_prefix, it, child_end, store);
+    seen[dir] = std::move(child);
+
+    payload.append("40000 ");
+    payload.append(dir);
+    payload.push_back('\0');
+    payload.append(reinterpret_cast<const char *>(child_oid.bytes), child_oid.size());
+    it = child_end;
+  }
+
+  const std::string object = "tree " + std::to_string(payload.size()) + '\0' + payload;
+  node.oid = store.put_object_if_absent(object).oid;
+  node.entry_count = static_cast<int>(std::distance(begin, end));
+  node.subtrees = std::move(seen); // drops directories that no longer exist
+  return node.oid;
+}
+
+const std::map<std::string, IndexEntry> &Index::entries() const {
+  return by_path_;
+}
+
+const IndexEntry *Index::find(const std::string &path) const {
+  auto it = by_path_.find(path);
+  return it == by_path_.end() ? nullptr : &it->second;
+}
+
+bool Index::is_racy(const IndexEntry &e) const {
+  if (timestamp_sec_ == 0) return true; // no index on disk yet
+  if (e.stat.mtime_sec != timestamp_sec_) return e.stat.mtime_sec > timestamp_sec_;
+  return e.stat.mtime_nsec >= timestamp_nsec_;
 }
 
 void Index::load() {
-  std::ifstream in(path_);
+  std::ifstream in(path_, std::ios::binary);
 
   if (!in) {
     return;
   }
 
+  struct stat st {};
+  if (::stat(path_.c_str(), &st) == 0) {
+    timestamp_sec_ = static_cast<std::uint32_t>(st.st_mtim.tv_sec);
+    timestamp_nsec_ = static_cast<std::uint32_t>(st.st_mtim.tv_nsec);
+  }
+
+  std::string data((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+  if (data.size() >= 4 && data.compare(0, 4, "DIRC") == 0) {
+    load_binary(data);
+  } else {
+    load_text(data);
+  }
+}
+
+void Index::load_text(const std::string &data) {
+  std::istringstream lines(data);
   std::string line;
-  while (std::getline(in, line)) {
+  while (std::getline(lines, line)) {
     if(line.empty()) continue;
     
     std::istringstream iss(line);
@@ -40,26 +219,155 @@ void Index::load() {
   } 
 }
 
-void Index::flush() {
-  auto tmp = path_;
-  tmp += ".tmp";
+void Index::load_binary(const std::string &data) {
+  const auto *p = reinterpret_cast<const unsigned char *>(data.data());
+  const std::size_t oid_len = hash_len(algo_);
+  const std::size_t entry_fixed_len = kEntryStatLen + oid_len + 2;
+  if (data.size() < kHeaderLen + oid_len) {
+    throw std::runtime_error("index file too short");
+  }
+
+  const std::size_t body_len = data.size() - oid_len;
+  unsigned char digest[kMaxHashLen];
+  Hasher::digest(algo_, data.data(), body_len, digest);
+  if (std::memcmp(digest, p + body_len, oid_len) != 0) {
+    throw std::runtime_error("index checksum mismatch");
+  }
+
+  const std::uint32_t version = read_be32(p + 4);
+  if (version != 2 && version != 3) {
+    throw std::runtime_error("unsupported index version " + std::to_string(version));
+  }
+  const std::uint32_t count = read_be32(p + 8);
+
+  std::size_t pos = kHeaderLen;
+  for (std::uint32_t i = 0; i < count; ++i) {
+    if (pos + entry_fixed_len > body_len) {
+      throw std::runtime_error("truncated index entry");
+    }
+    const unsigned char *e = p + pos;
+
+    IndexEntry entry;
+    entry.stat.ctime_sec = read_be32(e);
+    entry.stat.ctime_nsec = read_be32(e + 4);
+    entry.stat.mtime_sec = read_be32(e + 8);
+    entry.stat.mtime_nsec = read_be32(e + 12);
+    entry.stat.dev = read_be32(e + 16);
+    entry.stat.ino = read_be32(e + 20);
+    const std::uint32_t mode = read_be32(e + 24);
+    entry.stat.uid = read_be32(e + 28);
+    entry.stat.gid = read_be32(e + 32);
+    entry.stat.size = read_be32(e + 36);
+    entry.oid = Oid::from_raw(e + kEntryStatLen, algo_);
+    const std::uint16_t flags = read_be16(e + kEntryStatLen + oid_len);
 
-  std::ofstream out(tmp, std::ios::trunc);
-  if (!out) {
-    throw std::runtime_error("cannot open index temp file: " + tmp.string());
+    std::size_t fixed = entry_fixed_len;
+    if (flags & kExtendedFlag) {
+      if (version < 3) throw std::runtime_error("extended index entry in v2 index");
+      fixed += 2; // extended flags are not used here and are dropped
+    }
+
+    // The name is NUL-terminated; the 12-bit length saturates at 0xfff
+    const char *name = reinterpret_cast<const char *>(e + fixed);
+    const void *nul = std::memchr(name, '\0', body_len - (pos + fixed));
+    if (!nul) throw std::runtime_error("unterminated index entry name");
+    const std::size_t name_len = static_cast<std::size_t>(static_cast<const char *>(nul) - name);
+
+    char mode_buf[16];
+    std::snprintf(mode_buf, sizeof(mode_buf), "%06o", mode);
+    entry.mode = mode_buf;
+    entry.path.assign(name, name_len);
+    entry.flags = static_cast<std::uint16_t>(flags & ~kNameMask & ~kExtendedFlag);
+
+    by_path_[entry.path] = entry;
+    pos += (fixed + name_len + 8) & ~std::size_t(7);
   }
 
+  // Extensions: "<sig:4><size:4><data>". Uppercase signatures are optional
+  // and can be skipped; anything else must be understood.
+  while (pos + 8 <= body_len) {
+    const char *sig = reinterpret_cast<const char *>(p + pos);
+    const std::uint32_t len = read_be32(p + pos + 4);
+    if (pos + 8 + len > body_len) throw std::runtime_error("truncated index extension");
+    if (std::memcmp(sig, "TREE", 4) == 0) {
+      const unsigned char *cur = p + pos + 8;
+      std::string root_name;
+      cache_tree_ = CacheTree{};
+      read_cache_tree(cache_tree_, cur, cur + len, root_name, algo_);
+    } else if (sig[0] < 'A' || sig[0] > 'Z') {
+      throw std::runtime_error("unsupported index extension: " + std::string(sig, 4));
+    }
+    pos += 8 + len;
+  }
+}
+
+void Index::flush() {
+  std::string buf;
+  buf.append("DIRC", 4);
+  put_be32(buf, 2);
+  put_be32(buf, static_cast<std::uint32_t>(by_path_.size()));
+
   for (auto const& [path, entry]: by_path_) {
-    out << entry.mode << ' '
-        << entry.oid.to_hex() << ' '
-        << entry.path << '\n';
+    const std::size_t start = buf.size();
+    put_be32(buf, entry.stat.ctime_sec);
+    put_be32(buf, entry.stat.ctime_nsec);
+    put_be32(buf, entry.stat.mtime_sec);
+    put_be32(buf, entry.stat.mtime_nsec);
+    put_be32(buf, entry.stat.dev);
+    put_be32(buf, entry.stat.ino);
+    put_be32(buf, static_cast<std::uint32_t>(std::stoul(entry.mode, nullptr, 8)));
+    put_be32(buf, entry.stat.uid);
+    put_be32(buf, entry.stat.gid);
+    put_be32(buf, entry.stat.size);
+    buf.append(reinterpret_cast<const char *>(entry.oid.bytes), entry.oid.size());
+
+    const std::size_t name_len = std::min<std::size_t>(path.size(), kNameMask);
+    put_be16(buf, static_cast<std::uint16_t>((entry.flags & ~kNameMask) | name_len));
+    buf.append(path);
+    // 1..8 NULs so that the entry length is a multiple of 8
+    buf.append(8 - (buf.size() - start) % 8, '\0');
   }
 
-  if(!out) {
-    throw std::runtime_error("Error while writing to the temp file.");
+  // Only worth persisting once write_tree() has filled something in
+  if (cache_tree_.entry_count >= 0 || !cache_tree_.subtrees.empty()) {
+    std::string tree;
+    write_cache_tree(cache_tree_, "", tree);
+    buf.append("TREE", 4);
+    put_be32(buf, static_cast<std::uint32_t>(tree.size()));
+    buf.append(tree);
   }
 
-  out.close();
+  unsigned char digest[kMaxHashLen];
+  Hasher::digest(algo_, buf.data(), buf.size(), digest);
+  buf.append(reinterpret_cast<const char *>(digest), hash_len(algo_));
+
+  if (lock_fd_ < 0) lock();
+  const fs::path lock_path = path_.string() + ".lock";
+  const int fd = std::exchange(lock_fd_, -1);
+  try {
+    write_all(fd, buf.data(), buf.size());
+    if (::fsync(fd) != 0) throw std::runtime_error("fsync failed: " + lock_path.string());
+  } catch (...) {
+    ::close(fd);
+    ::unlink(lock_path.c_str());
+    throw;
+  }
+  if (::close(fd) != 0 || ::rename(lock_path.c_str(), path_.c_str()) != 0) {
+    const int err = errno;
+    ::unlink(lock_path.c_str());
+    throw std::runtime_error("cannot update index: " + std::string(std::strerror(err)));
+  }
+}
 
-  fs::rename(tmp, path_);
+void Index::lock() {
+  if (lock_fd_ >= 0) return;
+  const fs::path lock_path = path_.string() + ".lock";
+  lock_fd_ = ::open(lock_path.c_str(), O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, 0666);
+  if (lock_fd_ < 0) {
+    if (errno == EEXIST) {
+      throw std::runtime_error("cannot lock index: '" + lock_path.string() +
+                               "' exists; another process is updating it");
+    }
+    throw std::runtime_error("cannot lock index: " + std::string(std::strerror(errno)));
+  }
 }
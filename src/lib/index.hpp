@@ -1,25 +1,108 @@
+#pragma once
+
 #include "object_store.hpp"
+#include <cstdint>
 #include <map>
+#include <memory>
+#include <sys/stat.h>
 
 namespace fs = std::filesystem;
 
+// Cached lstat() data, truncated to 32 bits the way the on-disk index
+// stores it. If a file's current stat data matches, its contents have not
+// changed since it was hashed.
+struct IndexStat {
+  std::uint32_t ctime_sec = 0;
+  std::uint32_t ctime_nsec = 0;
+  std::uint32_t mtime_sec = 0;
+  std::uint32_t mtime_nsec = 0;
+  std::uint32_t dev = 0;
+  std::uint32_t ino = 0;
+  std::uint32_t uid = 0;
+  std::uint32_t gid = 0;
+  std::uint32_t size = 0;
+
+  static IndexStat from(const struct stat &st);
+  bool operator==(const IndexStat &) const = default;
+};
+
 struct IndexEntry {
   std::string path;
   std::string mode;
   Oid oid;
+  IndexStat stat{};
+  std::uint16_t flags = 0; // on-disk flags minus the name length
+};
+
+// Cached tree OIDs per directory (the "TREE" index extension). A node with
+// entry_count < 0 is invalid and has to be rebuilt by write_tree(); a valid
+// node covers `entry_count` index entries and is reused as-is.
+struct CacheTree {
+  int entry_count = -1;
+  Oid oid{};
+  std::map<std::string, std::unique_ptr<CacheTree>> subtrees;
 };
 
+// Staging area, stored as a git-compatible binary index ("DIRC" v2, v3 is
+// read as well):
+//   header: "DIRC" | version | entry count
+//   entry:  ctime | mtime | dev | ino | mode | uid | gid | size | oid | flags
+//           | path | 1-8 NULs (entries are 8-byte aligned)
+//   extensions ("TREE" is read and written), then a hash of everything
+//   before it.
+// OIDs and the trailing hash follow the repository's object format (20 bytes
+// for SHA-1, 32 for SHA-256).
+// The old text format ("<mode> <oid> <path>" per line) is still accepted on
+// load and gets rewritten as binary on the next flush.
 class Index {
 public:
-  explicit Index(fs::path index_path);
+  Index(fs::path index_path, HashAlgo algo);
+  // Drops "index.lock" if it is still held
+  ~Index();
+
+  Index(const Index &) = delete;
+  Index &operator=(const Index &) = delete;
+
+  // Takes "index.lock" with O_EXCL, as Git does. Call it before load() so
+  // that load() ... flush() is one read-modify-write: a concurrent writer
+  // fails instead of one update silently overwriting the other. Throws when
+  // the lock is held elsewhere.
+  void lock();
 
   void load();
   void upsert(const IndexEntry &e);
+  // Writes the index through "index.lock" and renames it into place,
+  // taking the lock first unless lock() already did.
   void flush();
 
   const std::map<std::string, IndexEntry> &entries() const;
+  const IndexEntry *find(const std::string &path) const;
+
+  // Writes the tree objects for the staged entries and returns the root
+  // tree OID. Directories whose cache-tree node is still valid are reused,
+  // so after upserting one file only the trees on its path are rebuilt.
+  // Call flush() afterwards to persist the refreshed cache-tree.
+  Oid write_tree(ObjectStore &store);
+
+  // True when `e` was modified in the same second the index was last
+  // written, so matching stat data does not prove the contents are
+  // unchanged ("racy git").
+  bool is_racy(const IndexEntry &e) const;
 
 private:
+  void load_text(const std::string &data);
+  void load_binary(const std::string &data);
+  void invalidate_path(const std::string &path);
+
+  using EntryIter = std::map<std::string, IndexEntry>::const_iterator;
+  Oid build_tree(CacheTree &node, const std::string &prefix, EntryIter begin,
+                 EntryIter end, ObjectStore &store);
+
   fs::path path_;
+  HashAlgo algo_;
   std::map<std::string, IndexEntry> by_path_;
+  CacheTree cache_tree_;
+  std::uint32_t timestamp_sec_ = 0; // mtime of the index file when loaded
+  std::uint32_t timestamp_nsec_ = 0;
+  int lock_fd_ = -1; // "index.lock", while held
 };
@@ -0,0 +1,93 @@
+#include "i_object_codec.hpp"
+
+#include <algorithm>
+#include <libdeflate.h>
+#include <stdexcept>
+
+// libdeflate's default level; it compresses about as well as zlib -6
+static constexpr int kDefault = 6;
+static constexpr int kMaxLevel = 12;
+// Level 0 (stored blocks, what level_for() picks for incompressible data)
+// needs libdeflate 1.16; older versions refuse to allocate it, so they get
+// the cheapest real level instead. Undefined version macros count as 0.
+#if LIBDEFLATE_VERSION_MAJOR > 1 || (LIBDEFLATE_VERSION_MAJOR == 1 && LIBDEFLATE_VERSION_MINOR >= 16)
+static constexpr int kMinLevel = 0;
+#else
+static constexpr int kMinLevel = 1;
+#endif
+
+namespace {
+
+struct CompressorFree {
+    void operator()(libdeflate_compressor* c) const { libdeflate_free_compressor(c); }
+};
+struct DecompressorFree {
+    void operator()(libdeflate_decompressor* d) const { libdeflate_free_decompressor(d); }
+};
+
+// libdeflate contexts are not thread-safe, and a compressor is bound to
+// one level; each thread keeps one per level it has used
+libdeflate_compressor* thread_compressor(int level) {
+    thread_local std::unique_ptr<libdeflate_compressor, CompressorFree> by_level[kMaxLevel + 1];
+    level = level < 0 ? kDefault : std::clamp(level, kMinLevel, kMaxLevel);
+    auto& c = by_level[level];
+    if (!c) c.reset(libdeflate_alloc_compressor(level));
+    if (!c) throw std::runtime_error("libdeflate: cannot allocate compressor");
+    return c.get();
+}
+
+libdeflate_decompressor* thread_decompressor() {
+    thread_local std::unique_ptr<libdeflate_decompressor, DecompressorFree> d(
+        libdeflate_alloc_decompressor());
+    if (!d) throw std::runtime_error("libdeflate: cannot allocate decompressor");
+    return d.get();
+}
+
+// Whole-buffer zlib streams through libdeflate. The output is an ordinary
+// zlib stream, so objects stay readable by upstream Git. libdeflate has no
+// streaming interface; streamed objects go through plain zlib.
+class LibdeflateCodec : public IObjectCodec {
+public:
+    const char* name() const override { return "libdeflate"; }
+    bool zlib_compatible() const override { return true; }
+    bool recognizes(std::string_view prefix) const override { return zlib_->recognizes(prefix); }
+
+    std::string compress(std::string_view s, int level) const override {
+        libdeflate_compressor* c = thread_compressor(level);
+        std::string out(libdeflate_zlib_compress_bound(c, s.size()), '\0');
+        const std::size_t n = libdeflate_zlib_compress(c, s.data(), s.size(), out.data(), out.size());
+        if (n == 0) throw std::runtime_error("libdeflate: compression failed");
+        out.resize(n);
+        return out;
+    }
+
+    std::string decompress(std::string_view s, std::size_t size_hint) const override {
+        libdeflate_decompressor* d = thread_decompressor();
+        std::string out(size_hint ? size_hint : std::max<std::size_t>(s.size() * 4, 256), '\0');
+        while (true) {
+            std::size_t in_used = 0, out_len = 0;
+            const libdeflate_result r = libdeflate_zlib_decompress_ex(
+                d, s.data(), s.size(), out.data(), out.size(), &in_used, &out_len);
+            if (r == LIBDEFLATE_SUCCESS) {
+                out.resize(out_len);
+                return out;
+            }
+            if (r != LIBDEFLATE_INSUFFICIENT_SPACE) {
+                throw std::runtime_error("libdeflate: corrupt zlib stream");
+            }
+            out.resize(out.size() * 2); // the size was a guess, or a wrong hint
+        }
+    }
+
+    std::unique_ptr<StreamEncoder> encoder(int level) const override { return zlib_->encoder(level); }
+    std::unique_ptr<StreamDecoder> decoder() const override { return zlib_->decoder(); }
+
+private:
+    std::unique_ptr<IObjectCodec> zlib_ = make_zlib_codec();
+};
+
+} // namespace
+
+std::unique_ptr<IObjectCodec> make_libdeflate_codec() {
+    return std::make_unique<LibdeflateCodec>();
+}
@@ -0,0 +1,102 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <utility>
+
+struct LruCacheStats {
+    std::uint64_t hits = 0;
+    std::uint64_t misses = 0;
+    std::size_t bytes = 0;
+    std::size_t entries = 0;
+
+    double hit_rate() const {
+        const std::uint64_t total = hits + misses;
+        return total ? static_cast<double>(hits) / static_cast<double>(total) : 0.0;
+    }
+};
+
+// Byte-budgeted LRU map from Key to immutable, shared Values. The caller
+// states each entry's cost when inserting it; once the total would exceed
+// the limit, least recently used entries are evicted from the tail. Values
+// are handed out as shared_ptr, so an evicted value stays alive for as long
+// as a reader holds it. Safe to share between threads.
+template <class Key, class Value, class Hash = std::hash<Key>>
+class LruCache {
+    struct Node {
+        Key key;
+        std::shared_ptr<const Value> value;
+        std::size_t cost;
+    };
+
+public:
+    // Bookkeeping each entry costs on top of its value; callers that count
+    // it include it in the cost they pass to put().
+    static constexpr std::size_t kEntryOverhead = sizeof(Node);
+
+    explicit LruCache(std::size_t limit) : limit_(limit) {}
+
+    std::size_t limit() const { return limit_; }
+
+    // Returns the cached value or nullptr, and marks a hit as most recently
+    // used.
+    std::shared_ptr<const Value> get(const Key& key) {
+        std::lock_guard<std::mutex> lock(mu_);
+        auto it = map_.find(key);
+        if (it == map_.end()) {
+            ++misses_;
+            return nullptr;
+        }
+        ++hits_;
+        lru_.splice(lru_.begin(), lru_, it->second);
+        return it->second->value;
+    }
+
+    // Entries costing more than the whole budget are dropped rather than
+    // evicting everything else. Re-inserting a present key only refreshes it.
+    void put(const Key& key, std::shared_ptr<const Value> value, std::size_t cost) {
+        if (cost > limit_) return;
+
+        std::lock_guard<std::mutex> lock(mu_);
+        if (auto it = map_.find(key); it != map_.end()) {
+            lru_.splice(lru_.begin(), lru_, it->second);
+            return;
+        }
+
+        while (!lru_.empty() && bytes_ + cost > limit_) {
+            bytes_ -= lru_.back().cost;
+            map_.erase(lru_.back().key);
+            lru_.pop_back();
+        }
+
+        lru_.push_front(Node{key, std::move(value), cost});
+        map_.emplace(key, lru_.begin());
+        bytes_ += cost;
+    }
+
+    void clear() {
+        std::lock_guard<std::mutex> lock(mu_);
+        lru_.clear();
+        map_.clear();
+        bytes_ = 0;
+    }
+
+    LruCacheStats stats() const {
+        std::lock_guard<std::mutex> lock(mu_);
+        return LruCacheStats{hits_, misses_, bytes_, map_.size()};
+    }
+
+private:
+    mutable std::mutex mu_;
+    std::list<Node> lru_; // most recently used at the front
+    std::unordered_map<Key, typename std::list<Node>::iterator, Hash> map_;
+    std::size_t limit_;
+    std::size_t bytes_ = 0;
+    std::uint64_t hits_ = 0;
+    std::uint64_t misses_ = 0;
+};
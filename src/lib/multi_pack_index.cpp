@@ -0,0 +1,277 @@
+#include "multi_pack_index.hpp"
+
+#include "byte_order.hpp"
+#include "file_util.hpp"
+#include "pack.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <stdexcept>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+static constexpr char kSignature[4] = {'M', 'I', 'D', 'X'};
+static constexpr std::uint8_t kVersion = 1;
+static constexpr std::size_t kHeaderLen = 12;
+static constexpr std::size_t kChunkEntryLen = 12;
+static constexpr std::size_t kFanoutLen = 256 * 4;
+static constexpr std::size_t kNameAlign = 4;
+
+static constexpr std::uint32_t kChunkPackNames = 0x504e414d;    // "PNAM"
+static constexpr std::uint32_t kChunkFanout = 0x4f494446;       // "OIDF"
+static constexpr std::uint32_t kChunkOids = 0x4f49444c;         // "OIDL"
+static constexpr std::uint32_t kChunkOffsets = 0x4f4f4646;      // "OOFF"
+static constexpr std::uint32_t kChunkLargeOffsets = 0x4c4f4646; // "LOFF"
+
+static constexpr std::uint32_t kLargeOffsetFlag = 0x80000000;
+
+// ------------------------------------------------------------------ reading
+
+std::unique_ptr<MultiPackIndex> MultiPackIndex::open(const fs::path& file, HashAlgo algo) {
+    const int fd = ::open(file.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return nullptr;
+    struct stat st {};
+    if (::fstat(fd, &st) != 0 || st.st_size == 0) {
+        ::close(fd);
+        return nullptr;
+    }
+    const auto size = static_cast<std::size_t>(st.st_size);
+    void* map = ::mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if (map == MAP_FAILED) return nullptr;
+
+    std::unique_ptr<MultiPackIndex> m(new MultiPackIndex());
+    m->algo_ = algo;
+    m->hash_len_ = hash_len(algo);
+    m->data_ = static_cast<const unsigned char*>(map);
+    m->size_ = size;
+
+    const unsigned char* p = m->data_;
+    const std::size_t h = m->hash_len_;
+    if (size < kHeaderLen + kChunkEntryLen + h || std::memcmp(p, kSignature, 4) != 0 ||
+        p[4] != kVersion || p[5] != hash_version(algo) || p[7] != 0) {
+        return nullptr;
+    }
+    const std::uint32_t packs = read_be32(p + 8);
+
+    // Chunk table: each chunk runs up to the offset of the next entry
+    const std::size_t chunks = p[6];
+    const std::size_t end = size - h;
+    if (kHeaderLen + (chunks + 1) * kChunkEntryLen > end) return nullptr;
+    const unsigned char* names = nullptr;
+    std::size_t names_len = 0, fanout_len = 0, oids_len = 0, offsets_len = 0, large_len = 0;
+    for (std::size_t i = 0; i < chunks; ++i) {
+        const unsigned char* entry = p + kHeaderLen + i * kChunkEntryLen;
+        const std::uint32_t id = read_be32(entry);
+        const std::uint64_t off = read_be64(entry + 4);
+        const std::uint64_t next = read_be64(entry + kChunkEntryLen + 4);
+        if (off > next || next > end) return nullptr;
+        const unsigned char* chunk = p + off;
+        const std::size_t len = static_cast<std::size_t>(next - off);
+        switch (id) {
+        case kChunkPackNames: names = chunk; names_len = len; break;
+        case kChunkFanout: m->fanout_ = chunk; fanout_len = len; break;
+        case kChunkOids: m->oids_ = chunk; oids_len = len; break;
+        case kChunkOffsets: m->offsets_ = chunk; offsets_len = len; break;
+        case kChunkLargeOffsets: m->large_offsets_ = chunk; large_len = len; break;
+        default: break; // optional chunks (RIDX, BTMP, ...) are not used
+        }
+    }
+
+    if (!names || !m->fanout_ || !m->oids_ || !m->offsets_ || fanout_len != kFanoutLen) return nullptr;
+    m->count_ = read_be32(m->fanout_ + 255 * 4);
+    if (oids_len != std::size_t(m->count_) * h || offsets_len != std::size_t(m->count_) * 8 ||
+        large_len % 8 != 0) {
+        return nullptr;
+    }
+    m->large_count_ = large_len / 8;
+
+    // Names are NUL-terminated; the padding after the last one is NULs too
+    for (std::size_t pos = 0; pos < names_len && m->pack_names_.size() < packs;) {
+        const void* nul = std::memchr(names + pos, 0, names_len - pos);
+        if (!nul) return nullptr;
+        const std::size_t len = static_cast<const unsigned char*>(nul) - (names + pos);
+        m->pack_names_.emplace_back(reinterpret_cast<const char*>(names + pos), len);
+        pos += len + 1;
+    }
+    if (m->pack_names_.size() != packs || !std::is_sorted(m->pack_names_.begin(), m->pack_names_.end())) {
+        return nullptr;
+    }
+    return m;
+}
+
+MultiPackIndex::~MultiPackIndex() {
+    if (data_) ::munmap(const_cast<unsigned char*>(data_), size_);
+}
+
+std::optional<MultiPackIndex::Location> MultiPackIndex::find(const Oid& oid) const {
+    if (oid.algo != algo_) return std::nullopt;
+    const int first = oid.bytes[0];
+    std::uint32_t lo = first == 0 ? 0 : read_be32(fanout_ + 4 * (first - 1));
+    std::uint32_t hi = std::min(read_be32(fanout_ + 4 * first), count_);
+    while (lo < hi) {
+        const std::uint32_t mid = lo + (hi - lo) / 2;
+        const int cmp = std::memcmp(oids_ + std::size_t(mid) * hash_len_, oid.bytes, hash_len_);
+        if (cmp == 0) return location_at(mid);
+        if (cmp < 0) lo = mid + 1;
+        else hi = mid;
+    }
+    return std::nullopt;
+}
+
+Oid MultiPackIndex::oid_at(std::uint32_t i) const {
+    return Oid::from_raw(oids_ + std::size_t(i) * hash_len_, algo_);
+}
+
+MultiPackIndex::Location MultiPackIndex::location_at(std::uint32_t i) const {
+    const unsigned char* entry = offsets_ + std::size_t(i) * 8;
+    Location loc{read_be32(entry), read_be32(entry + 4)};
+    if (loc.pack >= pack_names_.size()) throw std::runtime_error("corrupt multi-pack-index: bad pack id");
+    if (loc.offset & kLargeOffsetFlag) {
+        const std::size_t large = loc.offset & ~kLargeOffsetFlag;
+        if (large >= large_count_) throw std::runtime_error("corrupt multi-pack-index: bad large offset");
+        loc.offset = read_be64(large_offsets_ + large * 8);
+    }
+    return loc;
+}
+
+std::optional<std::string> MultiPackIndex::verify(const fs::path& pack_dir) const {
+    unsigned char digest[kMaxHashLen];
+    Hasher::digest(algo_, data_, size_ - hash_len_, digest);
+    if (std::memcmp(digest, data_ + size_ - hash_len_, hash_len_) != 0) return "checksum mismatch";
+
+    for (std::uint32_t b = 1; b < 256; ++b) {
+        if (read_be32(fanout_ + 4 * (b - 1)) > read_be32(fanout_ + 4 * b)) return "fanout is not monotonic";
+    }
+    for (std::uint32_t i = 0; i < count_; ++i) {
+        if (i > 0 && std::memcmp(oids_ + std::size_t(i - 1) * hash_len_, oids_ + std::size_t(i) * hash_len_,
+                                 hash_len_) >= 0) {
+            return "OIDs out of order at entry " + std::to_string(i);
+        }
+        if (find(oid_at(i)) == std::nullopt) return "fanout does not cover " + oid_at(i).to_hex();
+    }
+
+    std::vector<std::unique_ptr<PackIndex>> packs;
+    try {
+        for (const std::string& name : pack_names_) {
+            packs.push_back(std::make_unique<PackIndex>(pack_dir / name, algo_));
+        }
+        for (std::uint32_t i = 0; i < count_; ++i) {
+            const Location loc = location_at(i);
+            if (packs[loc.pack]->find(oid_at(i)) != loc.offset) {
+                return oid_at(i).to_hex() + ": wrong offset for " + pack_names_[loc.pack];
+            }
+        }
+    } catch (const std::runtime_error& e) {
+        return e.what();
+    }
+    for (std::size_t p = 0; p < packs.size(); ++p) {
+        for (std::uint32_t i = 0; i < packs[p]->count(); ++i) {
+            if (!find(packs[p]->oid_at(i))) {
+                return packs[p]->oid_at(i).to_hex() + " from " + pack_names_[p] + " is missing";
+            }
+        }
+    }
+    return std::nullopt;
+}
+
+// ------------------------------------------------------------------ writing
+
+std::size_t write_multi_pack_index(const fs::path& pack_dir, HashAlgo algo) {
+    const std::size_t h = hash_len(algo);
+    const fs::path file = pack_dir / "multi-pack-index";
+
+    struct Pack {
+        std::string name;
+        std::int64_t mtime;
+    };
+    std::vector<Pack> packs;
+    std::error_code ec;
+    for (const auto& entry : fs::directory_iterator(pack_dir, ec)) {
+        const fs::path& idx = entry.path();
+        if (idx.extension() != ".idx") continue;
+        struct stat st {};
+        if (::stat(fs::path(idx).replace_extension(".pack").c_str(), &st) != 0) continue;
+        packs.push_back({idx.filename().string(),
+                         std::int64_t(st.st_mtim.tv_sec) * 1'000'000'000 + st.st_mtim.tv_nsec});
+    }
+    if (packs.empty()) {
+        fs::remove(file, ec);
+        return 0;
+    }
+    std::sort(packs.begin(), packs.end(), [](const Pack& a, const Pack& b) { return a.name < b.name; });
+
+    struct Object {
+        Oid oid;
+        std::uint32_t pack;
+        std::uint64_t offset;
+    };
+    std::vector<Object> objects;
+    for (std::uint32_t p = 0; p < packs.size(); ++p) {
+        const PackIndex idx(pack_dir / packs[p].name, algo);
+        objects.reserve(objects.size() + idx.count());
+        for (std::uint32_t i = 0; i < idx.count(); ++i) objects.push_back({idx.oid_at(i), p, idx.offset_at(i)});
+    }
+    // For an object in several packs, the copy in the newest pack wins
+    std::sort(objects.begin(), objects.end(), [&](const Object& a, const Object& b) {
+        if (const int cmp = std::memcmp(a.oid.bytes, b.oid.bytes, h)) return cmp < 0;
+        if (packs[a.pack].mtime != packs[b.pack].mtime) return packs[a.pack].mtime > packs[b.pack].mtime;
+        return a.pack < b.pack;
+    });
+    objects.erase(std::unique(objects.begin(), objects.end(),
+                              [](const Object& a, const Object& b) { return a.oid == b.oid; }),
+                  objects.end());
+
+    std::string names, fanout, oids, offsets, large;
+    for (const Pack& p : packs) {
+        names += p.name;
+        names.push_back('\0');
+    }
+    names.resize((names.size() + kNameAlign - 1) / kNameAlign * kNameAlign, '\0');
+    std::uint32_t counts[256] = {};
+    for (const Object& o : objects) ++counts[o.oid.bytes[0]];
+    for (std::uint32_t b = 0, total = 0; b < 256; ++b) put_be32(fanout, total += counts[b]);
+    for (const Object& o : objects) {
+        oids.append(reinterpret_cast<const char*>(o.oid.bytes), h);
+        put_be32(offsets, o.pack);
+        if (o.offset < kLargeOffsetFlag) {
+            put_be32(offsets, static_cast<std::uint32_t>(o.offset));
+        } else {
+            put_be32(offsets, kLargeOffsetFlag | static_cast<std::uint32_t>(large.size() / 8));
+            put_be64(large, o.offset);
+        }
+    }
+
+    struct Chunk {
+        std::uint32_t id;
+        const std::string* data;
+    };
+    std::vector<Chunk> chunks = {
+        {kChunkPackNames, &names}, {kChunkFanout, &fanout}, {kChunkOids, &oids}, {kChunkOffsets, &offsets}};
+    if (!large.empty()) chunks.push_back({kChunkLargeOffsets, &large});
+
+    std::string out(kSignature, sizeof(kSignature));
+    out.push_back(static_cast<char>(kVersion));
+    out.push_back(static_cast<char>(hash_version(algo)));
+    out.push_back(static_cast<char>(chunks.size()));
+    out.push_back(0); // no base files
+    put_be32(out, static_cast<std::uint32_t>(packs.size()));
+    std::uint64_t offset = kHeaderLen + (chunks.size() + 1) * kChunkEntryLen;
+    for (const auto& chunk : chunks) {
+        put_be32(out, chunk.id);
+        put_be64(out, offset);
+        offset += chunk.data->size();
+    }
+    put_be32(out, 0);
+    put_be64(out, offset);
+    for (const auto& chunk : chunks) out += *chunk.data;
+    unsigned char digest[kMaxHashLen];
+    Hasher::digest(algo, out.data(), out.size(), digest);
+    out.append(reinterpret_cast<const char*>(digest), h);
+
+    replace_file(file, out);
+    return objects.size();
+}
@@ -0,0 +1,78 @@
+#pragma once
+
+#include "hash.hpp"
+#include "oid.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <memory>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace fs = std::filesystem;
+
+// Read-only view over a multi-pack-index ("objects/pack/multi-pack-index"),
+// one OID table for every pack in the directory, in Git's format:
+//   "MIDX" | version 1 | hash version | chunk count | base count 0
+//   | pack count | chunk table: (id, 64-bit offset) per chunk plus a
+//   terminating entry
+//   PNAM  the packs' .idx names, sorted, NUL-terminated, padded to 4 bytes
+//   OIDF  fanout[256] over the first OID byte
+//   OIDL  sorted OIDs
+//   OOFF  per OID: pack id (index into PNAM) | offset (MSB set: LOFF index)
+//   LOFF  64-bit offsets at or past 2 GiB (optional)
+//   | hash of everything before it
+// An object in several packs is listed once, for the most recently written
+// pack. The file is mmap'ed for the lifetime of the object.
+class MultiPackIndex {
+public:
+    struct Location {
+        std::uint32_t pack; // index into pack_names()
+        std::uint64_t offset;
+    };
+
+    // nullptr when the file is missing, malformed or for another hash
+    static std::unique_ptr<MultiPackIndex> open(const fs::path& file, HashAlgo algo);
+    ~MultiPackIndex();
+
+    MultiPackIndex(const MultiPackIndex&) = delete;
+    MultiPackIndex& operator=(const MultiPackIndex&) = delete;
+
+    std::uint32_t count() const { return count_; }
+    // "pack-<hash>.idx" names, in pack id order
+    const std::vector<std::string>& pack_names() const { return pack_names_; }
+
+    // Binary search inside the fanout bucket of oid.bytes[0]
+    std::optional<Location> find(const Oid& oid) const;
+
+    Oid oid_at(std::uint32_t i) const;
+    Location location_at(std::uint32_t i) const;
+
+    // Checks the trailing hash, the OID order and every entry against the
+    // .idx files in `pack_dir`; returns a description of the first
+    // problem, or nullopt.
+    std::optional<std::string> verify(const fs::path& pack_dir) const;
+
+private:
+    MultiPackIndex() = default;
+
+    HashAlgo algo_ = HashAlgo::Sha1;
+    std::size_t hash_len_ = kSha1Len;
+    const unsigned char* data_ = nullptr;
+    std::size_t size_ = 0;
+    std::uint32_t count_ = 0;
+    std::vector<std::string> pack_names_;
+    const unsigned char* fanout_ = nullptr;
+    const unsigned char* oids_ = nullptr;
+    const unsigned char* offsets_ = nullptr;
+    const unsigned char* large_offsets_ = nullptr;
+    std::size_t large_count_ = 0;
+};
+
+// Writes a multi-pack-index covering every pack (with both .pack and .idx)
+// in `pack_dir`, via a temp file renamed into place. Returns the number of
+// objects, or 0 (and removes any old file) when there are no packs.
+std::size_t write_multi_pack_index(const fs::path& pack_dir, HashAlgo algo);
@@ -0,0 +1,15 @@
+#include "object_cache.hpp"
+
+#include <utility>
+
+std::shared_ptr<const ObjectCache::Object> ObjectCache::get(const Oid& oid) { return lru_.get(oid); }
+
+void ObjectCache::put(const Oid& oid, std::string type, std::string content) {
+    if (!admits(type, content.size())) return;
+    const std::size_t cost = type.size() + content.size() + Lru::kEntryOverhead;
+    lru_.put(oid, std::make_shared<const Object>(Object{std::move(type), std::move(content)}), cost);
+}
+
+void ObjectCache::clear() { lru_.clear(); }
+
+ObjectCache::Stats ObjectCache::stats() const { return lru_.stats(); }
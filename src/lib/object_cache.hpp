@@ -0,0 +1,52 @@
+#pragma once
+
+#include "lru_cache.hpp"
+#include "oid.hpp"
+
+#include <cstddef>
+#include <memory>
+#include <string>
+#include <string_view>
+
+// Byte-budgeted LRU cache of decoded objects keyed by OID. Objects are
+// immutable, so entries never go stale; tree walks and long-lived batch
+// readers get repeated reads of the same trees without touching the
+// filesystem or inflating again. Safe to share between threads.
+class ObjectCache {
+public:
+    static constexpr std::size_t kDefaultLimit = 32u << 20; // 32 MiB
+
+    using Stats = LruCacheStats;
+
+    struct Object {
+        std::string type;
+        std::string content;
+    };
+
+    // A limit of 0 disables the cache.
+    explicit ObjectCache(std::size_t limit = kDefaultLimit) : lru_(limit) {}
+
+    bool enabled() const { return lru_.limit() != 0; }
+    std::size_t limit() const { return lru_.limit(); }
+
+    // Returns the cached object or nullptr. The object stays valid for as
+    // long as the caller holds on to it, even if it is evicted meanwhile.
+    std::shared_ptr<const Object> get(const Oid& oid);
+
+    // Objects larger than an eighth of the budget are not cached, so that
+    // one big blob does not flush every tree.
+    void put(const Oid& oid, std::string type, std::string content);
+    // Whether put() would keep an object of this type and content size;
+    // lets callers skip copying objects that would be dropped anyway.
+    bool admits(std::string_view type, std::size_t size) const {
+        return type.size() + size + Lru::kEntryOverhead <= lru_.limit() / 8;
+    }
+    void clear();
+
+    Stats stats() const;
+
+private:
+    using Lru = LruCache<Oid, Object, OidHash>;
+
+    Lru lru_;
+};
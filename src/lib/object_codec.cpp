@@ -0,0 +1,64 @@
+#include "i_object_codec.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <stdexcept>
+#include <string>
+
+// Defined in the optional codec sources, which CMake only builds when the
+// library is found
+#ifdef COMMITLOG_HAVE_LIBDEFLATE
+std::unique_ptr<IObjectCodec> make_libdeflate_codec();
+#endif
+#ifdef COMMITLOG_HAVE_ZSTD
+std::unique_ptr<IObjectCodec> make_zstd_codec();
+#endif
+
+bool codec_available(std::string_view name) {
+    if (name == "zlib") return true;
+#ifdef COMMITLOG_HAVE_LIBDEFLATE
+    if (name == "libdeflate") return true;
+#endif
+#ifdef COMMITLOG_HAVE_ZSTD
+    if (name == "zstd") return true;
+#endif
+    return false;
+}
+
+std::unique_ptr<IObjectCodec> make_codec(std::string_view name) {
+    if (name == "zlib") return make_zlib_codec();
+#ifdef COMMITLOG_HAVE_LIBDEFLATE
+    if (name == "libdeflate") return make_libdeflate_codec();
+#endif
+#ifdef COMMITLOG_HAVE_ZSTD
+    if (name == "zstd") return make_zstd_codec();
+#endif
+    if (name == "libdeflate" || name == "zstd") {
+        throw std::runtime_error("codec '" + std::string(name) + "' is not available in this build");
+    }
+    throw std::runtime_error("unknown object codec: " + std::string(name));
+}
+
+// Sampled from the front of the data; smaller inputs are always compressed
+static constexpr std::size_t kProbeBytes = 4096;
+static constexpr std::size_t kMinProbeBytes = 512;
+// Compressed or encrypted data measures ~7.95 bits/byte over a 4 KiB sample;
+// text and most binaries stay well below this
+static constexpr double kIncompressibleBits = 7.5;
+
+bool looks_incompressible(std::string_view data) {
+    if (data.size() < kMinProbeBytes) return false;
+    const std::size_t n = std::min(data.size(), kProbeBytes);
+
+    std::uint32_t counts[256] = {};
+    for (std::size_t i = 0; i < n; ++i) ++counts[static_cast<unsigned char>(data[i])];
+
+    double bits = 0;
+    for (std::uint32_t c : counts) {
+        if (c == 0) continue;
+        const double p = static_cast<double>(c) / static_cast<double>(n);
+        bits -= p * std::log2(p);
+    }
+    return bits >= kIncompressibleBits;
+}
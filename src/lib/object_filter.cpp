@@ -0,0 +1,123 @@
+#include "object_filter.hpp"
+
+#include "byte_order.hpp"
+#include "file_util.hpp"
+#include "hash.hpp"
+
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <stdexcept>
+#include <string>
+#include <unistd.h>
+
+static constexpr char kMagic[4] = {'O', 'F', 'L', 'T'};
+static constexpr std::uint8_t kVersion = 1;
+static constexpr unsigned kMinBitsLog2 = 16;
+static constexpr unsigned kMaxBitsLog2 = 40;
+
+// Two independent 64-bit values straight from the OID; the i-th probe is
+// h1 + i * h2 (double hashing). h2 is odd so the probes never collapse.
+static void oid_hashes(const Oid& oid, std::uint64_t& h1, std::uint64_t& h2) {
+    std::memcpy(&h1, oid.bytes, 8);
+    std::memcpy(&h2, oid.bytes + 8, 8);
+    h2 |= 1;
+}
+
+static unsigned bits_log2_for(std::size_t capacity) {
+    unsigned b = kMinBitsLog2;
+    while (b < kMaxBitsLog2 && (std::uint64_t{1} << b) < std::uint64_t{capacity} * ObjectFilter::kBitsPerEntry) ++b;
+    return b;
+}
+
+// The capacity is rounded up to what the bit count supports
+ObjectFilter::ObjectFilter(std::size_t capacity)
+    : ObjectFilter(bits_log2_for(capacity), (std::size_t{1} << bits_log2_for(capacity)) / kBitsPerEntry) {}
+
+ObjectFilter::ObjectFilter(unsigned bits_log2, std::size_t capacity)
+    : bits_log2_(bits_log2),
+      capacity_(capacity),
+      words_(std::make_unique<std::atomic<std::uint64_t>[]>((std::size_t{1} << bits_log2) / 64)) {}
+
+void ObjectFilter::add(const Oid& oid) {
+    std::uint64_t h1, h2;
+    oid_hashes(oid, h1, h2);
+    const std::uint64_t mask = (std::uint64_t{1} << bits_log2_) - 1;
+    for (unsigned i = 0; i < kHashes; ++i) {
+        const std::uint64_t bit = (h1 + i * h2) & mask;
+        words_[bit >> 6].fetch_or(std::uint64_t{1} << (bit & 63), std::memory_order_relaxed);
+    }
+    count_.fetch_add(1, std::memory_order_relaxed);
+}
+
+bool ObjectFilter::may_contain(const Oid& oid) const {
+    std::uint64_t h1, h2;
+    oid_hashes(oid, h1, h2);
+    const std::uint64_t mask = (std::uint64_t{1} << bits_log2_) - 1;
+    for (unsigned i = 0; i < kHashes; ++i) {
+        const std::uint64_t bit = (h1 + i * h2) & mask;
+        if (!(words_[bit >> 6].load(std::memory_order_relaxed) & (std::uint64_t{1} << (bit & 63)))) {
+            return false;
+        }
+    }
+    return true;
+}
+
+void ObjectFilter::save(const fs::path& file, HashAlgo algo, const Snapshot& snapshot) const {
+    const std::size_t words = (std::size_t{1} << bits_log2_) / 64;
+
+    std::string out(kMagic, sizeof(kMagic));
+    out.push_back(static_cast<char>(kVersion));
+    out.push_back(static_cast<char>(algo));
+    out.push_back(static_cast<char>(bits_log2_));
+    out.push_back('\0');
+    put_be64(out, count());
+    put_be64(out, capacity_);
+    for (std::int64_t m : snapshot.dir_mtime_ns) put_be64(out, static_cast<std::uint64_t>(m));
+    out.append(reinterpret_cast<const char*>(snapshot.packs), hash_len(algo));
+    out.reserve(out.size() + words * 8 + kMaxHashLen);
+    for (std::size_t i = 0; i < words; ++i) put_be64(out, words_[i].load(std::memory_order_relaxed));
+
+    unsigned char digest[kMaxHashLen];
+    Hasher::digest(algo, out.data(), out.size(), digest);
+    out.append(reinterpret_cast<const char*>(digest), hash_len(algo));
+
+    replace_file(file, out);
+}
+
+std::unique_ptr<ObjectFilter> ObjectFilter::load(const fs::path& file, HashAlgo algo, Snapshot& snapshot) {
+    std::ifstream in(file, std::ios::binary);
+    if (!in) return nullptr;
+    const std::string data((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+    const auto* p = reinterpret_cast<const unsigned char*>(data.data());
+
+    const std::size_t hlen = hash_len(algo);
+    const std::size_t header = 8 + 16 + 256 * 8 + hlen;
+    if (data.size() < header + hlen || std::memcmp(p, kMagic, 4) != 0 || p[4] != kVersion ||
+        p[5] != static_cast<unsigned char>(algo) || p[6] < kMinBitsLog2 || p[6] > kMaxBitsLog2) {
+        return nullptr;
+    }
+    const unsigned bits_log2 = p[6];
+    const std::size_t words = (std::size_t{1} << bits_log2) / 64;
+    if (data.size() != header + words * 8 + hlen) return nullptr;
+
+    unsigned char digest[kMaxHashLen];
+    Hasher::digest(algo, data.data(), data.size() - hlen, digest);
+    if (std::memcmp(digest, p + data.size() - hlen, hlen) != 0) return nullptr;
+
+    auto filter = std::unique_ptr<ObjectFilter>(new ObjectFilter(bits_log2, read_be64(p + 16)));
+    filter->count_.store(read_be64(p + 8), std::memory_order_relaxed);
+    const unsigned char* q = p + 24;
+    for (std::int64_t& m : snapshot.dir_mtime_ns) {
+        m = static_cast<std::int64_t>(read_be64(q));
+        q += 8;
+    }
+    std::memset(snapshot.packs, 0, sizeof(snapshot.packs));
+    std::memcpy(snapshot.packs, q, hlen);
+    q += hlen;
+    for (std::size_t i = 0; i < words; ++i, q += 8) {
+        filter->words_[i].store(read_be64(q), std::memory_order_relaxed);
+    }
+    return filter;
+}
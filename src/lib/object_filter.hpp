@@ -0,0 +1,59 @@
+#pragma once
+
+#include "oid.hpp"
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <memory>
+#include <optional>
+
+namespace fs = std::filesystem;
+
+// Bloom filter over object IDs. may_contain() never misses an added OID and
+// answers "definitely absent" for all but ~1% of the others while the
+// filter is within its capacity, which lets lookups for new objects skip
+// stat(). OIDs are already uniformly distributed, so their own bytes serve
+// as the hash values. add() and may_contain() may run concurrently.
+class ObjectFilter {
+public:
+    static constexpr unsigned kHashes = 7;
+    static constexpr unsigned kBitsPerEntry = 10; // ~1% false positives
+
+    // What the filter was built from, used to bring a persisted filter up
+    // to date: the mtime of every loose fan-out directory when it was
+    // scanned (-1 when missing, 0 to force a rescan) and a digest of the
+    // pack names.
+    struct Snapshot {
+        std::int64_t dir_mtime_ns[256] = {};
+        unsigned char packs[kMaxHashLen] = {};
+    };
+
+    // Sized for at least `capacity` OIDs.
+    explicit ObjectFilter(std::size_t capacity);
+
+    void add(const Oid& oid);
+    bool may_contain(const Oid& oid) const;
+
+    std::size_t count() const { return count_.load(std::memory_order_relaxed); }
+    std::size_t capacity() const { return capacity_; }
+    // Past capacity the false-positive rate climbs; rebuild bigger
+    bool full() const { return count() > capacity_; }
+
+    // File layout ("objects/info/object-filter"):
+    //   "OFLT" | version | hash algo | bits log2 | count | capacity
+    //   | snapshot dir mtimes[256] | snapshot pack digest | bit words
+    //   | hash of everything before it
+    void save(const fs::path& file, HashAlgo algo, const Snapshot& snapshot) const;
+    // nullptr when the file is missing, corrupt or for another hash
+    static std::unique_ptr<ObjectFilter> load(const fs::path& file, HashAlgo algo, Snapshot& snapshot);
+
+private:
+    ObjectFilter(unsigned bits_log2, std::size_t capacity);
+
+    unsigned bits_log2_;
+    std::size_t capacity_;
+    std::unique_ptr<std::atomic<std::uint64_t>[]> words_;
+    std::atomic<std::size_t> count_{0};
+};
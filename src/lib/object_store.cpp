@@ -1,48 +1,477 @@
 #include "object_store.hpp"
 
-#include "zstr.hpp"
+#include "config.hpp"
+#include "delta.hpp"
+#include "file_util.hpp"
+#include "hash.hpp"
+#include "multi_pack_index.hpp"
+#include "pack.hpp"
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <ctime>
+#include <fcntl.h>
 #include <filesystem>
 #include <fstream>
-#include <openssl/sha.h>
-#include <zlib.h>
+#include <iterator>
+#include <sys/stat.h>
+#include <unistd.h>
+
+static constexpr std::size_t kStreamChunk = 128 * 1024;
+
+// Loose files up to this size are read whole and decompressed in one call;
+// larger ones are streamed so memory stays bounded by the payload
+static constexpr std::size_t kWholeReadLimit = 1u << 20;
+
+// Lookups answered by stat() before the existence filter is built; a
+// handful of lookups is cheaper than scanning the store
+static constexpr std::uint32_t kFilterAfterLookups = 1024;
+// Directories modified this recently may still change within the same
+// mtime tick; their snapshot entry forces a rescan on the next load
+static constexpr std::int64_t kRacyMtimeNs = 2'000'000'000;
+
+ObjectStore::ObjectStore(std::unique_ptr<IObjectCodec> codec, fs::path repo_root)
+    : codec_(std::move(codec)), root_(std::move(repo_root)) {
+    // objects/ lives directly under .git
+    const Config config = Config::load(root_.parent_path() / "config");
+    if (auto format = config.get("extensions.objectFormat")) {
+        auto algo = hash_algo_from_name(*format);
+        if (!algo) throw std::runtime_error("unknown extensions.objectFormat: " + *format);
+        algo_ = *algo;
+    }
+
+    // Git's precedence: core.looseCompression / pack.compression, then
+    // core.compression
+    const auto level = [&](std::string_view key) -> std::optional<int> {
+        auto v = config.get_int(key);
+        if (!v) return std::nullopt;
+        if (*v < -1 || *v > 9) {
+            throw std::runtime_error("bad zlib compression level " + std::to_string(*v) + " for " +
+                                     std::string(key));
+        }
+        return static_cast<int>(*v);
+    };
+    const int core = level("core.compression").value_or(kDefaultLevel);
+    loose_level_ = level("core.looseCompression").value_or(core);
+    pack_level_ = level("pack.compression").value_or(core);
+
+    const long long cache_limit =
+        config.get_int("core.objectCacheLimit").value_or(static_cast<long long>(ObjectCache::kDefaultLimit));
+    if (cache_limit < 0) {
+        throw std::runtime_error("bad core.objectCacheLimit: " + std::to_string(cache_limit));
+    }
+    object_cache_ = std::make_unique<ObjectCache>(static_cast<std::size_t>(cache_limit));
+
+    if (auto midx = config.get("core.multiPackIndex")) {
+        use_midx_ = !(*midx == "false" || *midx == "no" || *midx == "off" || *midx == "0");
+    }
+
+    if (auto mode = config.get("core.objectFilter")) {
+        if (*mode == "persist") {
+            filter_mode_ = FilterMode::Persist;
+        } else if (*mode == "false" || *mode == "no" || *mode == "off" || *mode == "0") {
+            filter_mode_ = FilterMode::Off;
+        } else if (*mode != "true" && *mode != "yes" && *mode != "on" && *mode != "1") {
+            throw std::runtime_error("bad core.objectFilter: " + *mode);
+        }
+    }
+
+    // Objects written under a different core.objectCodec stay readable
+    if (!codec_->zlib_compatible()) read_codecs_.push_back(make_zlib_codec());
+    if (std::string_view(codec_->name()) != "zstd" && codec_available("zstd")) {
+        read_codecs_.push_back(make_codec("zstd"));
+    }
+}
 
+const IObjectCodec& ObjectStore::codec_for(std::string_view prefix) const {
+    if (codec_->recognizes(prefix)) return *codec_;
+    for (const auto& c : read_codecs_) {
+        if (c->recognizes(prefix)) return *c;
+    }
+    throw std::runtime_error("loose object in an unknown compression format");
+}
 
-static std::string zlib_compress(const unsigned char* data, size_t len, int level = Z_DEFAULT_COMPRESSION) {
-    auto cap = compressBound(len);        // upper bound for compressed size
-    std::string out;
-    out.resize(cap);
+const IObjectCodec& ObjectStore::pack_codec() const {
+    if (codec_->zlib_compatible()) return *codec_;
+    for (const auto& c : read_codecs_) {
+        if (c->zlib_compatible()) return *c;
+    }
+    throw std::runtime_error("no zlib codec for packs");
+}
 
-    int ret = compress2(reinterpret_cast<Bytef*>(&out[0]), &cap,
-                        reinterpret_cast<const Bytef*>(data), len, level);
-    if (ret != Z_OK) throw std::runtime_error("zlib compress2 failed");
-    out.resize(cap);
-    return out;
+ObjectStore::~ObjectStore() {
+    if (filter_mode_ != FilterMode::Persist || !filter_ || !filter_dirty_) return;
+    try {
+        std::filesystem::create_directories(root_ / "info");
+        filter_->save(root_ / "info" / "object-filter", algo_, filter_snapshot_);
+    } catch (const std::exception&) {
+        // Only a cache; the next run rebuilds it
+    }
 }
 
-Oid ObjectStore::compute_oid(std::string_view object_bytes) {
+Oid ObjectStore::compute_oid(std::string_view object_bytes, HashAlgo algo) {
     Oid oid{};
+    oid.algo = algo;
+    Hasher::digest(algo, object_bytes.data(), object_bytes.size(), oid.bytes);
+    return oid;
+}
 
-    SHA1(
-        reinterpret_cast<const unsigned char*>(object_bytes.data()), 
-        static_cast<const unsigned long>(object_bytes.size()), 
-        oid.bytes
-    );
+// Hashes "blob <size>\0" + the contents of `file` chunk by chunk. When
+// `out_fd` is valid, the same bytes are deflated into it as a loose object,
+// at `level` unless the first chunk looks incompressible.
+static Oid stream_blob(const fs::path& file, int out_fd, std::size_t& size_out, HashAlgo algo,
+                       const IObjectCodec* codec, int level) {
+    const int in_fd = ::open(file.c_str(), O_RDONLY | O_CLOEXEC);
+    if (in_fd < 0) {
+        throw std::runtime_error("could not open file: " + file.string());
+    }
+    struct Guard {
+        int fd;
+        ~Guard() { ::close(fd); }
+    } guard{in_fd};
+
+    struct stat st{};
+    if (::fstat(in_fd, &st) != 0) {
+        throw std::runtime_error("stat failed: " + file.string());
+    }
+    const auto size = static_cast<std::size_t>(st.st_size);
+    size_out = size;
+
+    std::unique_ptr<StreamEncoder> enc;
+    std::vector<unsigned char> in(kStreamChunk);
+    Hasher md(algo);
+
+    const std::string header = "blob " + std::to_string(size) + '\0';
+    md.update(reinterpret_cast<const unsigned char*>(header.data()), header.size());
+
+    const auto sink = [&](std::string_view out) {
+        write_all(out_fd, reinterpret_cast<const unsigned char*>(out.data()), out.size());
+    };
+    auto feed = [&](const unsigned char* p, std::size_t len, bool finish) {
+        md.update(p, len);
+        if (out_fd < 0) return;
+        const std::string_view chunk(reinterpret_cast<const char*>(p), len);
+        if (!enc) {
+            // The first chunk of content decides the level
+            enc = codec->encoder(level_for(chunk, level));
+            enc->write(header, false, sink);
+        }
+        enc->write(chunk, finish, sink);
+    };
+
+    std::size_t total = 0;
+    while (true) {
+        const ssize_t n = ::read(in_fd, in.data(), in.size());
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            throw std::runtime_error("read failed: " + file.string());
+        }
+        if (n == 0) break;
+        total += static_cast<std::size_t>(n);
+        if (total > size) break;
+        feed(in.data(), static_cast<std::size_t>(n), false);
+    }
+    if (total != size) {
+        throw std::runtime_error("file changed while hashing: " + file.string());
+    }
+    feed(nullptr, 0, true);
 
+    Oid oid{};
+    oid.algo = algo;
+    md.finish(oid.bytes);
     return oid;
 }
 
 // Private methods
 std::filesystem::path ObjectStore::loose_path_for(const Oid& oid) const {
-    const std::string hex = oid.to_hex();
-    return root_ / hex.substr(0, 2) / hex.substr(2);
+    // "ab/cdef..." spelled straight into a stack buffer
+    char rel[kMaxHashLen * 2 + 1];
+    hex_encode(oid.bytes, 1, rel);
+    rel[2] = '/';
+    hex_encode(oid.bytes + 1, oid.size() - 1, rel + 3);
+    return root_ / std::string_view(rel, 2 * oid.size() + 1);
 }
 
 std::filesystem::path ObjectStore::objects_dir_for(const Oid& oid) const {
-    const std::string hex = oid.to_hex();
-    return root_ / hex.substr(0, 2);
+    char dir[2];
+    hex_encode(oid.bytes, 1, dir);
+    return root_ / std::string_view(dir, 2);
+}
+
+void ObjectStore::prepare_packs() const {
+    if (packs_prepared_.load(std::memory_order_acquire)) return;
+    std::lock_guard<std::mutex> lock(packs_mu_);
+    if (packs_prepared_.load(std::memory_order_relaxed)) return;
+
+    // Published once the list is complete; readers skip the lock after that
+    struct Publish {
+        std::atomic<bool>& flag;
+        ~Publish() { flag.store(true, std::memory_order_release); }
+    } publish{packs_prepared_};
+
+    const fs::path pack_dir = root_ / "pack";
+    std::error_code ec;
+    if (!std::filesystem::is_directory(pack_dir, ec)) return;
+
+    for (const auto& entry : std::filesystem::directory_iterator(pack_dir, ec)) {
+        const fs::path& idx = entry.path();
+        if (idx.extension() != ".idx") continue;
+
+        fs::path pack = idx;
+        pack.replace_extension(".pack");
+        if (!std::filesystem::exists(pack)) continue;
+
+        packs_.push_back(std::make_unique<PackFile>(pack, idx, windows_, algo_));
+    }
+
+    // The multi-pack-index is only used when every pack it names is there
+    if (use_midx_) midx_ = MultiPackIndex::open(pack_dir / "multi-pack-index", algo_);
+    std::vector<char> covered(packs_.size());
+    if (midx_) {
+        for (const std::string& name : midx_->pack_names()) {
+            auto it = std::find_if(packs_.begin(), packs_.end(),
+                                   [&](const auto& p) { return p->path().stem().string() + ".idx" == name; });
+            if (it == packs_.end()) {
+                midx_.reset();
+                midx_packs_.clear();
+                break;
+            }
+            midx_packs_.push_back(it->get());
+            covered[static_cast<std::size_t>(it - packs_.begin())] = 1;
+        }
+    }
+    for (std::size_t i = 0; i < packs_.size(); ++i) {
+        if (!midx_ || !covered[i]) unindexed_packs_.push_back(packs_[i].get());
+    }
+}
+
+bool ObjectStore::find_packed(const Oid& oid, PackFile*& pack, std::uint64_t& offset) const {
+    prepare_packs();
+    if (midx_) {
+        if (auto loc = midx_->find(oid)) {
+            pack = midx_packs_[loc->pack];
+            offset = loc->offset;
+            return true;
+        }
+    }
+    for (PackFile* p : unindexed_packs_) {
+        if (auto off = p->index().find(oid)) {
+            pack = p;
+            offset = *off;
+            return true;
+        }
+    }
+    return false;
+}
+
+ReadObjectResult ObjectStore::read_packed(PackFile& pack, std::uint64_t offset) const {
+    // Walk down the delta chain until a cached or full base, then replay the
+    // deltas; every intermediate result is a base for the entry above it
+    struct Link {
+        PackFile* pack;
+        std::uint64_t offset;
+        std::string delta;
+    };
+    std::vector<Link> chain;
+    PackFile* cur_pack = &pack;
+    std::uint64_t cur = offset;
+
+    std::string type;
+    std::string content;
+    bool base_cacheable = true;
+
+    while (true) {
+        if (chain.size() > 10000) {
+            throw std::runtime_error("pack: delta chain too long");
+        }
+
+        // The requested entry itself is only looked up, never inserted
+        if (const auto hit = delta_bases_.get(cur_pack, cur)) {
+            type = hit->type;
+            content = hit->content;
+            base_cacheable = false; // already cached
+            break;
+        }
+
+        PackEntryHeader h = cur_pack->read_entry_header(cur);
+        if (h.type == PackObjectType::OfsDelta) {
+            chain.push_back(Link{cur_pack, cur, cur_pack->inflate_at(h.data_offset, h.size)});
+            cur = h.base_offset;
+            continue;
+        }
+        if (h.type == PackObjectType::RefDelta) {
+            chain.push_back(Link{cur_pack, cur, cur_pack->inflate_at(h.data_offset, h.size)});
+            if (find_packed(h.base_oid, cur_pack, cur)) continue;
+
+            auto base = read_object(h.base_oid);
+            if (!base) {
+                throw std::runtime_error("pack: missing REF_DELTA base " + h.base_oid.to_hex());
+            }
+            type = std::move(base->type);
+            content = std::move(base->content);
+            base_cacheable = false; // loose base: no (pack, offset) key
+            break;
+        }
+
+        type = pack_type_name(h.type);
+        content = cur_pack->inflate_at(h.data_offset, h.size);
+        break;
+    }
+
+    if (!chain.empty() && base_cacheable) {
+        delta_bases_.put(cur_pack, cur, type, content);
+    }
+    for (auto it = chain.rbegin(); it != chain.rend(); ++it) {
+        content = apply_delta(content, it->delta);
+        if (std::next(it) != chain.rend()) {
+            delta_bases_.put(it->pack, it->offset, type, content);
+        }
+    }
+
+    const std::size_t size = content.size();
+    return ReadObjectResult{std::move(type), size, std::move(content)};
 }
 
 // Public methods
+void ObjectStore::reprepare_packs() {
+    delta_bases_.clear(); // keyed by PackFile pointers
+    midx_packs_.clear();
+    unindexed_packs_.clear();
+    midx_.reset();
+    packs_.clear();
+    packs_prepared_ = false;
+
+    std::unique_lock<std::shared_mutex> lock(filter_mu_);
+    filter_.reset();
+}
+
+// mtime of fan-out directory `dir` in ns, -1 when it does not exist; stamps
+// too recent to be trusted become 0, which never matches
+static std::int64_t fanout_mtime(const fs::path& dir) {
+    struct stat st{};
+    if (::stat(dir.c_str(), &st) != 0) return -1;
+    const std::int64_t m = std::int64_t(st.st_mtim.tv_sec) * 1'000'000'000 + st.st_mtim.tv_nsec;
+    timespec now{};
+    ::clock_gettime(CLOCK_REALTIME, &now);
+    const std::int64_t now_ns = std::int64_t(now.tv_sec) * 1'000'000'000 + now.tv_nsec;
+    return now_ns - m < kRacyMtimeNs ? 0 : m;
+}
+
+// Appends the OIDs of the loose objects in fan-out directory `byte`
+static void scan_fanout(const fs::path& dir, unsigned byte, HashAlgo algo, std::vector<Oid>& out) {
+    std::error_code ec;
+    for (const auto& file : std::filesystem::directory_iterator(dir, ec)) {
+        const std::string name = file.path().filename().string();
+        if (name.size() != hash_len(algo) * 2 - 2) continue;
+        Oid oid{};
+        oid.algo = algo;
+        oid.bytes[0] = static_cast<unsigned char>(byte);
+        if (hex_decode(name.data(), oid.size() - 1, oid.bytes + 1)) out.push_back(oid);
+    }
+}
+
+void ObjectStore::build_filter() const {
+    prepare_packs();
+
+    // Digest of the pack names: a persisted filter that saw the same packs
+    // already holds their OIDs
+    std::vector<std::string> pack_names;
+    for (const auto& p : packs_) pack_names.push_back(p->path().filename().string());
+    std::sort(pack_names.begin(), pack_names.end());
+    Hasher packs_md(algo_);
+    for (const auto& n : pack_names) packs_md.update(n.data(), n.size() + 1); // with the NUL
+    unsigned char packs_digest[kMaxHashLen] = {};
+    packs_md.finish(packs_digest);
+
+    auto add_packs = [&](auto&& add) {
+        for (const auto& p : packs_) {
+            const PackIndex& idx = p->index();
+            for (std::uint32_t i = 0; i < idx.count(); ++i) add(idx.oid_at(i));
+        }
+    };
+
+    ObjectFilter::Snapshot snap;
+    const fs::path file = root_ / "info" / "object-filter";
+    std::unique_ptr<ObjectFilter> f;
+    if (filter_mode_ == FilterMode::Persist) f = ObjectFilter::load(file, algo_, snap);
+
+    char dir[2];
+    if (f) {
+        // Catch up with whatever changed since the filter was saved
+        bool changed = false;
+        std::vector<Oid> found;
+        for (unsigned b = 0; b < 256; ++b) {
+            hex_encode(reinterpret_cast<const unsigned char*>(&b), 1, dir);
+            const fs::path d = root_ / std::string_view(dir, 2);
+            const std::int64_t m = fanout_mtime(d);
+            if (m == snap.dir_mtime_ns[b] && m != 0) continue;
+            scan_fanout(d, b, algo_, found);
+            snap.dir_mtime_ns[b] = m;
+            changed = true;
+        }
+        for (const Oid& oid : found) f->add(oid);
+        if (std::memcmp(snap.packs, packs_digest, sizeof(packs_digest)) != 0) {
+            add_packs([&](const Oid& oid) { f->add(oid); });
+            std::memcpy(snap.packs, packs_digest, sizeof(packs_digest));
+            changed = true;
+        }
+        if (changed) filter_dirty_ = true;
+        if (f->full()) f.reset();
+    }
+
+    if (!f) {
+        // mtimes are taken before each directory is read, so anything added
+        // during the scan shows up as a changed directory next time
+        std::vector<Oid> oids;
+        for (unsigned b = 0; b < 256; ++b) {
+            hex_encode(reinterpret_cast<const unsigned char*>(&b), 1, dir);
+            const fs::path d = root_ / std::string_view(dir, 2);
+            snap.dir_mtime_ns[b] = fanout_mtime(d);
+            scan_fanout(d, b, algo_, oids);
+        }
+        add_packs([&](const Oid& oid) { oids.push_back(oid); });
+        std::memcpy(snap.packs, packs_digest, sizeof(packs_digest));
+
+        // Room to keep growing for a while before the next rebuild
+        f = std::make_unique<ObjectFilter>(2 * oids.size());
+        for (const Oid& oid : oids) f->add(oid);
+        filter_dirty_ = true;
+    }
+
+    filter_ = std::move(f);
+    filter_snapshot_ = snap;
+}
+
+bool ObjectStore::filter_excludes(const Oid& oid) const {
+    if (filter_mode_ == FilterMode::Off) return false;
+    {
+        std::shared_lock<std::shared_mutex> lock(filter_mu_);
+        if (filter_ && !filter_->full()) return !filter_->may_contain(oid);
+        // A persisted filter is cheap to load, so it is used right away
+        if (!filter_ && filter_mode_ == FilterMode::Memory &&
+            filter_lookups_.fetch_add(1, std::memory_order_relaxed) < kFilterAfterLookups) {
+            return false;
+        }
+    }
+    std::unique_lock<std::shared_mutex> lock(filter_mu_);
+    if (!filter_ || filter_->full()) build_filter();
+    return !filter_->may_contain(oid);
+}
+
+bool ObjectStore::already_stored(const Oid& oid, const fs::path& file) const {
+    if (filter_excludes(oid)) return false; // covers packs as well
+    PackFile* pack = nullptr;
+    std::uint64_t offset = 0;
+    return find_packed(oid, pack, offset) || std::filesystem::exists(file);
+}
+
+void ObjectStore::filter_note(const Oid& oid) {
+    std::shared_lock<std::shared_mutex> lock(filter_mu_);
+    if (!filter_) return; // built from the store later, which includes `oid`
+    filter_->add(oid);
+    filter_dirty_ = true;
+}
+
 ParsedHeader ObjectStore::parse_header(std::string_view object_bytes) {
     const std::size_t sp = object_bytes.find(' ');
     if (sp == std::string_view::npos) {
@@ -80,41 +509,178 @@ ParsedHeader ObjectStore::parse_header(std::string_view object_bytes) {
 
 PutObjectResult ObjectStore::put_object_if_absent(std::string_view object_bytes) {
     ParsedHeader h = ObjectStore::parse_header(object_bytes);
-    const Oid oid = ObjectStore::compute_oid(object_bytes);
+    const Oid oid = ObjectStore::compute_oid(object_bytes, algo_);
 
-    // Write the object to the store
-    auto dir = objects_dir_for(oid);
-    auto file = loose_path_for(oid);
-    
     // The object has already been created
-    if(std::filesystem::exists(file)) {
+    if (!write_loose(oid, object_bytes)) {
         return PutObjectResult{oid, false, h.type, h.size};
     }
-    
-    // Store the object
-    std::filesystem::create_directories(dir);
-    
-    std::string compressed = zlib_compress(
-            reinterpret_cast<const unsigned char*>(object_bytes.data()), 
-            object_bytes.size());
-    std::filesystem::path tmp = file;
-    tmp += ".tmp";
+    return PutObjectResult{oid, true, h.type, h.size};
+}
 
-    {
-        std::ofstream out(tmp, std::ios_base::binary);
-        if(!out) throw std::runtime_error("cannot open tmp object for write");
+std::vector<PutObjectResult> ObjectStore::put_objects_if_absent(const std::vector<std::string_view>& objects) {
+    std::vector<ParsedHeader> headers;
+    headers.reserve(objects.size());
+    for (std::string_view bytes : objects) headers.push_back(parse_header(bytes));
+
+    std::vector<Oid> oids(objects.size());
+    if (algo_ == HashAlgo::Sha1) {
+        std::vector<unsigned char[kSha1Len]> digests(objects.size());
+        sha1_many(objects.data(), objects.size(), digests.data());
+        for (std::size_t i = 0; i < objects.size(); ++i) oids[i] = Oid::from_raw(digests[i], algo_);
+    } else {
+        for (std::size_t i = 0; i < objects.size(); ++i) oids[i] = compute_oid(objects[i], algo_);
+    }
 
-        out.write(compressed.data(), compressed.size());
+    std::vector<PutObjectResult> results;
+    results.reserve(objects.size());
+    for (std::size_t i = 0; i < objects.size(); ++i) {
+        const Oid& oid = oids[i];
+        const bool inserted = write_loose(oid, objects[i]);
+        results.push_back(PutObjectResult{oid, inserted, headers[i].type, headers[i].size});
+    }
+    return results;
+}
 
-        if (!out) throw std::runtime_error("write failed");
-        out.close();
+bool ObjectStore::write_loose(const Oid& oid, std::string_view object_bytes) {
+    auto file = loose_path_for(oid);
+    if (already_stored(oid, file)) return false;
+
+    ensure_fanout_dir(oid);
+
+    const std::string_view payload = object_bytes.substr(object_bytes.find('\0') + 1);
+    const std::string compressed = codec_->compress(object_bytes, level_for(payload, loose_level_));
+    // Threads adding identical content race for the same object, so every
+    // writer gets its own temp file and publish_loose() lets only one win
+    std::string tmp = file.string() + ".tmp_XXXXXX";
+    int fd = ::mkstemp(tmp.data());
+    if (fd < 0 && errno == ENOENT) {
+        ensure_fanout_dir(oid, true);
+        tmp = file.string() + ".tmp_XXXXXX";
+        fd = ::mkstemp(tmp.data());
+    }
+    if (fd < 0) throw std::runtime_error("cannot open tmp object for write");
+    try {
+        write_all(fd, reinterpret_cast<const unsigned char*>(compressed.data()), compressed.size());
+        ::fchmod(fd, 0444);
+        if (::close(fd) != 0) throw std::runtime_error("write failed");
+    } catch (...) {
+        ::close(fd);
+        ::unlink(tmp.c_str());
+        throw;
     }
 
-    std::filesystem::rename(tmp, file);
-    return PutObjectResult{oid, true, h.type, h.header_len};
+    filter_note(oid);
+    return publish_loose(oid, tmp, file);
+}
+
+void ObjectStore::ensure_fanout_dir(const Oid& oid, bool recheck) {
+    std::atomic<bool>& ready = fanout_ready_[oid.bytes[0]];
+    if (!recheck && ready.load(std::memory_order_relaxed)) return;
+
+    const fs::path dir = objects_dir_for(oid);
+    if (::mkdir(dir.c_str(), 0777) != 0 && errno != EEXIST) {
+        if (errno != ENOENT) {
+            throw std::runtime_error("cannot create " + dir.string() + ": " + std::strerror(errno));
+        }
+        std::filesystem::create_directories(dir); // objects/ itself is missing
+    }
+    ready.store(true, std::memory_order_relaxed);
+}
+
+bool ObjectStore::publish_loose(const Oid& oid, const std::string& tmp, const fs::path& dest) {
+    int rc = ::link(tmp.c_str(), dest.c_str());
+    if (rc != 0 && errno == ENOENT) {
+        try {
+            ensure_fanout_dir(oid, true);
+        } catch (...) {
+            ::unlink(tmp.c_str());
+            throw;
+        }
+        rc = ::link(tmp.c_str(), dest.c_str());
+    }
+    if (rc == 0) {
+        ::unlink(tmp.c_str());
+        return true;
+    }
+    const int err = errno;
+    if (err == EEXIST) {
+        // Same OID, same content: the other writer's copy is as good as ours
+        ::unlink(tmp.c_str());
+        return false;
+    }
+    // File systems without hard links: rename() may replace a concurrent
+    // writer's identical file, which readers cannot tell apart
+    if (::rename(tmp.c_str(), dest.c_str()) != 0) {
+        const int rename_err = errno;
+        ::unlink(tmp.c_str());
+        throw std::runtime_error("cannot publish " + dest.string() + ": " + std::strerror(rename_err));
+    }
+    return true;
+}
+
+PutObjectResult ObjectStore::put_blob_from_file(const fs::path& file) {
+    // The OID is only known at the end, so deflate into a uniquely named
+    // temp file at the top of the store and move it into place afterwards
+    std::string tmp = (root_ / "tmp_obj_XXXXXX").string();
+    const int fd = ::mkstemp(tmp.data());
+    if (fd < 0) {
+        throw std::runtime_error("cannot create temp object in " + root_.string());
+    }
+
+    Oid oid{};
+    std::size_t size = 0;
+    try {
+        oid = stream_blob(file, fd, size, algo_, codec_.get(), loose_level_);
+        ::fchmod(fd, 0444); // mkstemp creates 0600; objects are read-only
+        if (::close(fd) != 0) throw std::runtime_error("close failed: " + tmp);
+    } catch (...) {
+        ::close(fd);
+        ::unlink(tmp.c_str());
+        throw;
+    }
+
+    const auto dest = loose_path_for(oid);
+    if (already_stored(oid, dest)) {
+        ::unlink(tmp.c_str());
+        return PutObjectResult{oid, false, "blob", size};
+    }
+    try {
+        ensure_fanout_dir(oid);
+    } catch (...) {
+        ::unlink(tmp.c_str());
+        throw;
+    }
+    filter_note(oid);
+    const bool inserted = publish_loose(oid, tmp, dest);
+    return PutObjectResult{oid, inserted, "blob", size};
+}
+
+Oid ObjectStore::hash_blob_file(const fs::path& file, HashAlgo algo) {
+    std::size_t size = 0;
+    return stream_blob(file, -1, size, algo, nullptr, kDefaultLevel);
 }
 
 std::optional<ReadObjectResult> ObjectStore::read_object(const Oid& oid) const {
+    if (!object_cache_->enabled()) return read_object_uncached(oid);
+    if (auto hit = object_cache_->get(oid)) {
+        return ReadObjectResult{hit->type, hit->content.size(), hit->content};
+    }
+    auto obj = read_object_uncached(oid);
+    if (obj && object_cache_->admits(obj->type, obj->content.size())) {
+        object_cache_->put(oid, obj->type, obj->content);
+    }
+    return obj;
+}
+
+std::optional<ReadObjectResult> ObjectStore::read_object_uncached(const Oid& oid) const {
+    // 0. Packed objects take precedence over loose ones
+    PackFile* pack = nullptr;
+    std::uint64_t offset = 0;
+    if (find_packed(oid, pack, offset)) {
+        return read_packed(*pack, offset);
+    }
+
     // 1. Compute loose object path from OID
     auto file = loose_path_for(oid);
 
@@ -123,31 +689,138 @@ std::optional<ReadObjectResult> ObjectStore::read_object(const Oid& oid) const {
         return std::nullopt;
     }
 
-    // 3. Read compressed bytes
-    zstr::ifstream in(file, std::ios::binary);
-    if (!in) {
+    // 3. Small files: one whole-buffer decompress, header included
+    const int fd = ::open(file.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
         throw std::runtime_error("cannot open object for read: " + file.string());
     }
-    std::string object_bytes((std::istreambuf_iterator<char>(in)),
-                           std::istreambuf_iterator<char>());
+    struct stat st{};
+    if (::fstat(fd, &st) == 0 && static_cast<std::size_t>(st.st_size) <= kWholeReadLimit) {
+        std::string raw(static_cast<std::size_t>(st.st_size), '\0');
+        std::size_t got = 0;
+        while (got < raw.size()) {
+            const ssize_t n = ::read(fd, raw.data() + got, raw.size() - got);
+            if (n < 0 && errno == EINTR) continue;
+            if (n <= 0) break;
+            got += static_cast<std::size_t>(n);
+        }
+        ::close(fd);
+        raw.resize(got);
 
-    
+        std::string data = codec_for(raw).decompress(raw);
+        const ParsedHeader h = parse_header(data);
+        if (data.size() != h.header_len + h.size) {
+            throw std::runtime_error("invalid object: size mismatch: " + file.string());
+        }
+        data.erase(0, h.header_len);
+        return ReadObjectResult{h.type, h.size, std::move(data)};
+    }
 
-    // 5. Parse header (type, size, header_len)
-    ParsedHeader h = ObjectStore::parse_header(object_bytes);
+    // 4. Large files: decode the header, then stream the payload into place
+    auto in = open_loose(file, fd);
+    std::string content(in->size(), '\0');
+    std::size_t done = 0;
+    while (done < content.size()) {
+        done += in->read(content.data() + done, content.size() - done);
+    }
+    return ReadObjectResult{in->type(), in->size(), std::move(content)};
+}
+
+std::unique_ptr<LooseObjectReader> ObjectStore::open_loose(const fs::path& file, int fd) const {
+    if (fd < 0) fd = ::open(file.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        throw std::runtime_error("cannot open object for read: " + file.string());
+    }
+    // Sniff the format from the first bytes, then hand the fd over from
+    // the start of the file
+    char magic[4];
+    const ssize_t n = ::pread(fd, magic, sizeof(magic), 0);
+    std::unique_ptr<StreamDecoder> decoder;
+    try {
+        decoder = codec_for(std::string_view(magic, n > 0 ? static_cast<std::size_t>(n) : 0)).decoder();
+    } catch (...) {
+        ::close(fd);
+        throw;
+    }
+    return std::make_unique<LooseObjectReader>(file, fd, std::move(decoder));
+}
 
-    // 6. Slice out the raw content
-    std::string content(object_bytes.substr(h.header_len));
+std::optional<ObjectStream> ObjectStore::open_object(const Oid& oid) const {
+    if (object_cache_->enabled()) {
+        if (auto hit = object_cache_->get(oid)) {
+            return ObjectStream{hit->type, hit->content.size(),
+                                std::make_unique<BufferObjectReader>(hit->content)};
+        }
+    }
+    PackFile* pack = nullptr;
+    std::uint64_t offset = 0;
+    if (find_packed(oid, pack, offset)) {
+        PackEntryHeader h = pack->read_entry_header(offset);
+        if (h.type != PackObjectType::OfsDelta && h.type != PackObjectType::RefDelta) {
+            return ObjectStream{pack_type_name(h.type), h.size,
+                                pack->open_stream(h.data_offset, h.size)};
+        }
+        ReadObjectResult obj = read_packed(*pack, offset);
+        return ObjectStream{std::move(obj.type), obj.size,
+                            std::make_unique<BufferObjectReader>(std::move(obj.content))};
+    }
 
-    // 7. Return structured result
-    return ReadObjectResult{h.type, h.size, std::move(content)};
+    auto file = loose_path_for(oid);
+    if (!std::filesystem::exists(file)) {
+        return std::nullopt;
+    }
+    auto reader = open_loose(file);
+    std::string type = reader->type();
+    const std::size_t size = reader->size();
+    return ObjectStream{std::move(type), size, std::move(reader)};
+}
+
+std::optional<ObjectInfo> ObjectStore::read_object_info(const Oid& oid) const {
+    if (object_cache_->enabled()) {
+        if (auto hit = object_cache_->get(oid)) return ObjectInfo{hit->type, hit->content.size()};
+    }
+    PackFile* pack = nullptr;
+    std::uint64_t offset = 0;
+    if (!find_packed(oid, pack, offset)) {
+        auto file = loose_path_for(oid);
+        if (!std::filesystem::exists(file)) return std::nullopt;
+        auto in = open_loose(file);
+        return ObjectInfo{in->type(), in->size()};
+    }
+
+    PackEntryHeader h = pack->read_entry_header(offset);
+    if (h.type != PackObjectType::OfsDelta && h.type != PackObjectType::RefDelta) {
+        return ObjectInfo{pack_type_name(h.type), h.size};
+    }
+    const std::size_t size = read_delta_sizes(pack->inflate_at(h.data_offset, h.size)).result_size;
+
+    // The type is that of the base at the bottom of the chain
+    for (std::size_t depth = 0;; ++depth) {
+        if (depth > 10000) {
+            throw std::runtime_error("pack: delta chain too long");
+        }
+        if (h.type == PackObjectType::OfsDelta) {
+            offset = h.base_offset;
+        } else if (h.type == PackObjectType::RefDelta) {
+            if (!find_packed(h.base_oid, pack, offset)) {
+                auto base = read_object_info(h.base_oid);
+                if (!base) {
+                    throw std::runtime_error("pack: missing REF_DELTA base " + h.base_oid.to_hex());
+                }
+                return ObjectInfo{std::move(base->type), size};
+            }
+        } else {
+            return ObjectInfo{pack_type_name(h.type), size};
+        }
+        h = pack->read_entry_header(offset);
+    }
 }
 
 std::vector<Oid> ObjectStore::get_all_objects() const {
     std::vector<Oid> oids;
 
     for(const auto& subdir: std::filesystem::directory_iterator(root_)) {
-        if (subdir.is_directory()) continue;
+        if (!subdir.is_directory()) continue;
 
         const std::string dir_name = subdir.path().filename().string();
         if(dir_name.size() != 2) continue;
@@ -155,13 +828,15 @@ std::vector<Oid> ObjectStore::get_all_objects() const {
         for(const auto& file: std::filesystem::directory_iterator(subdir)) {
             if (!file.is_regular_file()) continue;
 
+            // "<2 hex>/<rest>": decode the two halves without concatenating
             const std::string file_name = file.path().filename().string();
-            const std::string hex = dir_name + file_name; // 2 + 38 = 40 chars
+            if (file_name.size() != hash_len(algo_) * 2 - 2) continue;
 
-            if (hex.size() == SHA_DIGEST_LENGTH * 2) {
-                if (auto oid = Oid::from_hex(hex)) {
-                    oids.push_back(*oid);
-                }
+            Oid oid{};
+            oid.algo = algo_;
+            if (hex_decode(dir_name.data(), 1, oid.bytes) &&
+                hex_decode(file_name.data(), oid.size() - 1, oid.bytes + 1)) {
+                oids.push_back(oid);
             }
         }
     }
@@ -169,11 +844,33 @@ std::vector<Oid> ObjectStore::get_all_objects() const {
     return oids;
 }
 
+std::vector<Oid> ObjectStore::get_packed_objects() const {
+    prepare_packs();
+    std::vector<Oid> oids;
+    for (const auto& p : packs_) {
+        const PackIndex& idx = p->index();
+        for (std::uint32_t i = 0; i < idx.count(); ++i) oids.push_back(idx.oid_at(i));
+    }
+    return oids;
+}
+
 bool ObjectStore::has_object(const Oid& oid) const {
+    PackFile* pack = nullptr;
+    std::uint64_t offset = 0;
+    if (find_packed(oid, pack, offset)) return true;
+
     auto file = loose_path_for(oid);
     return std::filesystem::exists(file);
 }
 
+DeltaBaseCache::Stats ObjectStore::delta_base_cache_stats() const {
+    return delta_bases_.stats();
+}
+
+ObjectCache::Stats ObjectStore::object_cache_stats() const {
+    return object_cache_->stats();
+}
+
 const fs::path& ObjectStore::objects_root() const {
   return root_;
 }
@@ -1,14 +1,23 @@
 #pragma once
 
+#include "delta_base_cache.hpp"
+#include "hash.hpp"
 #include "i_object_codec.hpp"
+#include "object_cache.hpp"
+#include "object_filter.hpp"
+#include "object_stream.hpp"
+#include "oid.hpp"
+#include "pack_window.hpp"
 
+#include <atomic>
 #include <cstddef>
+#include <cstdint>
+#include <cstring>
 #include <filesystem>
-#include <iomanip>
 #include <memory>
-#include <openssl/sha.h>
+#include <mutex>
 #include <optional>
-#include <sstream>
+#include <shared_mutex>
 #include <string>
 #include <string_view>
 #include <vector>
@@ -16,48 +25,6 @@
 
 namespace fs = std::filesystem;
 
-struct Oid {
-    unsigned char bytes[SHA_DIGEST_LENGTH];
-
-    bool operator==(const Oid&) const noexcept = default;
-    bool operator!=(const Oid& oid) { return !operator==(oid); }
-
-    std::string to_hex() const {
-        std::ostringstream ss;
-        ss << std::hex << std::setfill('0');
-        for (int i = 0; i < SHA_DIGEST_LENGTH; i++) {
-            ss << std::setw(2) << static_cast<int>(bytes[i] & 0xff); 
-        }
-
-        return ss.str();
-    }
-
-    static std::optional<Oid> from_hex(std::string_view hex) {
-        if (hex.size() != SHA_DIGEST_LENGTH * 2) {
-            return std::nullopt; // must be 40 characters for SHA-1
-        }
-
-        Oid oid{};
-        auto hexval = [](char c) -> int {
-            if ('0' <= c && c <= '9') return c - '0';
-            if ('a' <= c && c <= 'f') return c - 'a' + 10;
-            if ('A' <= c && c <= 'F') return c - 'A' + 10;
-            return -1;
-        };
-
-        for (std::size_t i = 0; i < SHA_DIGEST_LENGTH; ++i) {
-            int hi = hexval(hex[2 * i]);
-            int lo = hexval(hex[2 * i + 1]);
-            if (hi < 0 || lo < 0) {
-                return std::nullopt; // invalid hex digit
-            }
-            oid.bytes[i] = static_cast<unsigned char>((hi << 4) | lo);
-        }
-
-        return oid;
-    }
-};
-
 struct PutObjectResult {
     Oid oid;
     bool inserted;
@@ -72,34 +39,176 @@ struct ReadObjectResult {
     std::string content;
 };
 
+class MultiPackIndex;
+class PackFile;
+
+struct ObjectInfo {
+    std::string type;
+    std::size_t size;
+};
+
 struct ParsedHeader {
     std::string type;     // "blob" | "tree" | "commit"
     std::size_t size;     // content size
     std::size_t header_len; // number of bytes up to and including the NUL
 };
 
+// Loose objects plus the packs under objects/pack. Reads (read_object,
+// open_object, read_object_info, has_object) and the put_* writers may run
+// on several threads, and in several processes, at once; reprepare_packs()
+// must not race with them.
 class ObjectStore {
 public:
     explicit ObjectStore(std::unique_ptr<IObjectCodec> codec,
-                         fs::path repo_root)
-        : codec_(std::move(codec)), root_(std::move(repo_root)) {}
+                         fs::path repo_root);
+    // Saves the existence filter when it is persisted and has changed.
+    ~ObjectStore();
     
+    // Stores the object unless it is already there. Once a process has
+    // stored enough objects, definite misses are answered from an in-memory
+    // Bloom filter over every loose and packed OID, without a stat().
+    // core.objectFilter: true (default), false, or "persist" to keep the
+    // filter in objects/info/object-filter between runs; a persisted filter
+    // is brought up to date on load by rescanning the fan-out directories
+    // whose mtime changed. The filter is a snapshot, but a stale one only
+    // costs a wasted deflate: publishing an object that another process has
+    // stored since reports it as already present.
     PutObjectResult put_object_if_absent(std::string_view);
+
+    // Batched put_object_if_absent: the OIDs are computed together with
+    // sha1_many, which hashes several small objects at once.
+    std::vector<PutObjectResult> put_objects_if_absent(const std::vector<std::string_view>& objects);
+
+    // Stores the contents of `file` as a blob. The file is read in fixed-size
+    // chunks that feed SHA-1 and deflate incrementally into a temp file, so
+    // peak memory does not depend on the file size.
+    PutObjectResult put_blob_from_file(const fs::path& file);
     std::optional<ReadObjectResult> read_object(const Oid&) const;
+
+    // Streaming variant of read_object: decodes the header up front and
+    // inflates the payload as the caller pulls it, in constant memory for
+    // loose and non-delta packed objects. Deltified entries have to be
+    // rebuilt in full before the first byte is available.
+    std::optional<ObjectStream> open_object(const Oid&) const;
+
+    // Type and size only. Deltified pack entries are answered from the entry
+    // headers along the chain plus the size prefix of the top delta, without
+    // rebuilding the object.
+    std::optional<ObjectInfo> read_object_info(const Oid&) const;
   
-    // Existence check
-    bool has_object(const Oid&) const; 
+    // Existence check: the packs, then a stat() of the loose file, so loose
+    // objects that other processes add are seen right away (new packs after
+    // reprepare_packs()).
+    bool has_object(const Oid&) const;
 
     // Get all the objects within ./git/objects
     std::vector<Oid> get_all_objects() const;
+    // OIDs in the packs under objects/pack, once per pack that has them
+    std::vector<Oid> get_packed_objects() const;
     const fs::path& objects_root() const;
 
+    // Hit/miss counters of the cache used while resolving delta chains.
+    DeltaBaseCache::Stats delta_base_cache_stats() const;
+
+    // Hit/miss counters of the decoded-object cache consulted by
+    // read_object, open_object and read_object_info. Its byte budget is
+    // core.objectCacheLimit (32 MiB by default, 0 disables it).
+    ObjectCache::Stats object_cache_stats() const;
+
+    // Drop the cached pack list so that packs written since are picked up.
+    // Packs covered by objects/pack/multi-pack-index are looked up with one
+    // binary search in it (unless core.multiPackIndex is false); packs
+    // written after it are probed one by one.
+    void reprepare_packs();
+
+    // Codec for pack entries: the store's codec when it writes zlib
+    // streams, plain zlib otherwise.
+    const IObjectCodec& pack_codec() const;
+
+    // Compression levels from .git/config on Git's -1..9 scale:
+    // core.looseCompression and pack.compression, each falling back to
+    // core.compression. Incompressible-looking data is stored at level 0
+    // regardless (see level_for()).
+    int loose_compression() const { return loose_level_; }
+    int pack_compression() const { return pack_level_; }
+
+    // Object format of the repository, from extensions.objectFormat in
+    // .git/config (SHA-1 when unset).
+    HashAlgo hash_algo() const { return algo_; }
+
     static ParsedHeader parse_header(std::string_view);
-    static Oid compute_oid(std::string_view);
+    static Oid compute_oid(std::string_view, HashAlgo algo);
+
+    // Blob OID of `file` without storing it, streamed like put_blob_from_file.
+    static Oid hash_blob_file(const fs::path& file, HashAlgo algo);
 private:
+    std::optional<ReadObjectResult> read_object_uncached(const Oid&) const;
+
     fs::path loose_path_for(const Oid& oid) const;
     fs::path objects_dir_for(const Oid& oid) const;
+
+    // Deflates `object_bytes` into the loose file for `oid`; false when the
+    // object is already packed or loose, including when a concurrent writer
+    // got there first.
+    bool write_loose(const Oid& oid, std::string_view object_bytes);
+    // Creates the "ab/" directory of `oid` once per store instead of once per
+    // write; safe to race with other threads and processes. `recheck` drops
+    // the cached answer, for when a prune removed the directory since.
+    void ensure_fanout_dir(const Oid& oid, bool recheck = false);
+    // Moves the finished temp file `tmp` to the loose path of `oid` without
+    // ever replacing an existing file: link() fails with EEXIST when another
+    // writer has published the object, and `tmp` is removed either way.
+    // False when the object was already there.
+    bool publish_loose(const Oid& oid, const std::string& tmp, const fs::path& dest);
+
+    // Loose objects are written with codec_; codec_for() picks whichever
+    // known codec recognizes a stored object's leading bytes.
+    const IObjectCodec& codec_for(std::string_view prefix) const;
+    // Takes ownership of `fd` when given.
+    std::unique_ptr<LooseObjectReader> open_loose(const fs::path& file, int fd = -1) const;
+
+    // Packs under objects/pack are discovered on first use
+    void prepare_packs() const;
+
+    // True only when `oid` was certainly not stored when the filter was
+    // built (see put_object_if_absent)
+    bool filter_excludes(const Oid& oid) const;
+    // In a pack or at `file` (its loose path); the pack search and the
+    // stat() are skipped when the filter rules the object out. Write paths
+    // only: readers must not miss objects stored since.
+    bool already_stored(const Oid& oid, const fs::path& file) const;
+    // Called before an object is published, so the filter never misses it
+    void filter_note(const Oid& oid);
+    // Loads (persist mode) or rebuilds filter_; filter_mu_ held exclusively
+    void build_filter() const;
+    bool find_packed(const Oid& oid, PackFile*& pack, std::uint64_t& offset) const;
+    ReadObjectResult read_packed(PackFile& pack, std::uint64_t offset) const;
       
     std::unique_ptr<IObjectCodec> codec_;
+    std::vector<std::unique_ptr<IObjectCodec>> read_codecs_;
+    int loose_level_ = kDefaultLevel;
+    int pack_level_ = kDefaultLevel;
     fs::path root_;
+    HashAlgo algo_ = HashAlgo::Sha1;
+    mutable PackWindowCache windows_; // must outlive packs_
+    mutable std::vector<std::unique_ptr<PackFile>> packs_;
+    mutable std::unique_ptr<MultiPackIndex> midx_;
+    mutable std::vector<PackFile*> midx_packs_;     // by multi-pack-index pack id
+    mutable std::vector<PackFile*> unindexed_packs_; // not in the multi-pack-index
+    bool use_midx_ = true;
+    mutable DeltaBaseCache delta_bases_;
+    std::unique_ptr<ObjectCache> object_cache_;
+    mutable std::mutex packs_mu_;
+    mutable std::atomic<bool> packs_prepared_{false};
+
+    enum class FilterMode { Off, Memory, Persist };
+    FilterMode filter_mode_ = FilterMode::Memory;
+    mutable std::shared_mutex filter_mu_;
+    mutable std::unique_ptr<ObjectFilter> filter_;
+    mutable ObjectFilter::Snapshot filter_snapshot_;
+    mutable std::atomic<std::uint32_t> filter_lookups_{0};
+    mutable std::atomic<bool> filter_dirty_{false};
+
+    // Fan-out directories known to exist, indexed by the first OID byte
+    std::atomic<bool> fanout_ready_[256] = {};
 };
@@ -0,0 +1,118 @@
+#include "object_stream.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <stdexcept>
+#include <string_view>
+#include <unistd.h>
+
+// Longest header is "commit <20 digits>\0"; anything past this is corrupt
+static constexpr std::size_t kMaxHeaderLen = 64;
+
+LooseObjectReader::LooseObjectReader(const fs::path& file, int fd,
+                                     std::unique_ptr<StreamDecoder> decoder)
+    : path_(file), fd_(fd), decoder_(std::move(decoder)) {
+    try {
+        read_header();
+    } catch (...) {
+        ::close(fd_);
+        throw;
+    }
+}
+
+void LooseObjectReader::read_header() {
+    // Inflate just enough to see the NUL that ends "<type> <size>"
+    char hdr[kMaxHeaderLen];
+    std::size_t got = 0;
+    const char* nul = nullptr;
+    while (!nul && got < sizeof(hdr)) {
+        const std::size_t n = inflate_some(hdr + got, sizeof(hdr) - got);
+        if (n == 0) break;
+        nul = static_cast<const char*>(std::memchr(hdr + got, '\0', n));
+        got += n;
+    }
+    if (!nul) {
+        throw std::runtime_error("invalid object: missing NUL after size: " + path_.string());
+    }
+
+    const std::string_view header(hdr, static_cast<std::size_t>(nul - hdr));
+    const std::size_t sp = header.find(' ');
+    if (sp == std::string_view::npos || sp == 0 || sp + 1 == header.size()) {
+        throw std::runtime_error("invalid object header: " + path_.string());
+    }
+    type_.assign(header.substr(0, sp));
+    for (char c : header.substr(sp + 1)) {
+        if (c < '0' || c > '9') {
+            throw std::runtime_error("invalid object: size not decimal");
+        }
+        size_ = size_ * 10 + static_cast<std::size_t>(c - '0');
+    }
+
+    pending_.assign(nul + 1, static_cast<std::size_t>(hdr + got - (nul + 1)));
+    if (pending_.size() > size_) {
+        throw std::runtime_error("invalid object: size mismatch: " + path_.string());
+    }
+    remaining_ = size_;
+}
+
+LooseObjectReader::~LooseObjectReader() {
+    ::close(fd_);
+}
+
+std::size_t LooseObjectReader::inflate_some(char* out, std::size_t n) {
+    std::size_t done = 0;
+    while (done < n && !stream_end_) {
+        if (in_avail_.empty()) {
+            const ssize_t got = ::read(fd_, in_, sizeof(in_));
+            if (got < 0) {
+                if (errno == EINTR) continue;
+                throw std::runtime_error("read failed: " + path_.string());
+            }
+            if (got == 0) break; // truncated file; the caller sees a short read
+            in_avail_ = std::string_view(in_, static_cast<std::size_t>(got));
+        }
+        const std::size_t before = in_avail_.size();
+        std::size_t got = 0;
+        try {
+            got = decoder_->decode(in_avail_, out + done, n - done, stream_end_);
+        } catch (const std::exception& e) {
+            throw std::runtime_error(std::string(e.what()) + ": " + path_.string());
+        }
+        if (got == 0 && in_avail_.size() == before && !stream_end_) {
+            throw std::runtime_error("corrupt object stream: " + path_.string());
+        }
+        done += got;
+    }
+    return done;
+}
+
+std::size_t LooseObjectReader::read(char* buf, std::size_t n) {
+    n = std::min(n, remaining_);
+    if (n == 0) return 0;
+
+    std::size_t done = 0;
+    if (pending_pos_ < pending_.size()) {
+        done = std::min(n, pending_.size() - pending_pos_);
+        std::memcpy(buf, pending_.data() + pending_pos_, done);
+        pending_pos_ += done;
+    }
+    if (done < n) {
+        const std::size_t got = inflate_some(buf + done, n - done);
+        if (got == 0) {
+            throw std::runtime_error("invalid object: truncated payload: " + path_.string());
+        }
+        done += got;
+    }
+
+    remaining_ -= done;
+    return done;
+}
+
+std::size_t BufferObjectReader::read(char* buf, std::size_t n) {
+    n = std::min(n, content_.size() - pos_);
+    std::memcpy(buf, content_.data() + pos_, n);
+    pos_ += n;
+    return n;
+}
@@ -0,0 +1,75 @@
+#pragma once
+
+#include "i_object_codec.hpp"
+
+#include <cstddef>
+#include <filesystem>
+#include <memory>
+#include <string>
+#include <string_view>
+
+namespace fs = std::filesystem;
+
+// Pull-based reader over an object's payload (the bytes after the header).
+class ObjectReader {
+public:
+    virtual ~ObjectReader() = default;
+
+    // Copies up to `n` payload bytes into `buf`; returns 0 once the payload
+    // is exhausted. Throws on corruption.
+    virtual std::size_t read(char* buf, std::size_t n) = 0;
+};
+
+// Header first, payload on demand.
+struct ObjectStream {
+    std::string type;
+    std::size_t size;
+    std::unique_ptr<ObjectReader> reader;
+};
+
+// Decompresses a loose object file in fixed-size chunks. The header is
+// decoded on construction; the payload is produced as the caller pulls it.
+// Takes ownership of `fd` (open on `file`, positioned at the start).
+class LooseObjectReader : public ObjectReader {
+public:
+    LooseObjectReader(const fs::path& file, int fd, std::unique_ptr<StreamDecoder> decoder);
+    ~LooseObjectReader() override;
+
+    LooseObjectReader(const LooseObjectReader&) = delete;
+    LooseObjectReader& operator=(const LooseObjectReader&) = delete;
+
+    const std::string& type() const { return type_; }
+    std::size_t size() const { return size_; }
+
+    std::size_t read(char* buf, std::size_t n) override;
+
+private:
+    void read_header();
+
+    // Decompresses into [out, out+n); returns the number of bytes produced.
+    std::size_t inflate_some(char* out, std::size_t n);
+
+    fs::path path_;
+    int fd_ = -1;
+    std::unique_ptr<StreamDecoder> decoder_;
+    bool stream_end_ = false;
+    char in_[16 * 1024];
+    std::string_view in_avail_; // unconsumed part of in_
+
+    std::string type_;
+    std::size_t size_ = 0;
+    std::size_t remaining_ = 0;
+    std::string pending_; // payload bytes inflated together with the header
+    std::size_t pending_pos_ = 0;
+};
+
+// Serves an already materialized payload (deltified pack entries).
+class BufferObjectReader : public ObjectReader {
+public:
+    explicit BufferObjectReader(std::string content) : content_(std::move(content)) {}
+    std::size_t read(char* buf, std::size_t n) override;
+
+private:
+    std::string content_;
+    std::size_t pos_ = 0;
+};
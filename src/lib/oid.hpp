@@ -0,0 +1,71 @@
+#pragma once
+
+#include "hash.hpp"
+#include "hex.hpp"
+
+#include <cstddef>
+#include <cstring>
+#include <optional>
+#include <string>
+#include <string_view>
+
+// Object ID. Storage is sized for the widest hash so that the type, and
+// comparisons on it, do not depend on the repository's object format;
+// SHA-1 IDs leave the tail of `bytes` zeroed.
+struct Oid {
+    unsigned char bytes[kMaxHashLen] = {};
+    HashAlgo algo = HashAlgo::Sha1;
+
+    bool operator==(const Oid&) const noexcept = default;
+    bool operator!=(const Oid& oid) { return !operator==(oid); }
+
+    // Digest length in bytes: 20 or 32
+    std::size_t size() const { return hash_len(algo); }
+
+    // Hex spelling without touching the heap; to_hex() copies it out.
+    struct Hex {
+        char chars[kMaxHashLen * 2];
+        std::size_t len;
+        std::string_view view() const { return {chars, len}; }
+    };
+
+    Hex hex() const {
+        Hex h;
+        h.len = 2 * size();
+        hex_encode(bytes, size(), h.chars);
+        return h;
+    }
+
+    std::string to_hex() const { return std::string(hex().view()); }
+
+    static Oid from_raw(const unsigned char* raw, HashAlgo algo) {
+        Oid oid{};
+        oid.algo = algo;
+        std::memcpy(oid.bytes, raw, hash_len(algo));
+        return oid;
+    }
+
+    // 40 hex digits for SHA-1, 64 for SHA-256
+    static std::optional<Oid> from_hex(std::string_view hex) {
+        Oid oid{};
+        if (hex.size() == kSha256Len * 2) {
+            oid.algo = HashAlgo::Sha256;
+        } else if (hex.size() != kSha1Len * 2) {
+            return std::nullopt;
+        }
+        if (!hex_decode(hex.data(), oid.size(), oid.bytes)) {
+            return std::nullopt; // invalid hex digit
+        }
+        return oid;
+    }
+};
+
+// For unordered containers. OIDs are already uniformly distributed, so the
+// leading bytes serve as the hash.
+struct OidHash {
+    std::size_t operator()(const Oid& oid) const noexcept {
+        std::size_t h;
+        std::memcpy(&h, oid.bytes, sizeof(h));
+        return h;
+    }
+};
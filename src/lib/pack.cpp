@@ -0,0 +1,316 @@
+#include "pack.hpp"
+
+#include "byte_order.hpp"
+#include "pack_window.hpp"
+
+#include <algorithm>
+#include <climits>
+#include <cstring>
+#include <fcntl.h>
+#include <stdexcept>
+#include <sys/mman.h>
+#include <unistd.h>
+#include <zlib.h>
+
+const char* pack_type_name(PackObjectType type) {
+    switch (type) {
+        case PackObjectType::Commit: return "commit";
+        case PackObjectType::Tree:   return "tree";
+        case PackObjectType::Blob:   return "blob";
+        case PackObjectType::Tag:    return "tag";
+        default: break;
+    }
+    throw std::runtime_error("pack: delta entry has no object type");
+}
+
+// ------------------------------ PackIndex --------------------------------
+
+static constexpr std::size_t kIdxHeaderLen = 8;
+static constexpr std::size_t kIdxFanoutLen = 256 * 4;
+
+PackIndex::PackIndex(const fs::path& idx_path, HashAlgo algo)
+    : algo_(algo), hash_len_(hash_len(algo)) {
+    const int fd = ::open(idx_path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        throw std::runtime_error("cannot open pack index: " + idx_path.string());
+    }
+    size_ = static_cast<std::size_t>(fs::file_size(idx_path));
+    void* map = size_ ? ::mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd, 0) : MAP_FAILED;
+    ::close(fd);
+    if (map == MAP_FAILED) {
+        throw std::runtime_error("cannot map pack index: " + idx_path.string());
+    }
+    data_ = static_cast<const unsigned char*>(map);
+
+    if (size_ < kIdxHeaderLen + kIdxFanoutLen + 2 * hash_len_ ||
+        std::memcmp(data_, "\377tOc", 4) != 0 || read_be32(data_ + 4) != 2) {
+        ::munmap(const_cast<unsigned char*>(data_), size_);
+        throw std::runtime_error("unsupported pack index (need v2): " + idx_path.string());
+    }
+
+    count_ = fanout(255);
+    const std::size_t min_len = kIdxHeaderLen + kIdxFanoutLen +
+                                std::size_t(count_) * (hash_len_ + 4 + 4) +
+                                2 * hash_len_;
+    if (size_ < min_len) {
+        ::munmap(const_cast<unsigned char*>(data_), size_);
+        throw std::runtime_error("truncated pack index: " + idx_path.string());
+    }
+}
+
+PackIndex::~PackIndex() {
+    ::munmap(const_cast<unsigned char*>(data_), size_);
+}
+
+std::uint32_t PackIndex::fanout(int bucket) const {
+    return read_be32(data_ + kIdxHeaderLen + 4 * bucket);
+}
+
+const unsigned char* PackIndex::oid_table() const {
+    return data_ + kIdxHeaderLen + kIdxFanoutLen;
+}
+
+// Instantiated per hash width so the memcmp in the loop has a constant length
+template <std::size_t N>
+std::optional<std::uint32_t> PackIndex::search(const Oid& oid) const {
+    const int first = oid.bytes[0];
+    std::uint32_t lo = first == 0 ? 0 : fanout(first - 1);
+    std::uint32_t hi = fanout(first);
+
+    const unsigned char* table = oid_table();
+    while (lo < hi) {
+        const std::uint32_t mid = lo + (hi - lo) / 2;
+        const int cmp = std::memcmp(table + std::size_t(mid) * N, oid.bytes, N);
+        if (cmp == 0) return mid;
+        if (cmp < 0) lo = mid + 1;
+        else hi = mid;
+    }
+    return std::nullopt;
+}
+
+std::optional<std::uint64_t> PackIndex::find(const Oid& oid) const {
+    if (oid.algo != algo_) return std::nullopt;
+    const auto pos = algo_ == HashAlgo::Sha1 ? search<HashTraits<HashAlgo::Sha1>::kLen>(oid)
+                                             : search<HashTraits<HashAlgo::Sha256>::kLen>(oid);
+    if (!pos) return std::nullopt;
+    return offset_at(*pos);
+}
+
+Oid PackIndex::oid_at(std::uint32_t i) const {
+    return Oid::from_raw(oid_table() + std::size_t(i) * hash_len_, algo_);
+}
+
+std::uint64_t PackIndex::offset_at(std::uint32_t i) const {
+    const unsigned char* offsets = oid_table() + std::size_t(count_) * (hash_len_ + 4);
+    const std::uint32_t off = read_be32(offsets + std::size_t(i) * 4);
+    if ((off & 0x80000000u) == 0) return off;
+
+    // MSB set: the remaining bits index the 64-bit offset table
+    const unsigned char* large = offsets + std::size_t(count_) * 4;
+    const std::size_t pos = std::size_t(off & 0x7fffffffu) * 8;
+    const unsigned char* end = data_ + size_ - 2 * hash_len_;
+    if (large + pos + 8 > end) {
+        throw std::runtime_error("corrupt pack index: bad large offset");
+    }
+    return read_be64(large + pos);
+}
+
+// ------------------------------- PackFile --------------------------------
+
+PackFile::PackFile(fs::path pack_path, const fs::path& idx_path, PackWindowCache& windows,
+                   HashAlgo algo)
+    : pack_path_(std::move(pack_path)), index_(idx_path, algo), windows_(windows), algo_(algo) {
+    fd_ = ::open(pack_path_.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd_ < 0) {
+        throw std::runtime_error("cannot open pack: " + pack_path_.string());
+    }
+    file_size_ = fs::file_size(pack_path_);
+
+    unsigned char hdr[12];
+    if (file_size_ < sizeof(hdr) + hash_len(algo_) ||
+        ::pread(fd_, hdr, sizeof(hdr), 0) != static_cast<ssize_t>(sizeof(hdr)) ||
+        std::memcmp(hdr, "PACK", 4) != 0) {
+        ::close(fd_);
+        throw std::runtime_error("not a pack file: " + pack_path_.string());
+    }
+    const std::uint32_t version = read_be32(hdr + 4);
+    if ((version != 2 && version != 3) || read_be32(hdr + 8) != index_.count()) {
+        ::close(fd_);
+        throw std::runtime_error("unsupported pack or index mismatch: " + pack_path_.string());
+    }
+}
+
+PackFile::~PackFile() {
+    windows_.release(*this);
+    ::close(fd_);
+}
+
+PackEntryHeader PackFile::read_entry_header(std::uint64_t offset) {
+    // type+size varint (<= 10 bytes) followed by at most a 10-byte ofs varint
+    // or a 20/32-byte base oid; the window must cover that much unless at EOF
+    const PackWindowCache::Pin window = windows_.use(*this, offset, 10 + std::max<std::size_t>(10, hash_len(algo_)));
+    const unsigned char* buf = window.data();
+    const std::size_t avail = window.avail();
+
+    std::size_t pos = 0;
+    auto next = [&]() -> unsigned char {
+        if (pos >= avail) throw std::runtime_error("pack: truncated entry header");
+        return buf[pos++];
+    };
+
+    PackEntryHeader h{};
+    unsigned char c = next();
+    h.type = static_cast<PackObjectType>((c >> 4) & 0x7);
+    h.size = c & 0x0f;
+    int shift = 4;
+    while (c & 0x80) {
+        c = next();
+        h.size |= static_cast<std::size_t>(c & 0x7f) << shift;
+        shift += 7;
+    }
+
+    switch (h.type) {
+        case PackObjectType::Commit:
+        case PackObjectType::Tree:
+        case PackObjectType::Blob:
+        case PackObjectType::Tag:
+            break;
+        case PackObjectType::OfsDelta: {
+            // Big-endian base-128 with an implicit +1 per continuation byte
+            c = next();
+            std::uint64_t rel = c & 0x7f;
+            while (c & 0x80) {
+                c = next();
+                rel = ((rel + 1) << 7) | (c & 0x7f);
+            }
+            if (rel == 0 || rel > offset) {
+                throw std::runtime_error("pack: bad OFS_DELTA base offset");
+            }
+            h.base_offset = offset - rel;
+            break;
+        }
+        case PackObjectType::RefDelta:
+            if (pos + hash_len(algo_) > avail) {
+                throw std::runtime_error("pack: truncated REF_DELTA base");
+            }
+            h.base_oid = Oid::from_raw(buf + pos, algo_);
+            pos += hash_len(algo_);
+            break;
+        default:
+            throw std::runtime_error("pack: invalid entry type");
+    }
+
+    h.data_offset = offset + pos;
+    return h;
+}
+
+std::string PackFile::inflate_at(std::uint64_t data_offset, std::size_t size) {
+    std::string out;
+    out.resize(size);
+
+    z_stream zs{};
+    if (inflateInit(&zs) != Z_OK) {
+        throw std::runtime_error("pack: inflateInit failed");
+    }
+
+    zs.next_out = reinterpret_cast<Bytef*>(out.data());
+    zs.avail_out = static_cast<uInt>(std::min<std::size_t>(size, UINT_MAX));
+
+    std::uint64_t pos = data_offset;
+    unsigned char sink;
+    int ret = Z_OK;
+    PackWindowCache::Pin window;
+    while (ret == Z_OK) {
+        if (zs.avail_in == 0) {
+            // The previous window is fully consumed; unpin it before the
+            // next one so that use() may evict it
+            if (pos >= file_size_) break;
+            window.reset();
+            window = windows_.use(*this, pos);
+            zs.next_in = const_cast<Bytef*>(window.data());
+            zs.avail_in = static_cast<uInt>(std::min<std::size_t>(window.avail(), UINT_MAX));
+            pos += zs.avail_in;
+        }
+        if (zs.avail_out == 0) {
+            const std::size_t produced = zs.total_out;
+            if (produced < size) {
+                zs.avail_out = static_cast<uInt>(std::min<std::size_t>(size - produced, UINT_MAX));
+            } else {
+                // Let zlib see the end of stream; any byte landing here is corruption
+                zs.next_out = &sink;
+                zs.avail_out = 1;
+            }
+        }
+        ret = inflate(&zs, Z_NO_FLUSH);
+    }
+
+    const bool complete = ret == Z_STREAM_END && zs.total_out == size;
+    inflateEnd(&zs);
+    if (!complete) {
+        throw std::runtime_error("pack: corrupt zlib stream in " + pack_path_.string());
+    }
+    return out;
+}
+
+namespace {
+
+// Inflates a non-delta entry straight from the window cache. Input windows
+// are pinned only for the duration of one inflate() call and re-acquired on
+// every read(), so another reader evicting them in between is harmless.
+class PackStreamReader : public ObjectReader {
+public:
+    PackStreamReader(PackFile& pack, PackWindowCache& windows, std::uint64_t data_offset,
+                     std::size_t size)
+        : pack_(pack), windows_(windows), in_pos_(data_offset), remaining_(size) {
+        if (inflateInit(&zs_) != Z_OK) {
+            throw std::runtime_error("pack: inflateInit failed");
+        }
+    }
+    ~PackStreamReader() override { inflateEnd(&zs_); }
+
+    std::size_t read(char* buf, std::size_t n) override {
+        n = std::min(n, remaining_);
+        if (n == 0) return 0;
+
+        zs_.next_out = reinterpret_cast<Bytef*>(buf);
+        zs_.avail_out = static_cast<uInt>(std::min<std::size_t>(n, UINT_MAX));
+        const uInt want = zs_.avail_out;
+
+        while (zs_.avail_out > 0 && !stream_end_ && in_pos_ < pack_.size()) {
+            const PackWindowCache::Pin window = windows_.use(pack_, in_pos_);
+            zs_.next_in = const_cast<Bytef*>(window.data());
+            zs_.avail_in = static_cast<uInt>(std::min<std::size_t>(window.avail(), UINT_MAX));
+            const uInt offered = zs_.avail_in;
+
+            const int ret = inflate(&zs_, Z_NO_FLUSH);
+            in_pos_ += offered - zs_.avail_in;
+            zs_.avail_in = 0;
+            if (ret == Z_STREAM_END) {
+                stream_end_ = true;
+            } else if (ret != Z_OK) {
+                throw std::runtime_error("pack: corrupt zlib stream in " + pack_.path().string());
+            }
+        }
+
+        const std::size_t got = want - zs_.avail_out;
+        if (got == 0) {
+            throw std::runtime_error("pack: truncated entry in " + pack_.path().string());
+        }
+        remaining_ -= got;
+        return got;
+    }
+
+private:
+    PackFile& pack_;
+    PackWindowCache& windows_;
+    z_stream zs_{};
+    std::uint64_t in_pos_;
+    std::size_t remaining_;
+    bool stream_end_ = false;
+};
+
+} // namespace
+
+std::unique_ptr<ObjectReader> PackFile::open_stream(std::uint64_t data_offset, std::size_t size) {
+    return std::make_unique<PackStreamReader>(*this, windows_, data_offset, size);
+}
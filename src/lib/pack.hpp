@@ -0,0 +1,109 @@
+#pragma once
+
+#include "object_store.hpp"
+#include "object_stream.hpp"
+
+#include <cstdint>
+#include <filesystem>
+#include <memory>
+#include <optional>
+#include <string>
+#include <string_view>
+
+namespace fs = std::filesystem;
+
+class PackWindowCache;
+
+// Object type codes stored in the 3-bit type field of a pack entry header.
+enum class PackObjectType : std::uint8_t {
+    Commit = 1,
+    Tree = 2,
+    Blob = 3,
+    Tag = 4,
+    OfsDelta = 6,
+    RefDelta = 7,
+};
+
+// "commit" | "tree" | "blob" | "tag"; throws for delta types.
+const char* pack_type_name(PackObjectType type);
+
+// Read-only view over a version 2 pack index (.idx):
+//   "\377tOc" | version | fanout[256] | oids[N] | crc32[N] | offset32[N]
+//   | offset64[*] | pack checksum | idx checksum
+// OIDs and checksums are 20 or 32 bytes wide depending on the repository's
+// object format.
+//
+// The whole index is mmap'ed read-only for the lifetime of the object.
+class PackIndex {
+public:
+    PackIndex(const fs::path& idx_path, HashAlgo algo);
+    ~PackIndex();
+
+    PackIndex(const PackIndex&) = delete;
+    PackIndex& operator=(const PackIndex&) = delete;
+
+    // Binary search inside the fanout bucket of oid.bytes[0].
+    std::optional<std::uint64_t> find(const Oid& oid) const;
+
+    std::uint32_t count() const { return count_; }
+    Oid oid_at(std::uint32_t i) const;
+    std::uint64_t offset_at(std::uint32_t i) const;
+    // Checksum of the .pack this index belongs to (its trailing hash)
+    const unsigned char* pack_checksum() const { return data_ + size_ - 2 * hash_len_; }
+
+private:
+    const unsigned char* oid_table() const;
+    std::uint32_t fanout(int bucket) const;
+    template <std::size_t N>
+    std::optional<std::uint32_t> search(const Oid& oid) const;
+
+    HashAlgo algo_;
+    std::size_t hash_len_;
+    const unsigned char* data_ = nullptr;
+    std::size_t size_ = 0;
+    std::uint32_t count_ = 0;
+};
+
+// Decoded header of a single pack entry.
+struct PackEntryHeader {
+    PackObjectType type;
+    std::size_t size;          // inflated size of the entry data
+    std::uint64_t data_offset; // start of the zlib stream
+    std::uint64_t base_offset; // OFS_DELTA only: absolute offset of the base
+    Oid base_oid;              // REF_DELTA only
+};
+
+// A .pack file together with its .idx. Pack bytes are never copied through
+// a stream: entries are parsed and inflated straight out of mmap'ed windows
+// handed out by the shared PackWindowCache.
+class PackFile {
+public:
+    PackFile(fs::path pack_path, const fs::path& idx_path, PackWindowCache& windows,
+             HashAlgo algo);
+    ~PackFile();
+
+    PackFile(const PackFile&) = delete;
+    PackFile& operator=(const PackFile&) = delete;
+
+    const PackIndex& index() const { return index_; }
+    const fs::path& path() const { return pack_path_; }
+    int fd() const { return fd_; }
+    std::uint64_t size() const { return file_size_; }
+
+    PackEntryHeader read_entry_header(std::uint64_t offset);
+
+    // Inflates exactly `size` bytes from the zlib stream at `data_offset`.
+    std::string inflate_at(std::uint64_t data_offset, std::size_t size);
+
+    // Like inflate_at, but hands the bytes out incrementally. The reader
+    // must not outlive this PackFile.
+    std::unique_ptr<ObjectReader> open_stream(std::uint64_t data_offset, std::size_t size);
+
+private:
+    fs::path pack_path_;
+    PackIndex index_;
+    PackWindowCache& windows_;
+    HashAlgo algo_;
+    int fd_ = -1;
+    std::uint64_t file_size_ = 0;
+};
@@ -0,0 +1,408 @@
+#include "pack_bitmap.hpp"
+
+#include "byte_order.hpp"
+#include "commit.hpp"
+#include "entry.hpp"
+#include "file_util.hpp"
+#include "rev_walk.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <stdexcept>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+static constexpr char kSignature[4] = {'B', 'I', 'T', 'M'};
+static constexpr std::uint16_t kVersion = 1;
+static constexpr std::uint16_t kOptFullDag = 0x1; // required by Git
+static constexpr std::size_t kEntryHeaderLen = 6;
+static constexpr std::size_t kMaxXorOffset = 160;  // Git rejects larger ones
+static constexpr std::size_t kXorWindow = 10;      // earlier entries tried as XOR bases
+static constexpr std::size_t kNoEntry = SIZE_MAX;
+
+static std::optional<PackObjectType> type_from_name(std::string_view name) {
+    if (name == "commit") return PackObjectType::Commit;
+    if (name == "tree") return PackObjectType::Tree;
+    if (name == "blob") return PackObjectType::Blob;
+    if (name == "tag") return PackObjectType::Tag;
+    return std::nullopt;
+}
+
+static ReadObjectResult read_existing(const ObjectStore& store, const Oid& oid) {
+    auto obj = store.read_object(oid);
+    if (!obj) throw std::runtime_error("missing object " + oid.to_hex());
+    return std::move(*obj);
+}
+
+// Pack positions of the entries of `index`, ordered by offset
+static std::vector<std::uint32_t> pack_order(const PackIndex& index, std::vector<std::uint64_t>& offsets) {
+    std::vector<std::pair<std::uint64_t, std::uint32_t>> by_offset(index.count());
+    for (std::uint32_t i = 0; i < index.count(); ++i) by_offset[i] = {index.offset_at(i), i};
+    std::sort(by_offset.begin(), by_offset.end());
+    std::vector<std::uint32_t> order(by_offset.size());
+    offsets.resize(by_offset.size());
+    for (std::size_t pos = 0; pos < by_offset.size(); ++pos) {
+        offsets[pos] = by_offset[pos].first;
+        order[pos] = by_offset[pos].second;
+    }
+    return order;
+}
+
+// ------------------------------------------------------------------ reading
+
+std::unique_ptr<PackBitmap> PackBitmap::open(const fs::path& pack_dir, HashAlgo algo) {
+    std::error_code ec;
+    for (const auto& file : fs::directory_iterator(pack_dir, ec)) {
+        const fs::path& path = file.path();
+        if (path.extension() != ".bitmap") continue;
+        fs::path idx = path;
+        idx.replace_extension(".idx");
+        fs::path pack = path;
+        pack.replace_extension(".pack");
+        if (!fs::exists(idx) || !fs::exists(pack)) continue;
+
+        std::unique_ptr<PackBitmap> bitmap;
+        try {
+            bitmap.reset(new PackBitmap(idx, algo));
+            bitmap->path_ = path;
+            if (bitmap->load()) return bitmap;
+        } catch (const std::runtime_error&) {
+            // unreadable index or corrupt bitmap: try the next one
+        }
+    }
+    return nullptr;
+}
+
+PackBitmap::~PackBitmap() {
+    if (data_) ::munmap(const_cast<unsigned char*>(data_), size_);
+}
+
+bool PackBitmap::load() {
+    const int fd = ::open(path_.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return false;
+    struct stat st {};
+    if (::fstat(fd, &st) != 0 || st.st_size == 0) {
+        ::close(fd);
+        return false;
+    }
+    size_ = static_cast<std::size_t>(st.st_size);
+    void* map = ::mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if (map == MAP_FAILED) return false;
+    data_ = static_cast<const unsigned char*>(map);
+
+    // A bitmap left behind by an older pack of the same name is useless
+    const std::size_t h = hash_len_;
+    const std::size_t header_len = 12 + h;
+    if (size_ < header_len + h || std::memcmp(data_, kSignature, 4) != 0 ||
+        read_be16(data_ + 4) != kVersion || !(read_be16(data_ + 6) & kOptFullDag) ||
+        std::memcmp(data_ + 12, index_.pack_checksum(), h) != 0) {
+        return false;
+    }
+
+    pack_order_ = pack_order(index_, offsets_);
+    std::vector<std::uint32_t> pos_of(pack_order_.size());
+    for (std::uint32_t pos = 0; pos < pack_order_.size(); ++pos) pos_of[pack_order_[pos]] = pos;
+
+    const std::size_t end = size_ - h;
+    std::size_t off = header_len;
+    for (Bitmap& type : types_) {
+        std::size_t used = 0;
+        type = ewah_decode(data_ + off, end - off, used);
+        off += used;
+    }
+
+    // Entries are decoded on first use; only their headers are read here
+    const std::uint32_t count = read_be32(data_ + 8);
+    entries_.reserve(count);
+    for (std::uint32_t i = 0; i < count; ++i) {
+        if (end - off < kEntryHeaderLen + 12) return false;
+        const std::uint32_t idx_pos = read_be32(data_ + off);
+        const std::size_t xor_offset = data_[off + 4];
+        if (idx_pos >= pos_of.size() || xor_offset > i || xor_offset > kMaxXorOffset) return false;
+        Entry e;
+        e.offset = off + kEntryHeaderLen;
+        e.xor_with = xor_offset ? i - xor_offset : kNoEntry;
+        const std::size_t words = read_be32(data_ + e.offset + 4);
+        if ((end - e.offset - 12) / 8 < words) return false;
+        off = e.offset + 12 + words * 8;
+        entry_at_.emplace(pos_of[idx_pos], entries_.size());
+        entries_.push_back(std::move(e));
+    }
+    return true;
+}
+
+const Bitmap& PackBitmap::entry_bitmap(std::size_t entry) {
+    // Decode the undecoded part of the XOR chain oldest first, so each
+    // entry only has to be combined with its already decoded base
+    std::vector<std::size_t> chain;
+    for (std::size_t i = entry; i != kNoEntry && !entries_[i].decoded; i = entries_[i].xor_with) {
+        chain.push_back(i);
+    }
+    for (auto it = chain.rbegin(); it != chain.rend(); ++it) {
+        Entry& e = entries_[*it];
+        std::size_t used = 0;
+        Bitmap b = ewah_decode(data_ + e.offset, size_ - e.offset, used);
+        if (e.xor_with != kNoEntry) b ^= *entries_[e.xor_with].decoded;
+        e.decoded = std::move(b);
+    }
+    return *entries_[entry].decoded;
+}
+
+const Bitmap* PackBitmap::stored(std::uint32_t pos) {
+    auto it = entry_at_.find(pos);
+    return it == entry_at_.end() ? nullptr : &entry_bitmap(it->second);
+}
+
+std::uint32_t PackBitmap::position(const Oid& oid, PackObjectType type) {
+    if (auto offset = index_.find(oid)) {
+        const auto it = std::lower_bound(offsets_.begin(), offsets_.end(), *offset);
+        return static_cast<std::uint32_t>(it - offsets_.begin());
+    }
+    auto [it, inserted] = extra_index_.emplace(oid, pack_count() + static_cast<std::uint32_t>(extra_.size()));
+    if (inserted) extra_.push_back(Extra{oid, type});
+    return it->second;
+}
+
+Bitmap PackBitmap::reachable(const ObjectStore& store, const std::vector<Oid>& tips) {
+    const HashAlgo algo = store.hash_algo();
+    Bitmap result;
+    std::vector<Oid> commits;
+    std::vector<Oid> trees;
+
+    for (Oid oid : tips) {
+        for (int depth = 0; depth < 16; ++depth) {
+            const auto obj = read_existing(store, oid);
+            const auto type = type_from_name(obj.type);
+            if (type == PackObjectType::Commit) {
+                commits.push_back(oid);
+            } else if (type == PackObjectType::Tree) {
+                trees.push_back(oid);
+            } else if (type) {
+                result.set(position(oid, *type));
+                if (type == PackObjectType::Tag) {
+                    if (auto target = tag_target(obj.content)) {
+                        oid = *target;
+                        continue;
+                    }
+                }
+            }
+            break;
+        }
+    }
+
+    // Commits first, so every stored bitmap is in before the trees are
+    // walked: a set bit then always stands for a fully covered object
+    while (!commits.empty()) {
+        const Oid oid = commits.back();
+        commits.pop_back();
+        const std::uint32_t pos = position(oid, PackObjectType::Commit);
+        if (result.test(pos)) continue;
+        if (const Bitmap* b = stored(pos)) {
+            result |= *b;
+            continue;
+        }
+        result.set(pos);
+        const Commit c = Commit::parse(read_existing(store, oid).content, algo);
+        trees.push_back(c.tree);
+        commits.insert(commits.end(), c.parents.begin(), c.parents.end());
+    }
+
+    while (!trees.empty()) {
+        const Oid oid = trees.back();
+        trees.pop_back();
+        const std::uint32_t pos = position(oid, PackObjectType::Tree);
+        if (result.test(pos)) continue;
+        result.set(pos);
+        const auto tree = read_existing(store, oid);
+        for (const EntryView& e : TreeView(tree.content, algo)) {
+            if (e.is_tree()) trees.push_back(e.oid());
+            else if (e.mode != EntryMode::Gitlink) result.set(position(e.oid(), PackObjectType::Blob));
+        }
+    }
+    return result;
+}
+
+std::size_t PackBitmap::count(const Bitmap& objects, PackObjectType type) const {
+    std::size_t n = objects.count_and(types_[type_slot(type)]);
+    for (std::size_t i = 0; i < extra_.size(); ++i) {
+        if (extra_[i].type == type && objects.test(pack_count() + i)) ++n;
+    }
+    return n;
+}
+
+// ------------------------------------------------------------------ writing
+
+// Index (into `by_date`, newest first) distance to the next commit to
+// select after the one at `i`, as Git spaces them: every commit among the
+// newest 100, then one in up to 100, widening to one in 5000
+static std::size_t selection_gap(std::size_t i) {
+    static constexpr std::size_t kMustRegion = 100, kMinRegion = 20000;
+    static constexpr std::size_t kMinGap = 100, kMaxGap = 5000;
+    if (i <= kMustRegion) return 0;
+    if (i <= kMinRegion) return std::min(i - kMustRegion, kMinGap);
+    return std::max(std::min(i - kMinRegion, kMaxGap), kMinGap);
+}
+
+std::size_t write_pack_bitmap(const ObjectStore& store, const fs::path& idx_path,
+                              const std::vector<Oid>& tips, const CommitGraph* graph) {
+    const HashAlgo algo = store.hash_algo();
+    const std::size_t h = hash_len(algo);
+    const PackIndex index(idx_path, algo);
+    std::vector<std::uint64_t> offsets;
+    const std::vector<std::uint32_t> order = pack_order(index, offsets);
+    auto position = [&](const Oid& oid) {
+        const auto offset = index.find(oid);
+        if (!offset) throw std::runtime_error("object " + oid.to_hex() + " is reachable but not in the pack");
+        return static_cast<std::size_t>(std::lower_bound(offsets.begin(), offsets.end(), *offset) - offsets.begin());
+    };
+
+    Bitmap types[4];
+    for (std::size_t pos = 0; pos < order.size(); ++pos) {
+        const Oid oid = index.oid_at(order[pos]);
+        const auto info = store.read_object_info(oid);
+        const auto type = info ? type_from_name(info->type) : std::nullopt;
+        if (!type) throw std::runtime_error("cannot read packed object " + oid.to_hex());
+        types[static_cast<std::size_t>(*type) - 1].set(pos);
+    }
+
+    // Every reachable commit, in an order where parents come first
+    CommitIndex commits(store, graph);
+    std::vector<char> seen;
+    std::vector<char> selected;
+    auto flag = [](std::vector<char>& v, std::uint32_t n) -> char& {
+        if (n >= v.size()) v.resize(std::size_t(n) + 1);
+        return v[n];
+    };
+    std::vector<std::uint32_t> topo;
+    std::vector<std::pair<std::uint32_t, bool>> stack; // (commit, parents done)
+    std::vector<std::uint32_t> parents;
+    for (Oid oid : tips) {
+        for (int depth = 0; depth < 16; ++depth) {
+            const auto obj = read_existing(store, oid);
+            if (obj.type == "tag") {
+                if (auto target = tag_target(obj.content)) {
+                    oid = *target;
+                    continue;
+                }
+            } else if (obj.type == "commit") {
+                const std::uint32_t n = commits.lookup(oid);
+                flag(selected, n) = 1;
+                stack.emplace_back(n, false);
+            }
+            break;
+        }
+        while (!stack.empty()) {
+            auto [n, done] = stack.back();
+            stack.pop_back();
+            if (done) {
+                topo.push_back(n);
+                continue;
+            }
+            if (flag(seen, n)) continue;
+            flag(seen, n) = 1;
+            stack.emplace_back(n, true);
+            commits.parents(n, parents);
+            for (std::uint32_t p : parents) {
+                if (!flag(seen, p)) stack.emplace_back(p, false);
+            }
+        }
+    }
+
+    std::vector<std::uint32_t> by_date = topo;
+    std::stable_sort(by_date.begin(), by_date.end(), [&](std::uint32_t a, std::uint32_t b) {
+        return commits.commit_time(a) > commits.commit_time(b);
+    });
+    for (std::size_t i = 0; i < by_date.size();) {
+        const std::size_t gap = selection_gap(i);
+        if (i + gap >= by_date.size()) break;
+        // Within the gap prefer a merge: its bitmap saves walking two lines
+        std::uint32_t chosen = by_date[i + gap];
+        for (std::size_t j = 0; j < gap; ++j) {
+            commits.parents(by_date[i + j], parents);
+            if (parents.size() > 1) chosen = by_date[i + j];
+        }
+        flag(selected, chosen) = 1;
+        i += gap + 1;
+    }
+
+    // Bitmaps in topological order, so each walk can stop at the selected
+    // commits below it and take their finished bitmaps
+    std::vector<std::uint32_t> entries;
+    std::vector<Bitmap> built;
+    std::unordered_map<std::uint32_t, std::size_t> built_at;
+    std::vector<std::uint32_t> walk;
+    std::vector<Oid> trees;
+    for (std::uint32_t n : topo) {
+        if (!flag(selected, n)) continue;
+        Bitmap b;
+        walk.assign(1, n);
+        while (!walk.empty()) {
+            const std::uint32_t m = walk.back();
+            walk.pop_back();
+            const std::size_t pos = position(commits.oid(m));
+            if (b.test(pos)) continue;
+            if (auto it = built_at.find(m); it != built_at.end()) {
+                b |= built[it->second];
+                continue;
+            }
+            b.set(pos);
+            trees.push_back(commits.tree(m));
+            commits.parents(m, parents);
+            walk.insert(walk.end(), parents.begin(), parents.end());
+        }
+        while (!trees.empty()) {
+            const Oid oid = trees.back();
+            trees.pop_back();
+            const std::size_t pos = position(oid);
+            if (b.test(pos)) continue;
+            b.set(pos);
+            const auto tree = read_existing(store, oid);
+            for (const EntryView& e : TreeView(tree.content, algo)) {
+                if (e.is_tree()) trees.push_back(e.oid());
+                else if (e.mode != EntryMode::Gitlink) b.set(position(e.oid()));
+            }
+        }
+        built_at.emplace(n, built.size());
+        built.push_back(std::move(b));
+        entries.push_back(n);
+    }
+
+    std::string out(kSignature, sizeof(kSignature));
+    put_be16(out, kVersion);
+    put_be16(out, kOptFullDag);
+    put_be32(out, static_cast<std::uint32_t>(entries.size()));
+    out.append(reinterpret_cast<const char*>(index.pack_checksum()), h);
+    for (const Bitmap& type : types) out += ewah_encode(type);
+
+    for (std::size_t i = 0; i < entries.size(); ++i) {
+        // Store the smallest of the plain bitmap and its XOR with one of the
+        // previous few
+        std::string best = ewah_encode(built[i]);
+        std::size_t best_offset = 0;
+        for (std::size_t k = 1; k <= std::min({i, kXorWindow, kMaxXorOffset}); ++k) {
+            Bitmap x = built[i];
+            x ^= built[i - k];
+            std::string encoded = ewah_encode(x);
+            if (encoded.size() < best.size()) {
+                best = std::move(encoded);
+                best_offset = k;
+            }
+        }
+        put_be32(out, order[position(commits.oid(entries[i]))]);
+        out.push_back(static_cast<char>(best_offset));
+        out.push_back(0); // flags
+        out += best;
+    }
+    unsigned char digest[kMaxHashLen];
+    Hasher::digest(algo, out.data(), out.size(), digest);
+    out.append(reinterpret_cast<const char*>(digest), h);
+
+    fs::path file = idx_path;
+    file.replace_extension(".bitmap");
+    replace_file(file, out);
+    return entries.size();
+}
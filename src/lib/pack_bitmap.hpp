@@ -0,0 +1,119 @@
+#pragma once
+
+#include "commit_graph.hpp"
+#include "ewah.hpp"
+#include "object_store.hpp"
+#include "pack.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <memory>
+#include <optional>
+#include <unordered_map>
+#include <vector>
+
+namespace fs = std::filesystem;
+
+// Reachability bitmaps of a pack ("pack-<hash>.bitmap" next to its .idx),
+// in Git's format so either tool can use what the other wrote:
+//   "BITM" | version 1 | options (1: full DAG) | entry count | pack checksum
+//   | EWAH bitmaps of the commits, trees, blobs and tags in the pack
+//   | per selected commit: .idx position (32 bits) | XOR offset (8) | flags
+//     (8) | EWAH bitmap
+//   | hash of everything before it
+// Bit i stands for the i-th object in pack order (by offset). A commit's
+// bitmap has a bit for every object reachable from it, so the objects
+// reachable from a set of commits are the OR of their bitmaps plus what a
+// short walk from commits without one adds. An entry with XOR offset k
+// stores the difference to the bitmap k entries earlier, which keeps the
+// bitmaps of neighbouring commits down to a few words.
+//
+// Not thread-safe: decoded bitmaps are cached and reachable() numbers
+// objects outside the pack as it finds them.
+class PackBitmap {
+public:
+    // The first usable bitmap under `pack_dir`; nullptr when there is none
+    // or it does not match its pack.
+    static std::unique_ptr<PackBitmap> open(const fs::path& pack_dir, HashAlgo algo);
+    ~PackBitmap();
+
+    PackBitmap(const PackBitmap&) = delete;
+    PackBitmap& operator=(const PackBitmap&) = delete;
+
+    const fs::path& path() const { return path_; }
+    // Objects in the pack; positions from here on are objects outside it
+    std::uint32_t pack_count() const { return static_cast<std::uint32_t>(pack_order_.size()); }
+    std::size_t entry_count() const { return entries_.size(); }
+
+    // Every object reachable from `tips` (commits or annotated tags, inside
+    // the pack or not). Commits with a stored bitmap contribute it whole;
+    // the walk only reads the commits and trees in between.
+    Bitmap reachable(const ObjectStore& store, const std::vector<Oid>& tips);
+
+    // Bits of `objects` that are objects of `type` (Commit, Tree, Blob, Tag)
+    std::size_t count(const Bitmap& objects, PackObjectType type) const;
+
+    // Calls f(oid, type) for every bit of `objects`: commits, trees, blobs,
+    // then tags, each in pack order, then the objects outside the pack.
+    template <class F>
+    void for_each(const Bitmap& objects, F&& f) const {
+        for (PackObjectType type : kTypes) {
+            Bitmap selected = types_[type_slot(type)];
+            selected &= objects;
+            selected.for_each([&](std::size_t pos) {
+                if (pos < pack_count()) f(oid_at(static_cast<std::uint32_t>(pos)), type);
+            });
+        }
+        for (std::size_t i = 0; i < extra_.size(); ++i) {
+            if (objects.test(pack_count() + i)) f(extra_[i].oid, extra_[i].type);
+        }
+    }
+
+private:
+    static constexpr PackObjectType kTypes[] = {PackObjectType::Commit, PackObjectType::Tree,
+                                                PackObjectType::Blob, PackObjectType::Tag};
+    static std::size_t type_slot(PackObjectType type) { return static_cast<std::size_t>(type) - 1; }
+
+    PackBitmap(const fs::path& idx_path, HashAlgo algo) : index_(idx_path, algo), hash_len_(hash_len(algo)) {}
+    bool load();
+
+    Oid oid_at(std::uint32_t pos) const { return index_.oid_at(pack_order_[pos]); }
+    // Position of `oid`, numbering it past the pack when it is not in it
+    std::uint32_t position(const Oid& oid, PackObjectType type);
+    // Stored bitmap of the commit at `pos`, if it has one
+    const Bitmap* stored(std::uint32_t pos);
+    const Bitmap& entry_bitmap(std::size_t entry);
+
+    struct Entry {
+        std::size_t offset = 0; // of its EWAH data in the file
+        std::size_t xor_with = 0; // entry index, or SIZE_MAX
+        std::optional<Bitmap> decoded;
+    };
+    struct Extra {
+        Oid oid;
+        PackObjectType type;
+    };
+
+    fs::path path_;
+    PackIndex index_;
+    std::size_t hash_len_;
+    const unsigned char* data_ = nullptr;
+    std::size_t size_ = 0;
+    std::vector<std::uint32_t> pack_order_;  // position -> .idx position
+    std::vector<std::uint64_t> offsets_;     // position -> pack offset
+    Bitmap types_[4];
+    std::vector<Entry> entries_;
+    std::unordered_map<std::uint32_t, std::size_t> entry_at_; // position -> entry
+    std::vector<Extra> extra_;
+    std::unordered_map<Oid, std::uint32_t, OidHash> extra_index_;
+};
+
+// Writes the bitmap for the pack indexed by `idx_path`, selecting commits
+// reachable from `tips` (tags are peeled; other objects are skipped): every
+// tip, every one of the 100 newest commits, then one commit in every 100
+// and, deep in history, up to one in 5000. Every object reachable from the
+// tips must be in the pack, as after "repack -a". `graph` (may be null)
+// speeds up the commit walk. Returns the number of commits given a bitmap.
+std::size_t write_pack_bitmap(const ObjectStore& store, const fs::path& idx_path,
+                              const std::vector<Oid>& tips, const CommitGraph* graph);
@@ -0,0 +1,121 @@
+#include "pack_window.hpp"
+
+#include "pack.hpp"
+
+#include <algorithm>
+#include <stdexcept>
+#include <utility>
+#include <sys/mman.h>
+#include <unistd.h>
+
+PackWindowCache::PackWindowCache(std::size_t window_size, std::size_t mapped_limit)
+    : mapped_limit_(mapped_limit) {
+    // Window starts are aligned to half a window, which must be page aligned
+    const auto page = static_cast<std::size_t>(::sysconf(_SC_PAGESIZE));
+    const std::size_t half = std::max(page, (window_size / 2) / page * page);
+    window_size_ = 2 * half;
+}
+
+PackWindowCache::~PackWindowCache() {
+    for (auto& w : windows_) unmap(w);
+}
+
+void PackWindowCache::unmap(const Window& w) {
+    ::munmap(w.base, w.len);
+    mapped_ -= w.len;
+}
+
+bool PackWindowCache::evict_lru() {
+    auto lru = windows_.end();
+    for (auto it = windows_.begin(); it != windows_.end(); ++it) {
+        if (it->pins == 0 && (lru == windows_.end() || it->last_used < lru->last_used)) lru = it;
+    }
+    if (lru == windows_.end()) return false;
+    unmap(*lru);
+    windows_.erase(lru);
+    return true;
+}
+
+PackWindowCache::Pin& PackWindowCache::Pin::operator=(Pin&& o) noexcept {
+    if (this != &o) {
+        reset();
+        cache_ = std::exchange(o.cache_, nullptr);
+        window_ = std::exchange(o.window_, nullptr);
+        data_ = std::exchange(o.data_, nullptr);
+        avail_ = std::exchange(o.avail_, 0);
+    }
+    return *this;
+}
+
+void PackWindowCache::Pin::reset() {
+    if (!window_) return;
+    {
+        std::lock_guard<std::mutex> lock(cache_->mu_);
+        --window_->pins;
+    }
+    cache_ = nullptr;
+    window_ = nullptr;
+    data_ = nullptr;
+    avail_ = 0;
+}
+
+PackWindowCache::Pin PackWindowCache::use(const PackFile& pack, std::uint64_t offset, std::size_t min_avail) {
+    if (offset >= pack.size()) {
+        throw std::runtime_error("pack: offset beyond end of " + pack.path().string());
+    }
+
+    Pin pin;
+    pin.cache_ = this;
+    std::lock_guard<std::mutex> lock(mu_);
+
+    const std::uint64_t want_end = std::min<std::uint64_t>(offset + min_avail, pack.size());
+    for (auto& w : windows_) {
+        if (w.pack == &pack && offset >= w.offset && want_end <= w.offset + w.len) {
+            w.last_used = ++tick_;
+            ++w.pins;
+            pin.window_ = &w;
+            pin.avail_ = static_cast<std::size_t>(w.offset + w.len - offset);
+            pin.data_ = w.base + (offset - w.offset);
+            return pin;
+        }
+    }
+
+    const std::uint64_t half = window_size_ / 2;
+    const std::uint64_t start = offset / half * half;
+    const auto len = static_cast<std::size_t>(std::min<std::uint64_t>(window_size_, pack.size() - start));
+
+    while (!windows_.empty() && mapped_ + len > mapped_limit_ && evict_lru()) {
+    }
+
+    void* base = ::mmap(nullptr, len, PROT_READ, MAP_PRIVATE, pack.fd(), static_cast<off_t>(start));
+    if (base == MAP_FAILED) {
+        throw std::runtime_error("pack: mmap failed for " + pack.path().string());
+    }
+
+    windows_.push_back(Window{&pack, start, len, static_cast<unsigned char*>(base), ++tick_, 1});
+    mapped_ += len;
+
+    pin.window_ = &windows_.back();
+    pin.avail_ = static_cast<std::size_t>(start + len - offset);
+    pin.data_ = static_cast<unsigned char*>(base) + (offset - start);
+    return pin;
+}
+
+void PackWindowCache::release(const PackFile& pack) {
+    std::lock_guard<std::mutex> lock(mu_);
+    windows_.remove_if([&](const Window& w) {
+        if (w.pack != &pack) return false;
+        unmap(w);
+        return true;
+    });
+}
+
+std::size_t PackWindowCache::mapped_bytes() const {
+    std::lock_guard<std::mutex> lock(mu_);
+    return mapped_;
+}
+
+std::size_t PackWindowCache::window_count() const {
+    std::lock_guard<std::mutex> lock(mu_);
+    return windows_.size();
+}
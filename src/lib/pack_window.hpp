@@ -0,0 +1,84 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <list>
+#include <mutex>
+
+class PackFile;
+
+// Bounded set of mmap'ed windows over pack files. Windows are aligned to
+// half the window size, so a window returned for `offset` always covers at
+// least window_size/2 bytes past it (or up to EOF). When the total mapped
+// size would exceed the limit, the least recently used windows that nobody
+// is reading from are unmapped. Safe to share between threads.
+class PackWindowCache {
+public:
+    static constexpr std::size_t kDefaultWindowSize = 32u << 20;  // 32 MiB
+    static constexpr std::size_t kDefaultMappedLimit = 256u << 20; // 256 MiB
+
+    explicit PackWindowCache(std::size_t window_size = kDefaultWindowSize,
+                             std::size_t mapped_limit = kDefaultMappedLimit);
+    ~PackWindowCache();
+
+    PackWindowCache(const PackWindowCache&) = delete;
+    PackWindowCache& operator=(const PackWindowCache&) = delete;
+
+private:
+    struct Window;
+
+public:
+    // Pointer into a mapped window. The window stays mapped for as long as
+    // the Pin is alive; drop it as soon as the bytes are consumed.
+    class Pin {
+    public:
+        Pin() = default;
+        ~Pin() { reset(); }
+        Pin(Pin&& o) noexcept { *this = std::move(o); }
+        Pin& operator=(Pin&& o) noexcept;
+
+        const unsigned char* data() const { return data_; }
+        std::size_t avail() const { return avail_; } // contiguous bytes at data()
+        void reset();
+
+    private:
+        friend class PackWindowCache;
+        PackWindowCache* cache_ = nullptr;
+        Window* window_ = nullptr;
+        const unsigned char* data_ = nullptr;
+        std::size_t avail_ = 0;
+    };
+
+    // Maps (or reuses) a window covering `offset` inside `pack` with at
+    // least `min_avail` bytes from there on (fewer only at EOF). A cached
+    // window that ends sooner is not reused; min_avail must not exceed
+    // half the window size.
+    Pin use(const PackFile& pack, std::uint64_t offset, std::size_t min_avail = 1);
+
+    // Unmaps every window that belongs to `pack`.
+    void release(const PackFile& pack);
+
+    std::size_t mapped_bytes() const;
+    std::size_t window_count() const;
+
+private:
+    struct Window {
+        const PackFile* pack;
+        std::uint64_t offset;
+        std::size_t len;
+        unsigned char* base;
+        std::uint64_t last_used;
+        std::size_t pins = 0;
+    };
+
+    void unmap(const Window& w);
+    // False when every window is pinned; the mapping then goes over the limit
+    bool evict_lru();
+
+    mutable std::mutex mu_;
+    std::list<Window> windows_; // stable addresses for Pin
+    std::size_t window_size_;
+    std::size_t mapped_limit_;
+    std::size_t mapped_ = 0;
+    std::uint64_t tick_ = 0;
+};
@@ -0,0 +1,277 @@
+#include "pack_writer.hpp"
+
+#include "byte_order.hpp"
+#include "delta.hpp"
+#include "file_util.hpp"
+#include "hash.hpp"
+#include "pack.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <deque>
+#include <fcntl.h>
+#include <stdexcept>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <zlib.h>
+
+// Objects smaller than this are never worth deltifying
+static constexpr std::size_t kMinDeltaSize = 32;
+
+namespace {
+
+// Raw fd writer that keeps a running SHA-1 of everything written.
+class HashingWriter {
+public:
+    HashingWriter(fs::path tmpl, HashAlgo algo) : md_(algo) {
+        std::string name = tmpl.string();
+        fd_ = ::mkstemp(name.data());
+        if (fd_ < 0) {
+            throw std::runtime_error("cannot create temp file: " + name);
+        }
+        path_ = name;
+    }
+    // A temp file that was never finished is removed
+    ~HashingWriter() {
+        if (fd_ < 0) return;
+        ::close(fd_);
+        ::unlink(path_.c_str());
+    }
+    HashingWriter(const HashingWriter&) = delete;
+    HashingWriter& operator=(const HashingWriter&) = delete;
+
+    void write(const void* data, std::size_t len) {
+        md_.update(data, len);
+        write_raw(data, len);
+    }
+
+    // Appends the digest of everything written so far and returns it.
+    Oid finish() {
+        Oid digest{};
+        digest.algo = md_.algo();
+        md_.finish(digest.bytes);
+        write_raw(digest.bytes, digest.size());
+        ::fchmod(fd_, 0444);
+        if (::fsync(fd_) != 0) {
+            throw std::runtime_error("fsync failed: " + path_.string());
+        }
+        ::close(fd_);
+        fd_ = -1;
+        return digest;
+    }
+
+    std::uint64_t offset() const { return offset_; }
+    const fs::path& path() const { return path_; }
+
+private:
+    void write_raw(const void* data, std::size_t len) {
+        const auto* p = static_cast<const char*>(data);
+        while (len > 0) {
+            const ssize_t n = ::write(fd_, p, len);
+            if (n < 0) {
+                if (errno == EINTR) continue;
+                throw std::runtime_error("write failed: " + path_.string());
+            }
+            p += n;
+            len -= static_cast<std::size_t>(n);
+            offset_ += static_cast<std::uint64_t>(n);
+        }
+    }
+
+    int fd_ = -1;
+    fs::path path_;
+    Hasher md_;
+    std::uint64_t offset_ = 0;
+};
+
+struct PackItem {
+    Oid oid;
+    PackObjectType type;
+    std::size_t size;
+    std::uint64_t offset = 0;
+    std::uint32_t crc = 0;
+    int depth = 0;
+};
+
+struct WindowSlot {
+    std::size_t item;
+    std::string content;
+};
+
+} // namespace
+
+static PackObjectType pack_type_from_name(const std::string& type) {
+    if (type == "commit") return PackObjectType::Commit;
+    if (type == "tree")   return PackObjectType::Tree;
+    if (type == "blob")   return PackObjectType::Blob;
+    if (type == "tag")    return PackObjectType::Tag;
+    throw std::runtime_error("cannot pack object of type " + type);
+}
+
+static std::string encode_entry_header(PackObjectType type, std::size_t size) {
+    std::string out;
+    unsigned char c = static_cast<unsigned char>((static_cast<unsigned>(type) << 4) | (size & 0x0f));
+    size >>= 4;
+    while (size) {
+        out.push_back(static_cast<char>(c | 0x80));
+        c = size & 0x7f;
+        size >>= 7;
+    }
+    out.push_back(static_cast<char>(c));
+    return out;
+}
+
+// Inverse of the OFS_DELTA decoding in PackFile::read_entry_header
+static std::string encode_ofs(std::uint64_t rel) {
+    unsigned char buf[10];
+    std::size_t pos = sizeof(buf) - 1;
+    buf[pos] = rel & 0x7f;
+    while (rel >>= 7) {
+        buf[--pos] = static_cast<unsigned char>(0x80 | (--rel & 0x7f));
+    }
+    return std::string(reinterpret_cast<char*>(buf + pos), sizeof(buf) - pos);
+}
+
+static void write_index(const fs::path& tmpl, std::vector<PackItem> items, const Oid& pack_sum,
+                        fs::path& out_path) {
+    std::sort(items.begin(), items.end(), [](const PackItem& a, const PackItem& b) {
+        return std::memcmp(a.oid.bytes, b.oid.bytes, kMaxHashLen) < 0;
+    });
+
+    std::string buf;
+    buf.append("\377tOc", 4);
+    put_be32(buf, 2);
+
+    std::uint32_t fanout[256] = {};
+    for (const auto& it : items) ++fanout[it.oid.bytes[0]];
+    std::uint32_t running = 0;
+    for (std::uint32_t& f : fanout) {
+        running += f;
+        f = running;
+    }
+    for (std::uint32_t f : fanout) put_be32(buf, f);
+
+    for (const auto& it : items) buf.append(reinterpret_cast<const char*>(it.oid.bytes), it.oid.size());
+    for (const auto& it : items) put_be32(buf, it.crc);
+
+    std::string large;
+    std::uint32_t nlarge = 0;
+    for (const auto& it : items) {
+        if (it.offset < 0x80000000u) {
+            put_be32(buf, static_cast<std::uint32_t>(it.offset));
+        } else {
+            put_be32(buf, 0x80000000u | nlarge++);
+            put_be32(large, static_cast<std::uint32_t>(it.offset >> 32));
+            put_be32(large, static_cast<std::uint32_t>(it.offset));
+        }
+    }
+    buf.append(large);
+    buf.append(reinterpret_cast<const char*>(pack_sum.bytes), pack_sum.size());
+
+    HashingWriter w(tmpl, pack_sum.algo);
+    w.write(buf.data(), buf.size());
+    w.finish();
+    out_path = w.path();
+}
+
+PackWriteResult write_pack(const ObjectStore& store, const std::vector<Oid>& oids,
+                           const fs::path& pack_dir, const PackWriteOptions& opts) {
+    fs::create_directories(pack_dir);
+
+    // Pass 1: learn type and size so objects can be ordered before writing;
+    // headers only, the content is inflated once, in pass 2
+    std::vector<PackItem> items;
+    items.reserve(oids.size());
+    for (const auto& oid : oids) {
+        auto info = store.read_object_info(oid);
+        if (!info) throw std::runtime_error("pack: missing object " + oid.to_hex());
+        items.push_back(PackItem{oid, pack_type_from_name(info->type), info->size});
+    }
+
+    // Same type together, large first: deltas then mostly remove data,
+    // which encodes smaller than inserting it
+    std::sort(items.begin(), items.end(), [](const PackItem& a, const PackItem& b) {
+        if (a.type != b.type) return a.type < b.type;
+        if (a.size != b.size) return a.size > b.size;
+        return std::memcmp(a.oid.bytes, b.oid.bytes, kMaxHashLen) < 0;
+    });
+
+    PackWriteResult result;
+    result.objects = items.size();
+    const IObjectCodec& codec = store.pack_codec();
+    const int level = store.pack_compression();
+
+    HashingWriter pack(pack_dir / "tmp_pack_XXXXXX", store.hash_algo());
+    {
+        std::string hdr("PACK", 4);
+        put_be32(hdr, 2);
+        put_be32(hdr, static_cast<std::uint32_t>(items.size()));
+        pack.write(hdr.data(), hdr.size());
+    }
+
+    // Pass 2: sliding window delta search, writing entries in order
+    std::deque<WindowSlot> window;
+    for (std::size_t i = 0; i < items.size(); ++i) {
+        PackItem& item = items[i];
+        auto obj = store.read_object(item.oid);
+        if (!obj) throw std::runtime_error("pack: missing object " + item.oid.to_hex()); // pruned meanwhile
+        std::string content = std::move(obj->content);
+
+        std::optional<std::string> best_delta;
+        const WindowSlot* best_base = nullptr;
+        if (content.size() >= kMinDeltaSize) {
+            for (auto it = window.rbegin(); it != window.rend(); ++it) {
+                const PackItem& base = items[it->item];
+                if (base.type != item.type || base.depth >= opts.depth) continue;
+                if (base.size < item.size / 32) continue; // too small to help
+
+                std::size_t limit = content.size() / 2;
+                if (best_delta) limit = std::min(limit, best_delta->size() - 1);
+                if (auto d = create_delta(it->content, content, limit)) {
+                    best_delta = std::move(d);
+                    best_base = &*it;
+                }
+            }
+        }
+
+        item.offset = pack.offset();
+        std::string entry;
+        std::string data;
+        if (best_delta) {
+            const PackItem& base = items[best_base->item];
+            item.depth = base.depth + 1;
+            entry = encode_entry_header(PackObjectType::OfsDelta, best_delta->size());
+            entry += encode_ofs(item.offset - base.offset);
+            data = codec.compress(*best_delta, level_for(*best_delta, level));
+            ++result.deltas;
+        } else {
+            entry = encode_entry_header(item.type, content.size());
+            data = codec.compress(content, level_for(content, level));
+        }
+        entry += data;
+
+        item.crc = static_cast<std::uint32_t>(
+            crc32(0, reinterpret_cast<const Bytef*>(entry.data()), static_cast<uInt>(entry.size())));
+        pack.write(entry.data(), entry.size());
+
+        if (opts.window > 0) {
+            window.push_back(WindowSlot{i, std::move(content)});
+            if (window.size() > static_cast<std::size_t>(opts.window)) window.pop_front();
+        }
+    }
+
+    const Oid pack_sum = pack.finish();
+    result.name = pack_sum.to_hex();
+
+    fs::path idx_tmp;
+    write_index(pack_dir / "tmp_idx_XXXXXX", std::move(items), pack_sum, idx_tmp);
+
+    // Readers discover packs through the .idx, so it is published last
+    result.pack_path = pack_dir / ("pack-" + result.name + ".pack");
+    result.idx_path = pack_dir / ("pack-" + result.name + ".idx");
+    fs::rename(pack.path(), result.pack_path);
+    fs::rename(idx_tmp, result.idx_path);
+    fsync_dir(pack_dir);
+    return result;
+}
@@ -0,0 +1,30 @@
+#pragma once
+
+#include "object_store.hpp"
+
+#include <cstddef>
+#include <filesystem>
+#include <string>
+#include <vector>
+
+namespace fs = std::filesystem;
+
+struct PackWriteOptions {
+    int window = 10; // how many preceding objects are tried as delta bases
+    int depth = 50;  // maximum delta chain length
+};
+
+struct PackWriteResult {
+    std::string name; // hex pack checksum: pack-<name>.pack / .idx
+    fs::path pack_path;
+    fs::path idx_path;
+    std::size_t objects = 0;
+    std::size_t deltas = 0;
+};
+
+// Writes `oids` into a new pack (+ v2 index) inside `pack_dir`. Objects are
+// ordered by type and descending size, and each one is delta-compressed
+// (OFS_DELTA) against the best of the previous `window` objects of the same
+// type. Both files are fsync'ed before being renamed into place.
+PackWriteResult write_pack(const ObjectStore& store, const std::vector<Oid>& oids,
+                           const fs::path& pack_dir, const PackWriteOptions& opts = {});
@@ -0,0 +1,159 @@
+#include "refs.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <fstream>
+#include <iterator>
+#include <map>
+#include <stdexcept>
+#include <unistd.h>
+
+static constexpr int kMaxSymrefDepth = 5;
+
+static std::string_view trim_newline(std::string_view s) {
+    while (!s.empty() && (s.back() == '\n' || s.back() == '\r')) s.remove_suffix(1);
+    return s;
+}
+
+static bool is_null(const Oid& oid) {
+    return std::all_of(oid.bytes, oid.bytes + oid.size(), [](unsigned char b) { return b == 0; });
+}
+
+// Parses a ref's value; nullopt unless it is a full OID of `algo`
+static std::optional<Oid> parse_oid(std::string_view hex, HashAlgo algo) {
+    auto oid = Oid::from_hex(hex);
+    if (!oid || oid->algo != algo) return std::nullopt;
+    return oid;
+}
+
+Refs::Refs(fs::path git_dir, HashAlgo algo) : git_dir_(std::move(git_dir)), algo_(algo) {}
+
+std::optional<std::string> Refs::read_file(std::string_view ref) const {
+    std::ifstream in(git_dir_ / ref, std::ios::binary);
+    if (!in) return std::nullopt;
+    std::string text((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+    return std::string(trim_newline(text));
+}
+
+std::optional<Oid> Refs::read_packed(std::string_view ref) const {
+    std::ifstream in(git_dir_ / "packed-refs", std::ios::binary);
+    std::string line;
+    while (std::getline(in, line)) {
+        // "# pack-refs with: ..." header and "^<peeled>" lines
+        if (line.empty() || line[0] == '#' || line[0] == '^') continue;
+        const std::size_t sp = line.find(' ');
+        if (sp == std::string::npos) continue;
+        if (trim_newline(std::string_view(line).substr(sp + 1)) == ref) {
+            return parse_oid(std::string_view(line).substr(0, sp), algo_);
+        }
+    }
+    return std::nullopt;
+}
+
+std::string Refs::follow(std::string_view ref) const {
+    std::string name(ref);
+    for (int depth = 0; depth < kMaxSymrefDepth; ++depth) {
+        auto text = read_file(name);
+        if (!text || text->rfind("ref: ", 0) != 0) return name;
+        name = text->substr(5);
+    }
+    throw std::runtime_error("symbolic ref loop at " + std::string(ref));
+}
+
+std::optional<Oid> Refs::read(std::string_view ref) const {
+    const std::string name = follow(ref);
+    if (auto text = read_file(name)) return parse_oid(*text, algo_);
+    return read_packed(name);
+}
+
+std::optional<std::string> Refs::symbolic_target(std::string_view ref) const {
+    auto text = read_file(ref);
+    if (!text || text->rfind("ref: ", 0) != 0) return std::nullopt;
+    return follow(ref);
+}
+
+std::optional<Oid> Refs::resolve(std::string_view name) const {
+    if (name.size() == 2 * hash_len(algo_)) {
+        if (auto oid = parse_oid(name, algo_)) return oid;
+    }
+    if (name.empty() || name.find("..") != std::string_view::npos) return std::nullopt;
+
+    if (name == "HEAD" || name.rfind("refs/", 0) == 0) {
+        if (auto oid = read(name)) return oid;
+    }
+    for (std::string_view prefix : {"refs/", "refs/tags/", "refs/heads/", "refs/remotes/"}) {
+        if (auto oid = read(std::string(prefix) + std::string(name))) return oid;
+    }
+    return std::nullopt;
+}
+
+void Refs::update(std::string_view ref, const Oid& new_oid,
+                  const std::optional<Oid>& expected_old) const {
+    const std::string name = follow(ref);
+    const fs::path path = git_dir_ / name;
+    const fs::path lock = path.string() + ".lock";
+    fs::create_directories(path.parent_path());
+
+    const int fd = ::open(lock.c_str(), O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, 0666);
+    if (fd < 0) {
+        if (errno == EEXIST) {
+            throw std::runtime_error("cannot lock ref '" + name + "': '" + lock.string() +
+                                     "' exists; another process is updating it");
+        }
+        throw std::runtime_error("cannot lock ref '" + name + "': " + std::strerror(errno));
+    }
+
+    auto fail = [&](const std::string& msg) {
+        ::close(fd);
+        ::unlink(lock.c_str());
+        throw std::runtime_error("cannot update ref '" + name + "': " + msg);
+    };
+
+    // Checked under the lock, so nobody can move the ref in between
+    if (expected_old) {
+        const auto current = read(name);
+        const bool must_be_new = is_null(*expected_old);
+        if (must_be_new ? current.has_value() : current != expected_old) {
+            fail("expected " + (must_be_new ? std::string("no value") : expected_old->to_hex()) +
+                 ", found " + (current ? current->to_hex() : std::string("no value")));
+        }
+    }
+
+    const std::string line = new_oid.to_hex() + "\n";
+    if (::write(fd, line.data(), line.size()) != static_cast<ssize_t>(line.size()) ||
+        ::fsync(fd) != 0) {
+        fail(std::strerror(errno));
+    }
+    ::close(fd);
+    if (::rename(lock.c_str(), path.c_str()) != 0) {
+        const int err = errno;
+        ::unlink(lock.c_str());
+        throw std::runtime_error("cannot update ref '" + name + "': " + std::strerror(err));
+    }
+}
+
+std::vector<std::pair<std::string, Oid>> Refs::list() const {
+    std::map<std::string, Oid> refs;
+
+    std::ifstream in(git_dir_ / "packed-refs", std::ios::binary);
+    std::string line;
+    while (std::getline(in, line)) {
+        if (line.empty() || line[0] == '#' || line[0] == '^') continue;
+        const std::size_t sp = line.find(' ');
+        if (sp == std::string::npos) continue;
+        if (auto oid = parse_oid(std::string_view(line).substr(0, sp), algo_)) {
+            refs[std::string(trim_newline(std::string_view(line).substr(sp + 1)))] = *oid;
+        }
+    }
+
+    std::error_code ec;
+    for (fs::recursive_directory_iterator it(git_dir_ / "refs", ec), end; !ec && it != end;
+         it.increment(ec)) {
+        if (!it->is_regular_file() || it->path().extension() == ".lock") continue;
+        const std::string name = fs::relative(it->path(), git_dir_).generic_string();
+        if (auto oid = read(name)) refs[name] = *oid;
+    }
+    return {refs.begin(), refs.end()};
+}
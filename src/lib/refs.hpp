@@ -0,0 +1,59 @@
+#pragma once
+
+#include "oid.hpp"
+
+#include <filesystem>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+namespace fs = std::filesystem;
+
+// References under .git: loose ref files holding "<hex>\n", the
+// packed-refs file, and symbolic refs ("ref: refs/heads/main\n", as HEAD
+// usually is). Loose refs take precedence over packed ones.
+//
+// Updates follow Git's locking protocol: "<ref>.lock" is created with
+// O_EXCL, so two writers (this binary or git itself) can never update the
+// same ref at once; the new value is fsync'ed into the lock file, the old
+// value is checked while the lock is held, and the lock is renamed over the
+// ref. Readers see either the old or the new value, never a partial one.
+class Refs {
+public:
+    Refs(fs::path git_dir, HashAlgo algo);
+
+    // Value of a full ref name ("HEAD", "refs/heads/main"), following
+    // symbolic refs; nullopt when it does not exist (an unborn branch).
+    std::optional<Oid> read(std::string_view ref) const;
+
+    // Full ref name a symbolic ref points at ("refs/heads/main" for HEAD on
+    // main), or nullopt when `ref` is not symbolic (a detached HEAD).
+    std::optional<std::string> symbolic_target(std::string_view ref) const;
+
+    // Revision lookup the way Git spells it: a full hex OID, "HEAD", a full
+    // ref name, or a short one tried as refs/<name>, refs/tags/<name>,
+    // refs/heads/<name> and refs/remotes/<name>, in that order.
+    std::optional<Oid> resolve(std::string_view name) const;
+
+    // Points `ref` (after following symbolic refs) at `new_oid`. With
+    // `expected_old` set the update only happens if the ref still has that
+    // value, where an all-zero OID means "must not exist yet"; otherwise it
+    // throws and leaves the ref alone. Also throws when another writer
+    // holds the lock.
+    void update(std::string_view ref, const Oid& new_oid,
+                const std::optional<Oid>& expected_old = std::nullopt) const;
+
+    // Every loose and packed ref under refs/, sorted by name.
+    std::vector<std::pair<std::string, Oid>> list() const;
+
+private:
+    // Follows up to five levels of symbolic refs; returns the final ref name
+    std::string follow(std::string_view ref) const;
+    std::optional<std::string> read_file(std::string_view ref) const;
+    std::optional<Oid> read_packed(std::string_view ref) const;
+
+    fs::path git_dir_;
+    HashAlgo algo_;
+};
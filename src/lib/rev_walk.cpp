@@ -0,0 +1,293 @@
+#include "rev_walk.hpp"
+
+#include "commit.hpp"
+#include "entry.hpp"
+
+#include <algorithm>
+#include <charconv>
+#include <stdexcept>
+#include <string>
+#include <unordered_set>
+
+// ------------------------------------------------------------ CommitIndex
+
+CommitIndex::CommitIndex(const ObjectStore& store, const CommitGraph* graph)
+    : store_(store), graph_(graph), graph_count_(graph ? graph->count() : 0) {}
+
+std::uint32_t CommitIndex::lookup(const Oid& oid) {
+    if (graph_) {
+        if (auto pos = graph_->find(oid)) return *pos;
+    }
+    auto [it, inserted] = extra_index_.emplace(oid, size());
+    if (inserted) extra_.emplace_back().oid = oid;
+    return it->second;
+}
+
+Oid CommitIndex::oid(std::uint32_t n) const {
+    return n < graph_count_ ? graph_->oid_at(n) : extra_[n - graph_count_].oid;
+}
+
+CommitIndex::Extra& CommitIndex::extra(std::uint32_t n) {
+    Extra& e = extra_[n - graph_count_];
+    if (e.parsed) return e;
+
+    const auto obj = store_.read_object(e.oid);
+    if (!obj) throw std::runtime_error("missing commit " + e.oid.to_hex());
+    if (obj->type != "commit") throw std::runtime_error(e.oid.to_hex() + " is a " + obj->type + ", not a commit");
+    const Commit c = Commit::parse(obj->content, store_.hash_algo());
+    // lookup() may grow extra_, so `e` is not used past this point
+    std::vector<std::uint32_t> parents;
+    parents.reserve(c.parents.size());
+    for (const Oid& p : c.parents) parents.push_back(lookup(p));
+
+    Extra& done = extra_[n - graph_count_];
+    done.tree = c.tree;
+    done.time = c.commit_time();
+    done.parents = std::move(parents);
+    done.parsed = true;
+    ++parsed_;
+    return done;
+}
+
+std::int64_t CommitIndex::commit_time(std::uint32_t n) {
+    return n < graph_count_ ? graph_->commit_time(n) : extra(n).time;
+}
+
+std::uint32_t CommitIndex::generation(std::uint32_t n) {
+    if (n < graph_count_) return graph_->generation(n);
+    extra(n); // still has to be a commit
+    return kGenerationInfinity;
+}
+
+Oid CommitIndex::tree(std::uint32_t n) {
+    return n < graph_count_ ? graph_->tree_at(n) : extra(n).tree;
+}
+
+void CommitIndex::parents(std::uint32_t n, std::vector<std::uint32_t>& out) {
+    out.clear();
+    if (n < graph_count_) {
+        graph_->parents(n, out);
+        return;
+    }
+    const Extra& e = extra(n);
+    out.assign(e.parents.begin(), e.parents.end());
+}
+
+// -------------------------------------------------------------- revisions
+
+// Commit payload of `oid` after peeling annotated tags; nullopt otherwise
+static std::optional<std::pair<Oid, Commit>> peel_to_commit(const ObjectStore& store, Oid oid) {
+    for (int depth = 0; depth < 16; ++depth) {
+        const auto obj = store.read_object(oid);
+        if (!obj) return std::nullopt;
+        if (obj->type == "commit") return std::make_pair(oid, Commit::parse(obj->content, store.hash_algo()));
+        if (obj->type != "tag") return std::nullopt;
+        auto target = tag_target(obj->content);
+        if (!target) return std::nullopt;
+        oid = *target;
+    }
+    return std::nullopt;
+}
+
+std::optional<Oid> resolve_revision(const ObjectStore& store, const Refs& refs, std::string_view spec) {
+    const std::size_t suffix = spec.find_first_of("^~");
+    auto base = refs.resolve(spec.substr(0, suffix));
+    if (!base) return std::nullopt;
+    auto commit = peel_to_commit(store, *base);
+    if (!commit) return std::nullopt;
+
+    std::string_view rest = suffix == std::string_view::npos ? "" : spec.substr(suffix);
+    while (!rest.empty()) {
+        const char op = rest[0];
+        rest.remove_prefix(1);
+        unsigned long n = 1;
+        if (!rest.empty() && rest[0] >= '0' && rest[0] <= '9') {
+            auto [end, ec] = std::from_chars(rest.data(), rest.data() + rest.size(), n);
+            if (ec != std::errc()) return std::nullopt;
+            rest.remove_prefix(static_cast<std::size_t>(end - rest.data()));
+        } else if (!rest.empty() && rest[0] != '^' && rest[0] != '~') {
+            return std::nullopt;
+        }
+
+        // "^<n>": n-th parent (^0 is the commit itself); "~<n>": n first parents
+        const unsigned long steps = op == '^' ? (n == 0 ? 0 : 1) : n;
+        const unsigned long pick = op == '^' ? n : 1;
+        for (unsigned long i = 0; i < steps; ++i) {
+            if (commit->second.parents.size() < pick) return std::nullopt;
+            commit = peel_to_commit(store, commit->second.parents[pick - 1]);
+            if (!commit) return std::nullopt;
+        }
+    }
+    return commit->first;
+}
+
+// ---------------------------------------------------------------- RevWalk
+
+RevWalk::RevWalk(const ObjectStore& store, const CommitGraph* graph) : index_(store, graph) {
+    if (graph) bits_.resize((std::size_t(graph->count()) * kFlagCount + 63) / 64);
+}
+
+void RevWalk::set(unsigned flag, std::uint32_t n) {
+    const std::size_t bit = std::size_t(n) * kFlagCount + flag;
+    if (bit / 64 >= bits_.size()) bits_.resize(bit / 64 + 1);
+    bits_[bit / 64] |= std::uint64_t{1} << (bit % 64);
+}
+
+void RevWalk::clear(unsigned flag, std::uint32_t n) {
+    const std::size_t bit = std::size_t(n) * kFlagCount + flag;
+    if (bit / 64 < bits_.size()) bits_[bit / 64] &= ~(std::uint64_t{1} << (bit % 64));
+}
+
+void RevWalk::push(const Oid& commit, bool hidden) {
+    if (started_) throw std::logic_error("RevWalk::push after next()");
+    const std::uint32_t n = index_.lookup(commit);
+    index_.commit_time(n); // must be a commit
+    if (hidden) {
+        has_hidden_ = true;
+        set(kHidden, n);
+    }
+    if (test(kSeen, n)) return;
+    set(kSeen, n);
+    tips_.push_back(n);
+}
+
+void RevWalk::enqueue(std::uint32_t n) {
+    set(kQueued, n);
+    queue_.push(DateItem{index_.commit_time(n), seq_++, n});
+}
+
+void RevWalk::hide_from(std::uint32_t n) {
+    std::vector<std::uint32_t> stack{n};
+    std::vector<std::uint32_t> parents;
+    set(kHidden, n);
+    if (test(kQueued, n)) --interesting_;
+    while (!stack.empty()) {
+        const std::uint32_t m = stack.back();
+        stack.pop_back();
+        index_.parents(m, parents);
+        for (std::uint32_t p : parents) {
+            if (!test(kSeen, p) || test(kHidden, p)) continue;
+            set(kHidden, p);
+            if (test(kQueued, p)) --interesting_;
+            stack.push_back(p);
+        }
+    }
+}
+
+void RevWalk::limit() {
+    std::priority_queue<GenItem> queue;
+    auto push = [&](std::uint32_t n) {
+        set(kQueued, n);
+        queue.push(GenItem{index_.generation(n), index_.commit_time(n), seq_++, n});
+        if (!test(kHidden, n)) ++interesting_;
+    };
+    for (std::uint32_t n : tips_) push(n);
+
+    // Nothing reachable from a hidden commit can be interesting, so the
+    // walk can end once only hidden commits are queued: in generation order
+    // none of them can reach a commit already shown. Outside the graph only
+    // dates are known, so like Git keep going until kSlop commits in a row
+    // were older than the one before, to ride out clock skew.
+    std::vector<std::uint32_t> parents;
+    std::int64_t last_time = 0;
+    int slop = kSlop;
+    while (!queue.empty()) {
+        const GenItem& top = queue.top();
+        if (interesting_ > 0) {
+            slop = kSlop;
+        } else if (top.generation != CommitIndex::kGenerationInfinity) {
+            break;
+        } else if (top.time >= last_time) {
+            slop = kSlop;
+        } else if (--slop == 0) {
+            break;
+        }
+        const std::uint32_t n = top.n;
+        last_time = top.time;
+        queue.pop();
+        clear(kQueued, n);
+        const bool hidden = test(kHidden, n);
+        if (!hidden) --interesting_;
+
+        index_.parents(n, parents);
+        for (std::uint32_t p : parents) {
+            if (!test(kSeen, p)) {
+                set(kSeen, p);
+                if (hidden) set(kHidden, p);
+                push(p);
+            } else if (hidden && !test(kHidden, p)) {
+                hide_from(p);
+            }
+        }
+    }
+    for (; !queue.empty(); queue.pop()) clear(kQueued, queue.top().n);
+}
+
+std::optional<Oid> RevWalk::next() {
+    if (!started_) {
+        started_ = true;
+        if (has_hidden_) limit();
+        for (std::uint32_t n : tips_) {
+            if (!test(kHidden, n) && !test(kQueued, n)) enqueue(n);
+        }
+    }
+
+    if (queue_.empty()) return std::nullopt;
+    const std::uint32_t n = queue_.top().n;
+    queue_.pop();
+    clear(kQueued, n);
+    set(kEmitted, n);
+
+    // After limit() every commit that is not hidden has been checked, so
+    // the walk can follow them without looking further
+    index_.parents(n, parents_);
+    for (std::uint32_t p : parents_) {
+        if (!test(kHidden, p) && !test(kQueued, p) && !test(kEmitted, p)) enqueue(p);
+    }
+    return index_.oid(n);
+}
+
+// ----------------------------------------------------------------- objects
+
+static std::string read_tree(const ObjectStore& store, const Oid& oid) {
+    auto obj = store.read_object(oid);
+    if (!obj) throw std::runtime_error("missing tree " + oid.to_hex());
+    if (obj->type != "tree") throw std::runtime_error(oid.to_hex() + " is a " + obj->type + ", not a tree");
+    return std::move(obj->content);
+}
+
+void walk_objects(const ObjectStore& store, const std::vector<Oid>& trees, const std::vector<Oid>& excluded,
+                  const std::function<void(const Oid&, std::string_view)>& emit) {
+    const HashAlgo algo = store.hash_algo();
+    std::unordered_set<Oid, OidHash> seen;
+
+    std::vector<Oid> stack(excluded.begin(), excluded.end());
+    while (!stack.empty()) {
+        const Oid oid = stack.back();
+        stack.pop_back();
+        if (!seen.insert(oid).second) continue;
+        const std::string content = read_tree(store, oid);
+        for (const EntryView& e : TreeView(content, algo)) {
+            if (e.is_tree()) stack.push_back(e.oid());
+            else if (e.mode != EntryMode::Gitlink) seen.insert(e.oid());
+        }
+    }
+
+    std::string path;
+    auto visit = [&](auto& self, const Oid& tree) -> void {
+        if (!seen.insert(tree).second) return;
+        emit(tree, path);
+        const std::string content = read_tree(store, tree);
+        const std::size_t len = path.size();
+        for (const EntryView& e : TreeView(content, algo)) {
+            if (e.mode == EntryMode::Gitlink) continue;
+            path.resize(len);
+            if (len) path += '/';
+            path += e.name;
+            if (e.is_tree()) self(self, e.oid());
+            else if (seen.insert(e.oid()).second) emit(e.oid(), path);
+        }
+        path.resize(len);
+    };
+    for (const Oid& tree : trees) visit(visit, tree);
+}
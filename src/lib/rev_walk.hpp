@@ -0,0 +1,148 @@
+#pragma once
+
+#include "commit_graph.hpp"
+#include "object_store.hpp"
+#include "refs.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <optional>
+#include <queue>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+// Dense numbering of the commits a walk touches. Commit-graph positions are
+// used as-is; commits outside the graph are numbered after them as they are
+// first mentioned and parsed from their objects on first use. Per-commit
+// walk state can then live in flat vectors and bitsets indexed by number.
+class CommitIndex {
+public:
+    // Generation of commits outside the graph: they may reach anything
+    static constexpr std::uint32_t kGenerationInfinity = 0xFFFFFFFF;
+
+    CommitIndex(const ObjectStore& store, const CommitGraph* graph);
+
+    // Number for `oid`; does not read the object
+    std::uint32_t lookup(const Oid& oid);
+    // One past the largest number handed out so far
+    std::uint32_t size() const { return graph_count_ + static_cast<std::uint32_t>(extra_.size()); }
+
+    Oid oid(std::uint32_t n) const;
+    // The accessors below parse commits outside the graph; they throw
+    // std::runtime_error when the object is missing or not a commit.
+    std::int64_t commit_time(std::uint32_t n);
+    std::uint32_t generation(std::uint32_t n);
+    Oid tree(std::uint32_t n);
+    // Replaces `out` with the parent numbers of `n`, in commit order
+    void parents(std::uint32_t n, std::vector<std::uint32_t>& out);
+
+    // Commits read from their objects rather than the graph
+    std::size_t parsed() const { return parsed_; }
+
+private:
+    struct Extra {
+        Oid oid;
+        bool parsed = false;
+        Oid tree;
+        std::int64_t time = 0;
+        std::vector<std::uint32_t> parents;
+    };
+    Extra& extra(std::uint32_t n);
+
+    const ObjectStore& store_;
+    const CommitGraph* graph_;
+    std::uint32_t graph_count_;
+    std::vector<Extra> extra_;
+    std::unordered_map<Oid, std::uint32_t, OidHash> extra_index_;
+    std::size_t parsed_ = 0;
+};
+
+// Parses a revision: a full hex OID or ref name (see Refs::resolve),
+// followed by any number of "^", "^<n>" (n-th parent) and "~<n>" (n-th
+// first-parent ancestor) suffixes. Annotated tags are peeled to the commit
+// they point at. nullopt when it does not name a commit.
+std::optional<Oid> resolve_revision(const ObjectStore& store, const Refs& refs, std::string_view spec);
+
+// Commit traversal in Git's default rev-list order: newest commit date
+// first, ties in the order the commits were found.
+//
+// Without hidden commits the walk streams: each next() pops the newest
+// queued commit and queues its unseen parents. With hidden commits
+// ("^A", "A..B") a limiting pass runs first, in generation order (then
+// date), marking everything reachable from a hidden commit; it ends as soon
+// as only hidden commits are queued. Generation numbers make that cut-off
+// exact for commits in the commit-graph, so "A..B" reads only the commits
+// between the two plus the boundary, however long the shared history;
+// commits outside the graph fall back to Git's date heuristic, which clock
+// skew can fool. The interesting commits are then emitted in date order.
+class RevWalk {
+public:
+    // `graph` may be null; it must outlive the walk.
+    RevWalk(const ObjectStore& store, const CommitGraph* graph);
+
+    // Start points; hidden ones exclude everything they reach. Must be
+    // called before the first next().
+    void push(const Oid& commit, bool hidden = false);
+
+    std::optional<Oid> next();
+
+    CommitIndex& commits() { return index_; }
+    // Whether commit `n` is reachable from a hidden commit, as far as the
+    // walk has looked
+    bool hidden(std::uint32_t n) const { return test(kHidden, n); }
+
+private:
+    enum Flag : unsigned { kSeen, kHidden, kQueued, kEmitted, kFlagCount };
+    static constexpr int kSlop = 5;
+
+    bool test(unsigned flag, std::uint32_t n) const {
+        const std::size_t bit = std::size_t(n) * kFlagCount + flag;
+        return bit / 64 < bits_.size() && (bits_[bit / 64] >> (bit % 64)) & 1;
+    }
+    void set(unsigned flag, std::uint32_t n);
+    void clear(unsigned flag, std::uint32_t n);
+
+    // Limiting pass for hidden commits
+    void limit();
+    // Marks `n` and every seen ancestor of it hidden
+    void hide_from(std::uint32_t n);
+    void enqueue(std::uint32_t n);
+
+    struct DateItem {
+        std::int64_t time;
+        std::uint64_t seq;
+        std::uint32_t n;
+        bool operator<(const DateItem& o) const {
+            return time != o.time ? time < o.time : seq > o.seq; // newest, then first found
+        }
+    };
+    struct GenItem {
+        std::uint32_t generation;
+        std::int64_t time;
+        std::uint64_t seq;
+        std::uint32_t n;
+        bool operator<(const GenItem& o) const {
+            if (generation != o.generation) return generation < o.generation;
+            return time != o.time ? time < o.time : seq > o.seq;
+        }
+    };
+
+    CommitIndex index_;
+    std::vector<std::uint64_t> bits_; // kFlagCount bits per commit number
+    std::vector<std::uint32_t> tips_;
+    bool has_hidden_ = false;
+    std::size_t interesting_ = 0; // queued in limit() and not hidden
+    bool started_ = false;
+    std::uint64_t seq_ = 0;
+    std::priority_queue<DateItem> queue_;
+    std::vector<std::uint32_t> parents_; // scratch
+};
+
+// The trees and blobs below `trees` in Git's "rev-list --objects" order:
+// each tree depth-first with entries in tree order, every object once.
+// Everything below `excluded` (the trees of the boundary commits) is left
+// out. emit(oid, path) gets an empty path for the trees in `trees`.
+void walk_objects(const ObjectStore& store, const std::vector<Oid>& trees, const std::vector<Oid>& excluded,
+                  const std::function<void(const Oid&, std::string_view)>& emit);
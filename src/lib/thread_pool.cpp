@@ -0,0 +1,106 @@
+#include "thread_pool.hpp"
+
+#include <utility>
+
+// Set on worker threads, so that submit() can tell which deque is local
+static thread_local const ThreadPool* tl_pool = nullptr;
+static thread_local std::size_t tl_index = 0;
+
+ThreadPool::ThreadPool(std::size_t threads) {
+    if (threads == 0) threads = 1;
+    queues_.reserve(threads);
+    for (std::size_t i = 0; i < threads; ++i) queues_.push_back(std::make_unique<Queue>());
+    workers_.reserve(threads);
+    for (std::size_t i = 0; i < threads; ++i) {
+        workers_.emplace_back([this, i] { worker_loop(i); });
+    }
+}
+
+ThreadPool::~ThreadPool() {
+    {
+        std::lock_guard<std::mutex> lock(mu_);
+        stopping_ = true;
+    }
+    work_cv_.notify_all();
+    for (auto& t : workers_) t.join();
+}
+
+void ThreadPool::submit(std::function<void()> task) {
+    {
+        std::lock_guard<std::mutex> lock(mu_);
+        ++pending_;
+    }
+    const std::size_t q = tl_pool == this ? tl_index : next_queue_++ % queues_.size();
+    {
+        std::lock_guard<std::mutex> lock(queues_[q]->mu);
+        queues_[q]->tasks.push_back(std::move(task));
+    }
+    queued_.fetch_add(1);
+    {
+        // Sleepers test queued_ under mu_; taking it here means a worker is
+        // either past its test or already waiting, so the wakeup is not lost
+        std::lock_guard<std::mutex> lock(mu_);
+    }
+    work_cv_.notify_one();
+}
+
+void ThreadPool::wait_idle() {
+    std::unique_lock<std::mutex> lock(mu_);
+    idle_cv_.wait(lock, [this] { return pending_ == 0; });
+    if (error_) {
+        auto err = std::exchange(error_, nullptr);
+        std::rethrow_exception(err);
+    }
+}
+
+bool ThreadPool::take(std::size_t self, std::function<void()>& task) {
+    {
+        Queue& own = *queues_[self];
+        std::lock_guard<std::mutex> lock(own.mu);
+        if (!own.tasks.empty()) {
+            task = std::move(own.tasks.back());
+            own.tasks.pop_back();
+            queued_.fetch_sub(1);
+            return true;
+        }
+    }
+    for (std::size_t i = 1; i < queues_.size(); ++i) {
+        Queue& victim = *queues_[(self + i) % queues_.size()];
+        std::lock_guard<std::mutex> lock(victim.mu);
+        if (!victim.tasks.empty()) {
+            task = std::move(victim.tasks.front());
+            victim.tasks.pop_front();
+            queued_.fetch_sub(1);
+            return true;
+        }
+    }
+    return false;
+}
+
+void ThreadPool::worker_loop(std::size_t self) {
+    tl_pool = this;
+    tl_index = self;
+
+    while (true) {
+        std::function<void()> task;
+        if (!take(self, task)) {
+            std::unique_lock<std::mutex> lock(mu_);
+            work_cv_.wait(lock, [this] { return stopping_ || queued_.load() > 0; });
+            if (stopping_ && queued_.load() == 0) return; // stopping and drained
+            continue;
+        }
+
+        try {
+            task();
+        } catch (...) {
+            std::lock_guard<std::mutex> lock(mu_);
+            if (!error_) error_ = std::current_exception();
+        }
+        task = nullptr; // release captures before the task counts as done
+
+        {
+            std::lock_guard<std::mutex> lock(mu_);
+            if (--pending_ == 0) idle_cv_.notify_all();
+        }
+    }
+}
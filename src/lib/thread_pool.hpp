@@ -0,0 +1,56 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Fixed-size work-stealing pool. Every worker owns a deque: tasks submitted
+// from inside a task go to the submitting worker's deque and are run
+// newest-first (depth-first, cache-warm), while idle workers steal the
+// oldest task from the others. Tasks submitted from outside the pool are
+// dealt round-robin. wait_idle() returns once every task has finished, and
+// rethrows the first exception a task threw.
+class ThreadPool {
+public:
+    explicit ThreadPool(std::size_t threads = std::thread::hardware_concurrency());
+    ~ThreadPool();
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    void submit(std::function<void()> task);
+    void wait_idle();
+
+    std::size_t size() const { return workers_.size(); }
+
+private:
+    struct Queue {
+        std::mutex mu;
+        std::deque<std::function<void()>> tasks;
+    };
+
+    void worker_loop(std::size_t self);
+    // Own deque from the back, then the others from the front
+    bool take(std::size_t self, std::function<void()>& task);
+
+    std::vector<std::unique_ptr<Queue>> queues_; // one per worker
+    std::vector<std::thread> workers_;
+    std::atomic<std::size_t> next_queue_{0};
+
+    // Sleeping and idle detection. `queued_` counts tasks sitting in a
+    // deque, `pending_` tasks that were submitted and have not finished.
+    std::mutex mu_;
+    std::condition_variable work_cv_;
+    std::condition_variable idle_cv_;
+    std::atomic<std::size_t> queued_{0};
+    std::size_t pending_ = 0;
+    bool stopping_ = false;
+    std::exception_ptr error_;
+};
@@ -1,16 +1,89 @@
 #include "i_object_codec.hpp"
-#include "zstr.hpp"
+
+#include <algorithm>
+#include <climits>
 #include <cstddef>
 #include <stdexcept>
 #include <zlib.h>
 
+namespace {
+
+class ZlibEncoder : public StreamEncoder {
+public:
+    explicit ZlibEncoder(int level) {
+        if (deflateInit(&zs_, level) != Z_OK) {
+            throw std::runtime_error("deflateInit failed");
+        }
+    }
+    ~ZlibEncoder() override { deflateEnd(&zs_); }
+
+    void write(std::string_view in, bool finish,
+               const std::function<void(std::string_view)>& sink) override {
+        zs_.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(in.data()));
+        zs_.avail_in = static_cast<uInt>(in.size());
+        do {
+            zs_.next_out = reinterpret_cast<Bytef*>(out_);
+            zs_.avail_out = sizeof(out_);
+            if (deflate(&zs_, finish ? Z_FINISH : Z_NO_FLUSH) == Z_STREAM_ERROR) {
+                throw std::runtime_error("zlib deflate failed");
+            }
+            const std::size_t n = sizeof(out_) - zs_.avail_out;
+            if (n) sink(std::string_view(out_, n));
+        } while (zs_.avail_out == 0);
+    }
+
+private:
+    z_stream zs_{};
+    char out_[64 * 1024];
+};
+
+class ZlibDecoder : public StreamDecoder {
+public:
+    ZlibDecoder() {
+        if (inflateInit(&zs_) != Z_OK) {
+            throw std::runtime_error("inflateInit failed");
+        }
+    }
+    ~ZlibDecoder() override { inflateEnd(&zs_); }
+
+    std::size_t decode(std::string_view& in, char* out, std::size_t out_len, bool& done) override {
+        zs_.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(in.data()));
+        zs_.avail_in = static_cast<uInt>(std::min<std::size_t>(in.size(), UINT_MAX));
+        zs_.next_out = reinterpret_cast<Bytef*>(out);
+        zs_.avail_out = static_cast<uInt>(std::min<std::size_t>(out_len, UINT_MAX));
+        const uInt in_before = zs_.avail_in;
+        const uInt out_before = zs_.avail_out;
+
+        const int ret = inflate(&zs_, Z_NO_FLUSH);
+        if (ret == Z_STREAM_END) {
+            done = true;
+        } else if (ret != Z_OK && ret != Z_BUF_ERROR) {
+            throw std::runtime_error("corrupt zlib stream");
+        }
+        in.remove_prefix(in_before - zs_.avail_in);
+        return out_before - zs_.avail_out;
+    }
+
+private:
+    z_stream zs_{};
+};
+
 class ZlibCodec: public IObjectCodec {
 public:
-    std::string compress(std::string_view s) override {
-        
-        const char* data = s.data(); 
+    const char* name() const override { return "zlib"; }
+    bool zlib_compatible() const override { return true; }
+
+    bool recognizes(std::string_view p) const override {
+        // CMF/FLG: deflate method and a header checksum divisible by 31
+        if (p.size() < 2) return false;
+        const auto cmf = static_cast<unsigned char>(p[0]);
+        const auto flg = static_cast<unsigned char>(p[1]);
+        return (cmf & 0x0f) == 8 && ((cmf << 8) | flg) % 31 == 0;
+    }
+
+    std::string compress(std::string_view s, int level) const override {
+        const char* data = s.data();
         std::size_t len = s.size();
-        int level = Z_DEFAULT_COMPRESSION;
 
         auto cap = compressBound(len);        // upper bound for compressed size
         std::string out;
@@ -23,13 +96,31 @@ public:
         return out;
     }
 
-    std::string decompress(std::string_view s) override {
-        std::stringbuf buf;
-        buf.sputn(s.data(), s.size());
-        zstr::istream in(&buf);
-        return {std::istreambuf_iterator<char>(in), {}};
+    std::string decompress(std::string_view s, std::size_t size_hint) const override {
+        std::string out(size_hint ? size_hint : std::max<std::size_t>(s.size() * 4, 256), '\0');
+        ZlibDecoder dec;
+        std::size_t len = 0;
+        bool done = false;
+        while (!done) {
+            const std::size_t in_before = s.size();
+            len += dec.decode(s, out.data() + len, out.size() - len, done);
+            if (done || s.size() != in_before) continue;
+            // No progress: either the output is full or the input ran out
+            if (len < out.size()) throw std::runtime_error("truncated zlib stream");
+            out.resize(out.size() * 2);
+        }
+        out.resize(len);
+        return out;
     }
-}; 
+
+    // Git's levels are zlib's, and kDefaultLevel is Z_DEFAULT_COMPRESSION
+    std::unique_ptr<StreamEncoder> encoder(int level) const override {
+        return std::make_unique<ZlibEncoder>(level);
+    }
+    std::unique_ptr<StreamDecoder> decoder() const override { return std::make_unique<ZlibDecoder>(); }
+};
+
+} // namespace
 
 std::unique_ptr<IObjectCodec> make_zlib_codec() {
     return std::make_unique<ZlibCodec>();
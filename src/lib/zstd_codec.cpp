@@ -0,0 +1,128 @@
+#include "i_object_codec.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+#include <zstd.h>
+
+static constexpr int kDefault = 3; // zstd's default
+
+// Git's 1..9 are used as is; 0 ("store") becomes zstd's fastest regular
+// level, which emits raw blocks for data it cannot shrink anyway
+static int zstd_level(int level) {
+    return level < 0 ? kDefault : std::max(level, 1);
+}
+
+namespace {
+
+void check(std::size_t ret) {
+    if (ZSTD_isError(ret)) throw std::runtime_error(std::string("zstd: ") + ZSTD_getErrorName(ret));
+}
+
+class ZstdEncoder : public StreamEncoder {
+public:
+    explicit ZstdEncoder(int level) : cctx_(ZSTD_createCCtx()) {
+        if (!cctx_) throw std::runtime_error("zstd: cannot allocate context");
+        ZSTD_CCtx_setParameter(cctx_, ZSTD_c_compressionLevel, zstd_level(level));
+    }
+    ~ZstdEncoder() override { ZSTD_freeCCtx(cctx_); }
+
+    void write(std::string_view in, bool finish,
+               const std::function<void(std::string_view)>& sink) override {
+        ZSTD_inBuffer ib{in.data(), in.size(), 0};
+        const ZSTD_EndDirective mode = finish ? ZSTD_e_end : ZSTD_e_continue;
+        while (true) {
+            ZSTD_outBuffer ob{out_, sizeof(out_), 0};
+            const std::size_t remaining = ZSTD_compressStream2(cctx_, &ob, &ib, mode);
+            check(remaining);
+            if (ob.pos) sink(std::string_view(out_, ob.pos));
+            // e_end: done once nothing is left to flush; e_continue: once
+            // all input is consumed
+            if (finish ? remaining == 0 : ib.pos == ib.size) break;
+        }
+    }
+
+private:
+    ZSTD_CCtx* cctx_;
+    char out_[64 * 1024];
+};
+
+class ZstdDecoder : public StreamDecoder {
+public:
+    ZstdDecoder() : dctx_(ZSTD_createDCtx()) {
+        if (!dctx_) throw std::runtime_error("zstd: cannot allocate context");
+    }
+    ~ZstdDecoder() override { ZSTD_freeDCtx(dctx_); }
+
+    std::size_t decode(std::string_view& in, char* out, std::size_t out_len, bool& done) override {
+        ZSTD_inBuffer ib{in.data(), in.size(), 0};
+        ZSTD_outBuffer ob{out, out_len, 0};
+        const std::size_t ret = ZSTD_decompressStream(dctx_, &ob, &ib);
+        check(ret);
+        if (ret == 0) done = true; // frame complete and fully flushed
+        in.remove_prefix(ib.pos);
+        return ob.pos;
+    }
+
+private:
+    ZSTD_DCtx* dctx_;
+};
+
+// zstd frames instead of zlib streams: faster to decode, but loose objects
+// written this way can only be read by this implementation.
+class ZstdCodec : public IObjectCodec {
+public:
+    const char* name() const override { return "zstd"; }
+    bool zlib_compatible() const override { return false; }
+
+    bool recognizes(std::string_view p) const override {
+        static const char kMagic[4] = {'\x28', '\xb5', '\x2f', '\xfd'};
+        return p.size() >= 4 && std::memcmp(p.data(), kMagic, 4) == 0;
+    }
+
+    std::string compress(std::string_view s, int level) const override {
+        std::string out(ZSTD_compressBound(s.size()), '\0');
+        // ZSTD_compress records the content size in the frame header
+        const std::size_t n = ZSTD_compress(out.data(), out.size(), s.data(), s.size(), zstd_level(level));
+        check(n);
+        out.resize(n);
+        return out;
+    }
+
+    std::string decompress(std::string_view s, std::size_t size_hint) const override {
+        const unsigned long long framed = ZSTD_getFrameContentSize(s.data(), s.size());
+        if (framed != ZSTD_CONTENTSIZE_UNKNOWN && framed != ZSTD_CONTENTSIZE_ERROR) {
+            std::string out(static_cast<std::size_t>(framed), '\0');
+            const std::size_t n = ZSTD_decompress(out.data(), out.size(), s.data(), s.size());
+            check(n);
+            out.resize(n);
+            return out;
+        }
+
+        // Streamed frames carry no size
+        std::string out(size_hint ? size_hint : std::max<std::size_t>(s.size() * 4, 256), '\0');
+        ZstdDecoder dec;
+        std::size_t len = 0;
+        bool done = false;
+        while (!done) {
+            if (len == out.size()) out.resize(out.size() * 2);
+            const std::size_t before = s.size();
+            const std::size_t n = dec.decode(s, out.data() + len, out.size() - len, done);
+            len += n;
+            if (!done && n == 0 && s.size() == before) throw std::runtime_error("zstd: truncated frame");
+        }
+        out.resize(len);
+        return out;
+    }
+
+    std::unique_ptr<StreamEncoder> encoder(int level) const override {
+        return std::make_unique<ZstdEncoder>(level);
+    }
+    std::unique_ptr<StreamDecoder> decoder() const override { return std::make_unique<ZstdDecoder>(); }
+};
+
+} // namespace
+
+std::unique_ptr<IObjectCodec> make_zstd_codec() {
+    return std::make_unique<ZstdCodec>();
+}
@@ -1,8 +1,10 @@
 #include "lib/commands.hpp"
+#include "lib/config.hpp"
 #include "lib/object_store.hpp"
 #include <cstdlib>
 #include <filesystem>
 #include <iostream>
+#include <optional>
 
 namespace fs = std::filesystem;
 
@@ -21,6 +23,8 @@ fs::path find_repo_root(fs::path start = fs::current_path()) {
 }
 
 int main(int argc, char *argv[]) {
+  // Give cout/cin their own buffers; cat-file --batch relies on this
+  std::ios::sync_with_stdio(false);
   std::cout << std::unitbuf;
   std::cerr << std::unitbuf;
 
@@ -35,11 +39,9 @@ int main(int argc, char *argv[]) {
     return EXIT_FAILURE;
   }
 
-  // Build codec for the store
-  auto codec = make_zlib_codec();
-
   // Special-case init: don't try to discover a repo before it exists.
   if (cmd_name == "init") {
+    auto codec = make_zlib_codec();
     fs::path objects =
         fs::current_path() / ".git" / "objects";  // may not exist yet
     ObjectStore store{std::move(codec), objects}; // ctor should be lazy
@@ -54,6 +56,19 @@ int main(int argc, char *argv[]) {
     std::cerr << e.what() << "\n";
     return EXIT_FAILURE;
   }
-  ObjectStore store{std::move(codec), repo_root / ".git" / "objects"};
-  return cmd->execute(argc, argv, store);
+
+  // Loose objects are compressed with core.objectCodec (zlib by default);
+  // objects written under another codec stay readable.
+  // The store reads the rest of its settings (object format, compression
+  // levels) from the same file and throws on invalid values.
+  std::optional<ObjectStore> store;
+  try {
+    const auto cfg = Config::load(repo_root / ".git" / "config");
+    store.emplace(make_codec(cfg.get("core.objectCodec").value_or("zlib")),
+                  repo_root / ".git" / "objects");
+  } catch (const std::exception &e) {
+    std::cerr << e.what() << "\n";
+    return EXIT_FAILURE;
+  }
+  return cmd->execute(argc, argv, *store);
 }